@@ -0,0 +1,298 @@
+////----------------------------------------------------------------------------------
+//// Analysis benchmarks
+////----------------------------------------------------------------------------------
+// Runs every analysis stage in isolation on synthetic input, for a matrix of
+// buffer sizes and channel counts, and reports ns/frame, frames/s and heap
+// allocations per hop. `make bench` builds and runs it; `--json <path>` also
+// writes one JSON object per result line to a file, `--multires <levels>`
+// benchmarks the multi-resolution pitch bands as well.
+#define _GNU_SOURCE // Thread affinity in realtime.h
+#include <math.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#define SAMPLE_TYPE ma_float
+
+#include "audio.h"
+#include "audio_analysis.h"
+
+#define BENCH_MIN_TIME 0.2 // Seconds spent on each measurement
+#define BENCH_MIN_ITERATIONS 5
+
+static const size_t bench_sizes[] = {512, 1024, 2048, 4096};
+static const size_t bench_channels[] = {1, 2, 8};
+static const double bench_tones[] = {50.0, 120.0, 440.0, 1000.0, 2500.0, 5000.0, 8000.0, 12000.0}; // Tracked by the tones stage
+
+// Heap calls are counted through the linker: the bench target links with
+// -Wl,--wrap=malloc,... so every call lands here first, FFTW's included
+static atomic_ulong bench_allocations;
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void *__real_aligned_alloc(size_t alignment, size_t size);
+int __real_posix_memalign(void **ptr, size_t alignment, size_t size);
+void *__wrap_malloc(size_t size) {
+	atomic_fetch_add_explicit(&bench_allocations, 1, memory_order_relaxed);
+	return __real_malloc(size);
+}
+void *__wrap_calloc(size_t count, size_t size) {
+	atomic_fetch_add_explicit(&bench_allocations, 1, memory_order_relaxed);
+	return __real_calloc(count, size);
+}
+void *__wrap_realloc(void *ptr, size_t size) {
+	atomic_fetch_add_explicit(&bench_allocations, 1, memory_order_relaxed);
+	return __real_realloc(ptr, size);
+}
+void *__wrap_aligned_alloc(size_t alignment, size_t size) {
+	atomic_fetch_add_explicit(&bench_allocations, 1, memory_order_relaxed);
+	return __real_aligned_alloc(alignment, size);
+}
+int __wrap_posix_memalign(void **ptr, size_t alignment, size_t size) {
+	atomic_fetch_add_explicit(&bench_allocations, 1, memory_order_relaxed);
+	return __real_posix_memalign(ptr, alignment, size);
+}
+
+typedef struct {
+	const char *name;
+	void (*prepare)(void); // Untimed, runs before every iteration
+	void (*run)(void);     // Timed, one hop over every channel
+	int stereo;            // Needs two channels
+	int multires;          // Needs the multi-resolution filterbank
+} BenchStage;
+
+static SAMPLE_TYPE *bench_input; // Interleaved synthetic hop
+
+static double bench_now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// A few partials plus noise, so no stage hits a degenerate fast path
+static void bench_fill_input(size_t size, size_t channels) {
+	unsigned int seed = 1;
+	for (size_t t = 0; t < size; t++) {
+		for (size_t c = 0; c < channels; c++) {
+			seed = seed * 1664525u + 1013904223u;
+			double noise = (seed >> 8) / (double)(1 << 24) - 0.5;
+			double v = 0.4 * sin(2.0 * M_PI * 440.0 * (t + c) / 48000.0) +
+				0.2 * sin(2.0 * M_PI * 3100.0 * t / 48000.0) + 0.05 * noise;
+			bench_input[t * channels + c] = (SAMPLE_TYPE)v;
+		}
+	}
+}
+
+static void bench_deinterleave() {
+	for (size_t i = 0; i < g_audio_analysis->buffer.channels; i++) {
+		_analysis_task_copy((void *)i);
+	}
+}
+static void bench_time() {
+	for (size_t i = 0; i < g_audio_analysis->buffer.channels; i++) {
+		_analysis_time(i, ANALYSIS_TIME_DATA | ANALYSIS_NORM_AVG);
+	}
+}
+static void bench_fft() {
+	for (size_t i = 0; i < g_audio_analysis->buffer.channels; i++) {
+		_analysis_fft(i);
+	}
+}
+static void bench_magnitude() {
+	for (size_t i = 0; i < g_audio_analysis->buffer.channels; i++) {
+		_analysis_magnitude(i);
+	}
+}
+static void bench_smoothing() {
+	for (size_t i = 0; i < g_audio_analysis->buffer.channels; i++) {
+		_analysis_smooth(i);
+	}
+}
+static void bench_bands() {
+	for (size_t i = 0; i < g_audio_analysis->buffer.channels; i++) {
+		_analysis_pitch(i);
+	}
+}
+static void bench_multires() {
+	for (size_t i = 0; i < g_audio_analysis->buffer.channels; i++) {
+		_analysis_task_multires((void *)i);
+	}
+}
+static void bench_stereo() {
+	_analysis_task_stereo(NULL);
+}
+static void bench_loudness() {
+	_analysis_task_loudness(NULL);
+}
+static void bench_tones_stage() {
+	_analysis_task_tones(NULL);
+}
+static void bench_waveform() {
+	for (size_t i = 0; i < g_audio_analysis->buffer.channels; i++) {
+		_analysis_task_waveform((void *)i);
+	}
+}
+static void bench_fill_ring() {
+	// Queue one hop of captured audio, like the device callback does
+	AudioBuffer *buffer = &g_audio_analysis->buffer;
+	ma_uint32 frames = buffer->size;
+	void *write;
+	ma_pcm_rb_acquire_write(&g_audio_data->rb, &frames, &write);
+	memcpy(write, bench_input, frames * buffer->channels * sizeof(SAMPLE_TYPE));
+	ma_pcm_rb_commit_write(&g_audio_data->rb, frames);
+}
+static void bench_read_audio_data() {
+	ma_uint32 frames = g_audio_analysis->buffer.size;
+	SAMPLE_TYPE *raw_data = read_audio_data(&frames);
+	free(raw_data);
+}
+static void bench_hop() {
+	// Every stage through the task graph, with the configured workers
+	analysis_process_hop(bench_input, g_audio_analysis->buffer.size);
+}
+
+static const BenchStage bench_stages[] = {
+	{"deinterleave", NULL, bench_deinterleave, 0, 0},
+	{"time", NULL, bench_time, 0, 0},
+	{"fft", NULL, bench_fft, 0, 0},
+	{"magnitude", NULL, bench_magnitude, 0, 0},
+	{"smoothing", NULL, bench_smoothing, 0, 0},
+	{"bands", NULL, bench_bands, 0, 0},
+	{"multires", NULL, bench_multires, 0, 1},
+	{"stereo", NULL, bench_stereo, 1, 0},
+	{"loudness", NULL, bench_loudness, 0, 0},
+	{"tones", NULL, bench_tones_stage, 0, 0},
+	{"waveform", NULL, bench_waveform, 0, 0},
+	{"read_audio_data", bench_fill_ring, bench_read_audio_data, 0, 0},
+	{"hop", NULL, bench_hop, 0, 0},
+};
+#define BENCH_STAGE_COUNT (sizeof(bench_stages) / sizeof(bench_stages[0]))
+
+static void bench_report(FILE *json, const char *stage, size_t size, size_t channels, int threads, unsigned long iterations, double elapsed, unsigned long allocations) {
+	double ns_per_frame = elapsed * 1e9 / ((double)iterations * size);
+	double frames_per_second = 1e9 / ns_per_frame;
+	double allocations_per_hop = (double)allocations / iterations;
+	printf("%-16s %6zu %3zu %3d %12.3f %14.0f %10.2f\n", stage, size, channels, threads, ns_per_frame, frames_per_second, allocations_per_hop);
+	if (json != NULL) {
+		fprintf(json, "{\"stage\":\"%s\",\"size\":%zu,\"channels\":%zu,\"threads\":%d,\"iterations\":%lu,"
+			"\"ns_per_frame\":%.3f,\"frames_per_second\":%.0f,\"allocations_per_hop\":%.2f}\n",
+			stage, size, channels, threads, iterations, ns_per_frame, frames_per_second, allocations_per_hop);
+	}
+}
+
+static void bench_usage(FILE *out, const char *program) {
+	fprintf(out, "Usage: %s [--json <path>] [--multires <levels>]\n", program);
+}
+
+int main(int argc, char **argv) {
+	const char *json_path = NULL;
+	size_t multires_levels = 0;
+	// Anything not understood stops the run, a typo would otherwise benchmark something else
+	for (int a = 1; a < argc; a++) {
+		if (strcmp(argv[a], "--help") == 0 || strcmp(argv[a], "-h") == 0) {
+			bench_usage(stdout, argv[0]);
+			return 0;
+		} else if (strcmp(argv[a], "--json") == 0 && a + 1 < argc) {
+			json_path = argv[++a];
+		} else if (strcmp(argv[a], "--multires") == 0 && a + 1 < argc) {
+			char *end;
+			multires_levels = strtoul(argv[++a], &end, 10);
+			if (*end != '\0' || multires_levels == 0 || multires_levels > MULTIRES_MAX_LEVELS) {
+				fprintf(stderr, "Error: Invalid argument for --multires option.\n");
+				return 1;
+			}
+		} else if (strcmp(argv[a], "--json") == 0 || strcmp(argv[a], "--multires") == 0) {
+			fprintf(stderr, "Error: No value provided for %s.\n", argv[a]);
+			bench_usage(stderr, argv[0]);
+			return 1;
+		} else {
+			fprintf(stderr, "Error: Unknown option '%s'.\n", argv[a]);
+			bench_usage(stderr, argv[0]);
+			return 1;
+		}
+	}
+	FILE *json = NULL;
+	if (json_path != NULL) {
+		json = fopen(json_path, "w");
+		if (json == NULL) {
+			fprintf(stderr, "Error: Failed to open %s\n", json_path);
+			return 1;
+		}
+	}
+
+	for (size_t s = 0; s < sizeof(bench_sizes) / sizeof(bench_sizes[0]); s++) {
+		for (size_t c = 0; c < sizeof(bench_channels) / sizeof(bench_channels[0]); c++) {
+			size_t size = bench_sizes[s];
+			size_t channels = bench_channels[c];
+
+			AudioAnalysisConfig config = init_audio_analysis_config();
+			config.buffer_size = size;
+			config.channels = channels;
+			config.multires_levels = multires_levels;
+			config.tone_frequencies = bench_tones;
+			config.tone_count = sizeof(bench_tones) / sizeof(bench_tones[0]);
+			config.waveform_seconds = WAVEFORM_PYRAMID_DEFAULT_SECONDS;
+
+			if (create_analysis(&config) != 0) {
+				fprintf(stderr, "Error: Failed to create the analysis for %zu x %zu\n", size, channels);
+				return 1;
+			}
+			analysis_subscribe(ANALYSIS_CONSUMER_RENDERER, ANALYSIS_ALL);
+
+			// read_audio_data reads the ring buffer of the capture device
+			g_audio_data = (AudioData *)calloc(1, sizeof(AudioData));
+			ma_pcm_rb_init(ma_format_f32, channels, size * 2, NULL, NULL, &g_audio_data->rb);
+			g_audio_device.capture.format = ma_format_f32;
+			g_audio_device.capture.channels = channels;
+
+			bench_input = (SAMPLE_TYPE *)malloc(sizeof(SAMPLE_TYPE) * size * channels);
+			bench_fill_input(size, channels);
+			_analysis_hop.raw_data = bench_input;
+			_analysis_hop.frames = size;
+			_analysis_hop.outputs = analysis_resolve_outputs(ANALYSIS_ALL);
+			_analysis_hop.full = 1; // The stages of the whole buffer run on every call
+			_analysis_hop.buffered = 1;
+
+			int threads = g_audio_analysis->pool->worker_count + 1;
+			printf("%-16s %6s %3s %3s %12s %14s %10s\n", "stage", "size", "ch", "thr", "ns/frame", "frames/s", "allocs/hop");
+			for (size_t k = 0; k < BENCH_STAGE_COUNT; k++) {
+				const BenchStage *stage = &bench_stages[k];
+				if (stage->stereo && g_audio_analysis->stereo == NULL) {
+					continue;
+				}
+				if (stage->multires && g_audio_analysis->multires == NULL) {
+					continue;
+				}
+				// Warm up caches, FFTW and the pool workers
+				if (stage->prepare) stage->prepare();
+				stage->run();
+
+				unsigned long iterations = 0;
+				double elapsed = 0.0;
+				unsigned long allocations = 0;
+				while (elapsed < BENCH_MIN_TIME || iterations < BENCH_MIN_ITERATIONS) {
+					if (stage->prepare) stage->prepare();
+					unsigned long before = atomic_load(&bench_allocations);
+					double start = bench_now();
+					stage->run();
+					elapsed += bench_now() - start;
+					allocations += atomic_load(&bench_allocations) - before;
+					iterations++;
+				}
+				bench_report(json, stage->name, size, channels, threads, iterations, elapsed, allocations);
+			}
+
+			free(bench_input);
+			ma_pcm_rb_uninit(&g_audio_data->rb);
+			free(g_audio_data);
+			g_audio_data = NULL;
+			analysis_subscribe(ANALYSIS_CONSUMER_RENDERER, 0);
+			destroy_analysis();
+			printf("\n");
+		}
+	}
+	if (json != NULL) {
+		fclose(json);
+	}
+	return 0;
+}
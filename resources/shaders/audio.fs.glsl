@@ -11,6 +11,10 @@ uniform sampler2D u_audio_channel_0;
 uniform sampler2D u_audio_channel_1;
 uniform sampler2D u_spectrum_channel_0;
 uniform sampler2D u_spectrum_channel_1;
+uniform sampler2D u_stereo;         // rows: correlation, balance, mid energy, side energy
+uniform vec4 u_stereo_summary;      // correlation, balance, delay (samples), delay confidence
+uniform sampler2D u_spectrogram;    // pitch history, u_spectrogram_row.y rows per channel stacked vertically
+uniform ivec2 u_spectrogram_row;    // newest row, rows per channel
 uniform vec2 u_resolution;
 uniform int u_buffer_size;
 uniform float u_time;
@@ -29,14 +33,16 @@ void main(){
 
 void main_2()
 {
-	// Sample stereo audio data
+	// Stereo field per band, computed once per hop by the analysis thread
 	vec2 st = fragTexCoord;
-	float rightChannel = texture(u_audio_channel_0, st).x;
-	float leftChannel = texture(u_audio_channel_1, st).x;
+	float correlation = texture(u_stereo, vec2(st.x, 0.125)).x;
+	float balance = texture(u_stereo, vec2(st.x, 0.375)).x * 0.5 + 0.5; // -1..1 to 0..1
+	float mid = texture(u_stereo, vec2(st.x, 0.625)).x;
+	float side = texture(u_stereo, vec2(st.x, 0.875)).x;
 
-	// Calculate amplitude and phase information
-	float amplitude = length(vec2(leftChannel, rightChannel));
-	float stereoWidth = abs(leftChannel - rightChannel);
+	// Calculate amplitude and width information
+	float amplitude = sqrt(mid + side);
+	float stereoWidth = 1.0 - correlation;
 
 	// Create color based on audio characteristics
 	vec3 color;
@@ -44,16 +50,13 @@ void main_2()
 	// Color mapping based on stereo characteristics
 	if (amplitude > 0.001)
 	{
-		// Hue based on left/right balance
-		float balance = (leftChannel + 1.0) / 2.0; // Normalize to 0-1
-
 		// Create color gradient
 		color.x = amplitude * (1.0 - balance) * 2.0;           // More red for left
 		color.y = amplitude * min(balance * 2.0, (1.0 - balance) * 2.0); // Green for center
 		color.z = amplitude * balance * 2.0;                    // More blue for right
 
 		// Add stereo width information
-		color += vec3(stereoWidth * 0.5);
+		color += vec3(stereoWidth * 0.5 * u_stereo_summary.w);
 	}
 	else {
 		color = vec3(0.0); // Default color if no audio
@@ -64,3 +67,22 @@ void main_2()
 
 	finalColor = vec4(color, 1.0);
 }
+
+// Pitch of a channel `age` hops ago, band in 0..1
+float spectrogram(int channel, float band, int age)
+{
+	int rows = u_spectrogram_row.y;
+	int row = (u_spectrogram_row.x - age % rows + rows) % rows;
+	int x = int(band * float(textureSize(u_spectrogram, 0).x - 1));
+	return texelFetch(u_spectrogram, ivec2(x, channel * rows + row), 0).x;
+}
+
+void main_3()
+{
+	// Waterfall: newest hop at the top, older hops scroll down
+	vec2 st = fragTexCoord;
+	int age = int(st.y * float(u_spectrogram_row.y - 1));
+	float left = spectrogram(0, st.x, age);
+	float right = spectrogram(1, st.x, age);
+	finalColor = vec4(left, 0.5 * (left + right), right, 1.0);
+}
@@ -0,0 +1,20 @@
+#version 330 core
+
+// Input from vertex shader
+in vec2 fragTexCoord;
+
+// Output
+out vec4 finalColor;
+
+// Uniforms
+uniform vec4 u_color;
+uniform int u_layer;         // 0 bars, 1 ticks, 2 labels
+uniform sampler2D u_labels;  // Label atlas, one cell per bar
+
+void main(){
+	if (u_layer == 2) {
+		finalColor = vec4(u_color.rgb, u_color.a * texture(u_labels, fragTexCoord).a);
+	} else {
+		finalColor = u_color;
+	}
+}
@@ -0,0 +1,46 @@
+#version 330 core
+
+// Instanced bars, one instance per bar, see bar_renderer.h
+
+// Input vertex attributes
+layout(location = 0) in vec2 a_corner; // Corner of the unit quad, y grows downwards
+layout(location = 1) in vec2 a_value;  // Value of the bar, or its low and high end for ranges, advances once per instance
+
+// Output to fragment shader
+out vec2 fragTexCoord;
+
+// Uniforms
+uniform mat4 u_modelview;
+uniform mat4 u_projection;
+uniform vec4 u_bar;          // x of the first bar, baseline, bar width, pixels per unit of value
+uniform vec3 u_shape;        // share of the length drawn, minimum pixels, bars from the baseline (0), trace (1) or range (2)
+uniform int u_layer;         // 0 bars, 1 ticks, 2 labels
+uniform vec3 u_label;        // label cell width, height, labels in the atlas
+
+void main(){
+	float len = abs(a_value.x) * u_bar.w;
+	float height = len * u_shape.x + u_shape.y;
+	float top = u_bar.y - height;
+	if (u_shape.z > 1.5) {
+		// From the low to the high value, the minimum pixels centered on it
+		height = (a_value.y - a_value.x) * u_bar.w + u_shape.y;
+		top = u_bar.y - a_value.y * u_bar.w - 0.5 * u_shape.y;
+	} else if (u_shape.z > 0.0) {
+		top = a_value.x > 0.0 ? u_bar.y - len : u_bar.y + len - height;
+	}
+	float left = u_bar.x + float(gl_InstanceID) * u_bar.z;
+	vec2 size = vec2(u_bar.z, height);
+	if (u_layer == 1) {
+		size = vec2(1.0, u_bar.y - top);
+	} else if (u_layer == 2) {
+		left += 2.0;
+		top -= u_label.y;
+		size = u_label.xy;
+	} else if (a_value.x == 0.0 && u_shape.z < 1.5) {
+		size = vec2(0.0); // Silent bars are not drawn, their ticks and labels are
+	}
+	vec2 position = vec2(left, top) + a_corner * size;
+	// Render textures are stored upside down
+	fragTexCoord = vec2((float(gl_InstanceID) + a_corner.x) / u_label.z, 1.0 - a_corner.y);
+	gl_Position = u_projection * u_modelview * vec4(position, 0.0, 1.0);
+}
@@ -7,27 +7,32 @@ in vec2 fragTexCoord;
 out vec4 finalColor;
 
 // Uniforms
-uniform sampler2D u_audio_channel_0;
-uniform sampler2D u_audio_channel_1;
-uniform sampler2D u_spectrum_channel_0;
-uniform sampler2D u_spectrum_channel_1;
-uniform vec2 u_resolution;
-uniform int u_buffer_size;
-uniform float u_signal;
-uniform float u_time;
-
-#define audio0(_x) (texture(u_audio_channel_0, vec2(_x, 0.0)).x)
-#define audio1(_x) (texture(u_audio_channel_1, vec2(_x, 0.0)).x)
-#define spectrum0(_x) (texture(u_spectrum_channel_0, vec2(_x, 0.0)).x)
-#define spectrum1(_x) (texture(u_spectrum_channel_1, vec2(_x, 0.0)).x)
+uniform sampler2D u_features;       // Feature atlas, layout in feature_atlas.h
+layout(std140) uniform AudioFeatures {
+	vec4 u_stereo_summary;          // correlation, balance, delay (samples), delay confidence
+	vec4 u_loudness;                // momentary, short-term, integrated (LUFS), true-peak (dBTP)
+	vec4 u_signal;                  // average level of channels 0..3
+	vec4 u_clock;                   // seconds, resolution x, resolution y, frames analysed
+	ivec4 u_layout;                 // samples, bins, tones, channels
+	ivec4 u_history;                // history rows, newest history row, atlas width, atlas height
+};
+
+#define u_time (u_clock.x)
+#define u_resolution (u_clock.yz)
+// _x in 0..1 across the `_count` values of an atlas row
+#define feature(_row, _x, _count) (texture(u_features, vec2((_x) * float(_count) / float(u_history.z), (float(_row) + 0.5) / float(u_history.w))))
+#define audio0(_x) (feature(0, _x, u_layout.x).r)
+#define audio1(_x) (feature(0, _x, u_layout.x).g)
+#define spectrum0(_x) (feature(1, _x, u_layout.y).r)
+#define spectrum1(_x) (feature(1, _x, u_layout.y).g)
 
 float avgFreq(float start, float end, float step) {
     float div = 0.0;
     float total = 0.0;
     for (float pos = start; pos < end; pos += step) {
         div += 2.0;
-        total += texture(u_spectrum_channel_0, vec2(pos)).x;
-        total += texture(u_spectrum_channel_1, vec2(pos)).x;
+        total += spectrum0(pos);
+        total += spectrum1(pos);
     }
     return total / div;
 }
@@ -8,6 +8,26 @@ typedef struct {
 	int is_running;
 	int show_menu;
 	int fullscreen; // Flag to indicate if the application is in fullscreen mode
+	char *record_path; // Feature stream to record the analysis to, NULL if not recording
+	char *replay_path; // Feature stream drawn instead of the live analysis, NULL to capture audio
+	int replay_step;   // Draw one recorded hop per frame instead of following the recording clock
+	int show_profiler; // Stage timings overlay, toggled with F3
+	int show_visual;   // Shader visual behind the bars, toggled with F2
+	char *trace_path;  // Chrome trace written on exit, NULL if not tracing
+	size_t latency_clicks; // Clicks injected by the latency harness, 0 to capture audio
+	size_t multires_levels; // Levels of the multi-resolution pitch bands, 0 for a single transform
+	double *tone_frequencies; // Frequencies tracked by the sliding DFT bank, NULL if none
+	size_t tone_count;
+	char *realtime; // Scheduling of the audio path given to --realtime, NULL for the default scheduler
+	int power_save;  // Throttle unfocused windows and silent input, hidden windows always are
+	float silence_gate_db; // dBFS peak under which the input counts as silent
+	double silence_timeout; // Seconds of silence before going idle
+	int adaptive_quality; // Step render quality and resolution down under load
+	int adaptive_analysis; // Step analysis quality down under load as well
+	int interpolate; // Blend the two newest hops for the time a frame is shown
+	size_t buffer_size; // Samples of the analysis buffer, 0 for twice the screen width
+	int fps; // Frames drawn per second, 0 for the refresh rate of the display
+	double waveform_seconds; // History of the waveform drawn under the bars, 0 draws none
 } Application;
 
 Application* init_application() {
@@ -19,11 +39,32 @@ Application* init_application() {
 	app->is_running = 1;
 	app->show_menu = 0;
 	app->fullscreen = 1; // Initialize fullscreen to true
+	app->record_path = NULL;
+	app->replay_path = NULL;
+	app->replay_step = 0;
+	app->show_profiler = 0;
+	app->show_visual = 0;
+	app->trace_path = NULL;
+	app->latency_clicks = 0;
+	app->multires_levels = 0;
+	app->tone_frequencies = NULL;
+	app->tone_count = 0;
+	app->realtime = NULL;
+	app->power_save = 0;
+	app->silence_gate_db = -60.0f;
+	app->silence_timeout = 30.0;
+	app->adaptive_quality = 1;
+	app->adaptive_analysis = 0;
+	app->interpolate = 1;
+	app->buffer_size = 0;
+	app->fps = 0;
+	app->waveform_seconds = 0.0;
 
 	return app;
 }
 void uinit_application(Application *app) {
 	if (app != NULL) {
+		free(app->tone_frequencies);
 		free(app);
 		app = NULL;
 	}
@@ -0,0 +1,74 @@
+#ifndef ARENA_H
+#define ARENA_H
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Bump allocator over a single zeroed block.
+// Every allocation starts on a cache line, so rows of different channels or
+// stages never share one. Modules expose a *_arena_size() function mirroring
+// their allocations so the whole block can be sized up front.
+
+#define ARENA_ALIGNMENT 64
+
+typedef struct {
+	unsigned char *base;
+	size_t capacity;
+	size_t used;
+} Arena;
+
+// Bytes taken by an allocation of `size` bytes, padding included
+static inline size_t arena_size(size_t size) {
+	return (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+}
+
+// Bytes taken by arena_alloc_rows
+static inline size_t arena_rows_size(size_t count, size_t row_size) {
+	return arena_size(sizeof(void *) * count) + count * arena_size(row_size);
+}
+
+int arena_init(Arena *arena, size_t capacity) {
+	arena->capacity = arena_size(capacity);
+	arena->used = 0;
+	arena->base = (unsigned char *)aligned_alloc(ARENA_ALIGNMENT, arena->capacity > 0 ? arena->capacity : ARENA_ALIGNMENT);
+	if (arena->base == NULL) {
+		printf("Error: Failed to allocate an arena of %zu bytes\n", arena->capacity);
+		arena->capacity = 0;
+		return -1;
+	}
+	// Zeroing also faults every page in, so the hot path never does
+	memset(arena->base, 0, arena->capacity);
+	return 0;
+}
+
+void arena_free(Arena *arena) {
+	free(arena->base);
+	arena->base = NULL;
+	arena->capacity = 0;
+	arena->used = 0;
+}
+
+// Zeroed, cache line aligned allocation, NULL once the arena is exhausted
+void *arena_alloc(Arena *arena, size_t size) {
+	size_t padded = arena_size(size);
+	if (arena->base == NULL || arena->used + padded > arena->capacity) {
+		printf("Error: Arena exhausted (%zu of %zu bytes used, %zu requested)\n", arena->used, arena->capacity, padded);
+		return NULL;
+	}
+	void *ptr = arena->base + arena->used;
+	arena->used += padded;
+	return ptr;
+}
+
+// Array of `count` pointers to rows of `row_size` bytes, each row on its own cache line
+void **arena_alloc_rows(Arena *arena, size_t count, size_t row_size) {
+	void **rows = (void **)arena_alloc(arena, sizeof(void *) * count);
+	if (rows == NULL) return NULL;
+	for (size_t i = 0; i < count; i++) {
+		rows[i] = arena_alloc(arena, row_size);
+		if (rows[i] == NULL) return NULL;
+	}
+	return rows;
+}
+#endif // ARENA_H
@@ -5,9 +5,12 @@
 #include <fftw3.h>
 #include <miniaudio.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stddef.h>
 #include <stdlib.h>
 #include <time.h>
+#include "profiler.h"
+#include "realtime.h"
 
 #ifndef SAMPLE_TYPE
 #define SAMPLE_TYPE ma_float
@@ -21,11 +24,13 @@ typedef struct {
 typedef enum {
 	AUDIO_SOURCE_TYPE_INLINE,		  // inline input
 	AUDIO_SOURCE_TYPE_FILE,	  // Audio file input
+	AUDIO_SOURCE_TYPE_GENERATOR, // No device, the application writes the ring buffer itself (latency_probe.h)
 } AudioSourceType;
 
 typedef struct {
 	ma_uint32 sample_rate;
 	size_t buffer_size;
+	size_t ring_size; // Frames the ring buffer holds between the capture and the analysis
 	AudioSourceType source_type; // Type of audio source (e.g., inline, file)
 	char *file_path; // Path to the audio file if source_type is AUDIO_SOURCE_TYPE_FILE
 
@@ -37,6 +42,7 @@ typedef struct {
 	ma_uint32 playback_channels;
 	ma_device_id* playback_device_id;
 
+	ThreadSchedule schedule; // Of the device thread running the callbacks, and the decoder of file sources
 } AudioConfig;
 
 typedef struct {
@@ -54,6 +60,14 @@ static ma_device g_audio_device;
 
 static int _is_audio_initialized = 0; // Flag to indicate if audio is initialized
 
+static int _is_audio_device_initialized = 0; // Generator sources run without a device
+
+static atomic_ullong _audio_capture_time; // profile_now() when the last captured frames reached the ring buffer
+static atomic_int _audio_capture_timing;  // Capture times are wanted without profiling, see audio_capture_timing
+
+static ThreadSchedule _audio_schedule; // Applied by the device thread on its first callback
+static __thread int _audio_thread_scheduled = 0;
+
 AudioData *get_audio_data() {
 	return g_audio_data;
 }
@@ -62,6 +76,32 @@ int is_audio_initialized() {
 	return _is_audio_initialized;
 }
 
+// Time the newest frames in the ring buffer were captured at, 0 before the first callback.
+// Callbacks only read the clock for it while profiling or after audio_capture_timing(1)
+uint64_t audio_capture_time() {
+	return atomic_load_explicit(&_audio_capture_time, memory_order_acquire);
+}
+
+// Stamp captured frames even with the profiler disabled, for consumers of capture times
+void audio_capture_timing(int enabled) {
+	atomic_store_explicit(&_audio_capture_timing, enabled != 0, memory_order_relaxed);
+}
+
+// Start of a callback: its profile start, or the clock only when capture times are wanted
+static inline uint64_t _audio_callback_begin(uint64_t *captured) {
+	uint64_t start = profile_begin();
+	*captured = start != 0 ? start : atomic_load_explicit(&_audio_capture_timing, memory_order_relaxed) ? profile_now() : 0;
+	return start;
+}
+
+// End of a callback that wrote the ring buffer
+static inline void _audio_callback_end(uint64_t start, uint64_t captured, ma_uint32 frameCount) {
+	if (captured != 0) {
+		atomic_store_explicit(&_audio_capture_time, captured, memory_order_release);
+	}
+	profile_end_arg(PROFILE_CALLBACK, start, frameCount);
+}
+
 int init_audio_context() {
 	// Initialize the audio context
 	if (ma_context_init(NULL, 0, NULL, &g_audio_context) != MA_SUCCESS) {
@@ -89,13 +129,13 @@ SAMPLE_TYPE* read_audio_data(ma_uint32 *sizeInFrames) {
 		return NULL;
 	}
 
-	if (sizeInFrames == 0) {
+	if (*sizeInFrames == 0) {
 		ma_pcm_rb_commit_read(&audio_data->rb, 0);
 		return NULL; // No data to read
 	}
 
 	// Calculate the size in bytes to read
-	ma_uint32 bytesPerFrame = ma_get_bytes_per_frame(g_audio_device.capture.format, g_audio_device.capture.channels);
+	ma_uint32 bytesPerFrame = ma_get_bytes_per_frame(audio_data->rb.format, audio_data->rb.channels);
 	raw_data = malloc(*sizeInFrames * bytesPerFrame);
 	if (raw_data == NULL) {
 		printf("Failed to allocate memory for audio data\n");
@@ -113,6 +153,14 @@ SAMPLE_TYPE* read_audio_data(ma_uint32 *sizeInFrames) {
 
 void ma_callback_file(ma_device *pDevice, void *pOutput, const void *pInput, ma_uint32 frameCount) {
 	if (frameCount == 0) return;
+	uint64_t captured;
+	uint64_t start = _audio_callback_begin(&captured);
+	profile_thread_name("audio");
+	if (!_audio_thread_scheduled) {
+		// The device thread belongs to miniaudio, it can only be scheduled from inside
+		_audio_thread_scheduled = 1;
+		thread_schedule_apply("audio", &_audio_schedule);
+	}
 
 	AudioData *audio_data = (AudioData *)pDevice->pUserData;
 
@@ -144,11 +192,19 @@ void ma_callback_file(ma_device *pDevice, void *pOutput, const void *pInput, ma_
 	// ma_copy_and_apply_volume_factor_pcm_frames(void *pFramesOut, const void *pFramesIn, ma_uint64 frameCount, ma_format format, ma_uint32 channels, float factor)
 	ma_copy_pcm_frames(pOutput, pOutputBuffer, framesRead, audio_data->rb.format, audio_data->rb.channels);
 	free(pOutputBuffer);
+	_audio_callback_end(start, captured, frameCount);
 	// MA_COPY_MEMORY(pOutput, pBuffer, frameCount * ma_get_bytes_per_frame(pDevice->playback.format, pDevice->playback.channels));
 }
 
 void ma_callback_inline(ma_device *pDevice, void *pOutput, const void *pInput, ma_uint32 frameCount) {
 	if (frameCount == 0) return;
+	uint64_t captured;
+	uint64_t start = _audio_callback_begin(&captured);
+	profile_thread_name("audio");
+	if (!_audio_thread_scheduled) {
+		_audio_thread_scheduled = 1;
+		thread_schedule_apply("audio", &_audio_schedule);
+	}
 
 	AudioData *audio_data = (AudioData *)pDevice->pUserData;
 
@@ -170,7 +226,7 @@ void ma_callback_inline(ma_device *pDevice, void *pOutput, const void *pInput, m
 		printf("Failed to commit write buffer: %s\n", ma_result_description(result));
 		return;
 	}
-
+	_audio_callback_end(start, captured, frameCount);
 }
 
 ma_decoder_config g_decoder_config;
@@ -180,7 +236,7 @@ AudioData *_init_audio_data(AudioConfig *config) {
 	ma_result result = ma_pcm_rb_init(
 		config->capture_format,
 		config->capture_channels,
-		1200,
+		config->ring_size,
 		NULL,
 		NULL,
 		&audio_data->rb
@@ -248,6 +304,7 @@ AudioConfig init_audio_config() {
 	AudioConfig config;
 	config.sample_rate = 48000; // Default sample rate
 	config.buffer_size = 1200;   // Default buffer size
+	config.ring_size = 1200;     // Default ring buffer size
 	config.source_type = AUDIO_SOURCE_TYPE_INLINE; // Default source type is inline
 
 	config.capture_format = ma_format_f32;
@@ -257,6 +314,7 @@ AudioConfig init_audio_config() {
 	config.playback_format = ma_format_f32;
 	config.playback_channels = 2;           // Stereo
 	config.playback_device_id = NULL;       // Use default playback device
+	config.schedule = thread_schedule_default();
 	AudioDevicesInfo devices_info = get_audio_devices_info();
 	if (devices_info.capture_device_count > 0) {
 		for (ma_uint32 i = 0; i < devices_info.capture_device_count; i++) {
@@ -304,6 +362,7 @@ int _init_device(AudioConfig *config) {
 		return result;
 	}
 	ma_device_start(&g_audio_device);
+	config->sample_rate = g_audio_device.sampleRate; // The device may not run at the requested rate
 
 	printf("Audio device initialized successfully\n");
 	return 0;
@@ -317,6 +376,7 @@ int init_audio(AudioConfig *config) {
 		return -1;
 	}
 
+	_audio_schedule = config->schedule;
 	g_audio_data = _init_audio_data(config);
 	if (g_audio_data == NULL) {
 		printf("Failed to initialize audio data\n");
@@ -324,9 +384,12 @@ int init_audio(AudioConfig *config) {
 	}
 
 	// if (_init_device(g_audio_data, &pCaptureInfos[*capture_device_index].id, &pPlaybackInfos[*playback_device_index].id) != 0) {
-	if (_init_device(config) != 0) {
-		printf("Failed to initialize audio device\n");
-		abort();
+	if (config->source_type != AUDIO_SOURCE_TYPE_GENERATOR) {
+		if (_init_device(config) != 0) {
+			printf("Failed to initialize audio device\n");
+			abort();
+		}
+		_is_audio_device_initialized = 1;
 	}
 
 
@@ -341,8 +404,11 @@ void close_audio() {
 		printf("Audio data is not initialized\n");
 		return;
 	}
-	ma_device_stop(&g_audio_device);
-	ma_device_uninit(&g_audio_device);
+	if (_is_audio_device_initialized) {
+		ma_device_stop(&g_audio_device);
+		ma_device_uninit(&g_audio_device);
+		_is_audio_device_initialized = 0;
+	}
 	ma_pcm_rb_uninit(&g_audio_data->rb);
 	if (g_audio_data->decoder != NULL) {
 		ma_decoder_uninit(g_audio_data->decoder);
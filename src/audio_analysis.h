@@ -3,20 +3,117 @@
 #include <fftw3.h>
 #include <math.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stddef.h>
 #include <stdlib.h>
 #include <time.h>
 #include "audio.h"
 #define MA_TYPE double
 #include "moving_average.h"
+#include "stereo_analysis.h"
+#include "loudness.h"
+#include "spectrogram.h"
+#include "waveform_pyramid.h"
+#include "multires.h"
+#include "tone_tracker.h"
+#include "feature_stream.h"
+#include "thread_pool.h"
+#include "realtime.h"
+#include "quality.h"
 
 #ifndef SAMPLE_TYPE
 #define SAMPLE_TYPE ma_int32
 #endif
 
+#define ANALYSIS_NUM_BINS 125 // Number of logarithmic bins for pitch calculation
+
+// Outputs of the analysis stages. Consumers subscribe to the ones they read and
+// fft_loop only runs the stages needed to produce them.
+typedef enum {
+	ANALYSIS_TIME_DATA = 1 << 0, // time_data
+	ANALYSIS_FREQ_DATA = 1 << 1, // freq_data
+	ANALYSIS_PITCH     = 1 << 2, // pitch
+	ANALYSIS_NORM_AVG  = 1 << 3, // norm_avg
+	ANALYSIS_STEREO    = 1 << 4, // stereo
+	ANALYSIS_LOUDNESS  = 1 << 5, // loudness
+	ANALYSIS_SPECTROGRAM = 1 << 6, // spectrogram
+	ANALYSIS_TONES     = 1 << 7, // tones
+	ANALYSIS_WAVEFORM  = 1 << 8, // waveform
+	ANALYSIS_FRAMES    = 1 << 9, // buffer.frames, internal
+	ANALYSIS_SPECTRUM  = 1 << 10, // fft_out, internal
+	ANALYSIS_ALL       = (1 << 9) - 1,
+} AnalysisOutput;
+
+typedef enum {
+	ANALYSIS_CONSUMER_RENDERER,
+	ANALYSIS_CONSUMER_RECORDER,
+	ANALYSIS_CONSUMER_NETWORK,
+	ANALYSIS_CONSUMER_COUNT
+} AnalysisConsumer;
+
+// How the pitch bands are computed
+typedef enum {
+	ANALYSIS_MODE_SINGLE   = 1 << 0, // From the spectrum of the whole buffer
+	ANALYSIS_MODE_MULTIRES = 1 << 1, // From a multi-resolution filterbank, see multires.h
+	ANALYSIS_MODE_ANY      = ANALYSIS_MODE_SINGLE | ANALYSIS_MODE_MULTIRES,
+} AnalysisMode;
+
+typedef struct {
+	const char *name;
+	unsigned int outputs;  // Outputs written by the stage
+	unsigned int requires; // Outputs of other stages read by the stage
+	unsigned int modes;    // Modes the stage runs in
+} AnalysisStage;
+
+static const AnalysisStage _analysis_stages[] = {
+	{"copy",      ANALYSIS_FRAMES,                       0,                                    ANALYSIS_MODE_ANY},
+	{"time",      ANALYSIS_TIME_DATA | ANALYSIS_NORM_AVG, ANALYSIS_FRAMES,                     ANALYSIS_MODE_ANY},
+	{"fft",       ANALYSIS_SPECTRUM,                     ANALYSIS_TIME_DATA,                   ANALYSIS_MODE_ANY},
+	{"magnitude", ANALYSIS_FREQ_DATA,                    ANALYSIS_SPECTRUM,                    ANALYSIS_MODE_ANY},
+	{"pitch",     ANALYSIS_PITCH,                        ANALYSIS_FREQ_DATA,                   ANALYSIS_MODE_SINGLE},
+	{"multires",  ANALYSIS_PITCH,                        0,                                    ANALYSIS_MODE_MULTIRES},
+	{"stereo",    ANALYSIS_STEREO,                       ANALYSIS_SPECTRUM | ANALYSIS_TIME_DATA, ANALYSIS_MODE_ANY},
+	{"loudness",  ANALYSIS_LOUDNESS,                     0,                                    ANALYSIS_MODE_ANY},
+	{"spectrogram", ANALYSIS_SPECTROGRAM,                ANALYSIS_PITCH,                       ANALYSIS_MODE_ANY},
+	{"tones",     ANALYSIS_TONES,                        0,                                    ANALYSIS_MODE_ANY},
+	{"waveform",  ANALYSIS_WAVEFORM,                     0,                                    ANALYSIS_MODE_ANY},
+};
+#define ANALYSIS_STAGE_COUNT (sizeof(_analysis_stages) / sizeof(_analysis_stages[0]))
+
+static atomic_uint _analysis_subscriptions[ANALYSIS_CONSUMER_COUNT]; // Outputs requested by each consumer
+static atomic_int _analysis_paused[ANALYSIS_CONSUMER_COUNT]; // Consumers whose outputs are not computed for now
+static atomic_int _analysis_idle; // The input is silent, only the recorder is served
+
+// Quality levels of the analysis, stepped through by its QualityGovernor under load
+typedef enum {
+	ANALYSIS_QUALITY_FULL,
+	ANALYSIS_QUALITY_NO_SMOOTHING, // freq_data is not averaged over hops
+	ANALYSIS_QUALITY_HALF_FFT,     // The transform covers half the buffer, stereo keeps its last values
+	ANALYSIS_QUALITY_QUARTER_FFT,  // A quarter of the buffer
+	ANALYSIS_QUALITY_COUNT
+} AnalysisQuality;
+
+static const char *const _analysis_quality_names[ANALYSIS_QUALITY_COUNT] = {"full", "no smoothing", "half fft", "quarter fft"};
+
+#define ANALYSIS_IDLE_POLL_US 10000 // Ring buffer poll interval while idle, well under the 25ms the default ring holds
+
 typedef struct {
 	size_t buffer_size; // Size of the buffer for FFT
 	size_t channels;   // Number of channels
+	unsigned int sample_rate; // Sample rate of the capture stream
+	int threads;       // Worker threads besides the analysis thread, 0 runs every stage serially
+	size_t spectrogram_rows; // Hops of pitch history kept per channel
+	const char *record_path; // Feature stream file written while the analysis runs, NULL to not record
+	size_t multires_levels; // Levels of the multi-resolution pitch bands, 0 reads them off the whole buffer
+	const double *tone_frequencies; // Frequencies tracked on every sample, see tone_tracker.h
+	size_t tone_count; // Number of tone_frequencies, 0 to not track any
+	double tone_window; // Seconds of signal each tracked magnitude covers
+	double waveform_seconds; // Seconds of waveform history in the min/max/RMS pyramid, 0 keeps none
+	ThreadSchedule schedule; // Of the analysis thread, the pool workers take the following cores
+	int lock_memory;   // Lock the analysis state in memory and fault in the stacks of its threads
+	float silence_gate; // Peak under which a hop counts as silent, 0 never idles
+	double silence_timeout; // Seconds of silent hops before the analysis idles
+	int adaptive_quality; // Step down the AnalysisQuality when hops take too long, 0 (default) keeps full quality
 } AudioAnalysisConfig;
 
 typedef struct {
@@ -24,20 +121,61 @@ typedef struct {
 	size_t channels;
 	size_t frames_count;
 	size_t frames_cursor;
+	int stale; // A hop of the current fill skipped the copy, the fill is not analysed
 	SAMPLE_TYPE **frames;
 } AudioBuffer;
 
 
+// Bytes of analysis state per stage, all of it is carved from a single arena
 typedef struct {
-	double *fft_in;     // Input for FFT
-	double *fft_out;    // Output for FFT
+	size_t frames;    // Captured samples of each channel
+	size_t time;      // time_data and norm_avg
+	size_t spectrum;  // fft_out and freq_data
+	size_t smoothing; // Moving average history of freq_data
+	size_t pitch;     // pitch and the bin edges
+	size_t stereo;
+	size_t loudness;
+	size_t spectrogram;
+	size_t multires;
+	size_t tones;
+	size_t waveform;
+	size_t total;     // Everything above plus the AudioAnalysis itself
+} AnalysisMemoryBudget;
+
+typedef struct {
+	Arena arena;        // Backs the whole structure, released at once by close_analysis
+	double **fft_out;   // Output for FFT for each channel, the input is time_data
 	fftw_plan fft_plan; // FFT plan
 	AudioBuffer buffer; // Buffer to hold audio data for analysis, will be larger
 	MovingAverageND **ma_freq; // Moving average for smoothing the data
 	double **freq_data; // Frequency domain data for each channel
 	double **time_data; // Time domain data for each channel
-	double **pitch; // Pitch data for each channel, can be used for further analysis
+	double **pitch; // Pitch data for each channel, num_bins wide, can be used for further analysis
 	float *norm_avg;    // Average normalized value for each channel
+	size_t num_bins;    // Number of pitch bins
+	int *bin_start;     // First frequency bin of each pitch bin
+	int *bin_end;       // One past the last frequency bin of each pitch bin
+	StereoAnalysis *stereo; // Stereo field of the first two channels, NULL for mono input
+	LoudnessMeter *loudness; // EBU R128 loudness and true-peak of the capture stream
+	Spectrogram *spectrogram; // Pitch history of each channel, one row per hop
+	MultiResAnalysis *multires; // Source of the pitch bands in ANALYSIS_MODE_MULTIRES, NULL otherwise
+	ToneTracker *tones; // Magnitudes of the tracked frequencies, NULL when none are tracked
+	WaveformPyramid *waveform; // Min/max/RMS history of every channel, NULL when none is kept
+	FeatureRecorder *recorder; // Feature stream being recorded, NULL when not recording
+	uint64_t frames_read; // Captured frames consumed so far
+	uint64_t frames_analyzed; // frames_read when the last full hop was analysed, the results cover frames before it
+	uint64_t capture_time; // profile_now() when the newest frames of the last full hop were captured, 0 if unknown
+	ThreadPool *pool;   // Runs the analysis stages of each hop
+	int graph_built;    // The pool holds the graph of graph_outputs
+	unsigned int graph_outputs; // Outputs the task graph was built for
+	ThreadSchedule schedule; // Of the analysis thread, see AudioAnalysisConfig
+	int lock_memory;
+	float silence_gate;
+	uint64_t silence_timeout; // Nanoseconds
+	uint64_t last_sound;      // profile_now() of the last hop above the silence gate
+	unsigned int sample_rate;
+	QualityGovernor quality;  // Level of the next hop, from the hop times against the audio they cover
+	fftw_plan reduced_plans[ANALYSIS_QUALITY_COUNT - ANALYSIS_QUALITY_HALF_FFT]; // Half and quarter size transforms
 } AudioAnalysis;
 
 static AudioAnalysis *g_audio_analysis;
@@ -54,17 +192,478 @@ AudioAnalysisConfig init_audio_analysis_config() {
 	AudioAnalysisConfig config;
 	config.buffer_size = 1200; // Default buffer size for FFT
 	config.channels = 2;        // Default number of channels
+	config.sample_rate = 48000; // Default sample rate
+	config.threads = thread_pool_default_workers(); // One worker per remaining core
+	config.spectrogram_rows = SPECTROGRAM_DEFAULT_ROWS;
+	config.record_path = NULL;
+	config.multires_levels = 0;
+	config.tone_frequencies = NULL;
+	config.tone_count = 0;
+	config.tone_window = TONE_TRACKER_DEFAULT_WINDOW;
+	config.waveform_seconds = 0.0; // Set by the consumer that draws the waveform
+	config.schedule = thread_schedule_default();
+	config.lock_memory = 0;
+	config.silence_gate = 0.0f;
+	config.silence_timeout = 30.0;
+	config.adaptive_quality = 0; // Opt-in, consumers expect the outputs they subscribed to
 	return config;
 }
 
+// Pool workers besides the analysis thread: stages of one channel run in sequence, so more workers than channels would only spin
+int analysis_worker_count(const AudioAnalysisConfig *config) {
+	int workers = config->threads < (int)config->channels ? config->threads : (int)config->channels;
+	return workers < 0 ? 0 : workers;
+}
+
+// Window of every multi-resolution level, so the deepest one spans the whole buffer
+static size_t _analysis_multires_size(const AudioAnalysisConfig *config) {
+	if (config->multires_levels == 0 || config->multires_levels > MULTIRES_MAX_LEVELS) return 0;
+	return config->buffer_size >> (config->multires_levels - 1);
+}
+
+// Samples of waveform history per channel, 0 for none
+static size_t _analysis_waveform_history(const AudioAnalysisConfig *config) {
+	return config->waveform_seconds > 0.0 ? (size_t)(config->waveform_seconds * config->sample_rate) : 0;
+}
+
+// Size the arena of an analysis with this configuration
+AnalysisMemoryBudget analysis_memory_budget(const AudioAnalysisConfig *config) {
+	AnalysisMemoryBudget budget;
+	size_t channels = config->channels;
+	size_t size = config->buffer_size;
+	budget.frames = arena_rows_size(channels, sizeof(SAMPLE_TYPE) * size);
+	budget.time = arena_rows_size(channels, sizeof(double) * size) + arena_size(sizeof(float) * channels);
+	budget.spectrum = 2 * arena_rows_size(channels, sizeof(double) * size);
+	budget.smoothing = arena_size(sizeof(MovingAverageND *) * channels) + channels * moving_average_nd_arena_size(size);
+	budget.pitch = arena_rows_size(channels, sizeof(double) * ANALYSIS_NUM_BINS) + 2 * arena_size(sizeof(int) * ANALYSIS_NUM_BINS);
+	budget.stereo = channels >= 2 ? stereo_analysis_arena_size(size, ANALYSIS_NUM_BINS) : 0;
+	budget.loudness = loudness_meter_arena_size(channels);
+	budget.spectrogram = spectrogram_arena_size(channels, ANALYSIS_NUM_BINS, config->spectrogram_rows);
+	size_t multires_size = _analysis_multires_size(config);
+	budget.multires = multires_size > 0 ? multires_arena_size(channels, multires_size, config->multires_levels, ANALYSIS_NUM_BINS) : 0;
+	budget.tones = config->tone_count > 0 ?
+		tone_tracker_arena_size(channels, config->tone_count, tone_tracker_window(config->tone_window, config->sample_rate)) : 0;
+	size_t waveform_history = _analysis_waveform_history(config);
+	budget.waveform = waveform_history > 0 ? waveform_pyramid_arena_size(channels, waveform_history, size) : 0;
+	budget.total = arena_size(sizeof(AudioAnalysis)) + budget.frames + budget.time + budget.spectrum +
+		budget.smoothing + budget.pitch + budget.stereo + budget.loudness + budget.spectrogram + budget.multires + budget.tones + budget.waveform;
+	return budget;
+}
+
+// Hop being processed by the analysis tasks
+static struct {
+	SAMPLE_TYPE *raw_data; // Interleaved frames read from the ring buffer
+	ma_uint32 frames;      // Number of frames in raw_data
+	unsigned int outputs;  // Outputs needed by the subscribed consumers, with their dependencies
+	int full;              // The buffer is full, the hop ends a fill
+	int buffered;          // The fill was copied in full, the whole buffer stages run
+	int quality;           // AnalysisQuality of the hop
+	int fft_shift;         // The transform covers buffer.size >> fft_shift samples
+} _analysis_hop;
+
+// Replace the outputs a consumer reads, 0 unsubscribes it
+void analysis_subscribe(AnalysisConsumer consumer, unsigned int outputs) {
+	if (consumer >= ANALYSIS_CONSUMER_COUNT) return;
+	atomic_store(&_analysis_subscriptions[consumer], outputs & ANALYSIS_ALL);
+}
+
+// Outputs requested by all consumers together
+unsigned int analysis_subscriptions() {
+	unsigned int outputs = 0;
+	int idle = atomic_load(&_analysis_idle);
+	for (int i = 0; i < ANALYSIS_CONSUMER_COUNT; i++) {
+		if (atomic_load(&_analysis_paused[i])) continue;
+		if (idle && i != ANALYSIS_CONSUMER_RECORDER) continue; // Recordings keep their silences
+		outputs |= atomic_load(&_analysis_subscriptions[i]);
+	}
+	return outputs;
+}
+
+// Stop computing the outputs of a consumer without dropping its subscription, e.g. for a hidden window
+void analysis_pause(AnalysisConsumer consumer, int paused) {
+	if (consumer >= ANALYSIS_CONSUMER_COUNT) return;
+	atomic_store(&_analysis_paused[consumer], paused != 0);
+}
+
+// The input stayed under the silence gate, see AudioAnalysisConfig
+int analysis_idle() {
+	return atomic_load(&_analysis_idle);
+}
+
+// Mode of the running analysis
+unsigned int analysis_mode() {
+	return g_audio_analysis != NULL && g_audio_analysis->multires != NULL ? ANALYSIS_MODE_MULTIRES : ANALYSIS_MODE_SINGLE;
+}
+
+// Expand requested outputs with everything the stages producing them read
+unsigned int analysis_resolve_outputs(unsigned int requested) {
+	unsigned int mode = analysis_mode();
+	unsigned int needed = requested;
+	unsigned int previous;
+	do {
+		previous = needed;
+		for (size_t i = 0; i < ANALYSIS_STAGE_COUNT; i++) {
+			if (!(_analysis_stages[i].modes & mode)) continue;
+			if (_analysis_stages[i].outputs & needed) {
+				needed |= _analysis_stages[i].requires;
+			}
+		}
+	} while (needed != previous);
+	return needed;
+}
+
+void _analysis_task_loudness(void *arg) {
+	uint64_t start = profile_begin();
+	// Loudness is metered on every captured sample, not only on full buffers
+	process_loudness_meter(g_audio_analysis->loudness, _analysis_hop.raw_data, _analysis_hop.frames);
+	profile_end_arg(PROFILE_LOUDNESS, start, _analysis_hop.frames);
+}
+
+void _analysis_task_tones(void *arg) {
+	uint64_t start = profile_begin();
+	// Like loudness, the tracked tones follow every captured sample
+	process_tone_tracker(g_audio_analysis->tones, _analysis_hop.raw_data, _analysis_hop.frames);
+	profile_end_arg(PROFILE_TONES, start, _analysis_hop.frames);
+}
+
+void _analysis_task_waveform(void *arg) {
+	uint64_t start = profile_begin();
+	size_t i = (size_t)arg;
+	// Every captured frame, the history reaches back further than the buffer
+	waveform_pyramid_push(g_audio_analysis->waveform, i, _analysis_hop.raw_data + i, _analysis_hop.frames, g_audio_analysis->buffer.channels);
+	profile_end_arg(PROFILE_WAVEFORM, start, i);
+}
+
+void _analysis_task_copy(void *arg) {
+	uint64_t start = profile_begin();
+	size_t i = (size_t)arg;
+	AudioBuffer *buffer = &g_audio_analysis->buffer;
+	// fill the buffer with the acquired frames of this channel
+	for (ma_uint32 j = 0; j < _analysis_hop.frames; j++) {
+		ma_uint32 frame_index = j * buffer->channels + i;
+		ma_uint32 buffer_frames_cursor = (j + buffer->frames_cursor) % buffer->size;
+		buffer->frames[i][buffer_frames_cursor] = _analysis_hop.raw_data[frame_index]; // Copy data to the buffer
+	}
+	profile_end_arg(PROFILE_COPY, start, i);
+}
+
+// Time domain copy and average of a channel
+void _analysis_time(size_t i, unsigned int outputs) {
+	AudioBuffer *buffer = &g_audio_analysis->buffer;
+	if (outputs & ANALYSIS_TIME_DATA) {
+		for (ma_uint32 j = 0; j < buffer->size; j++) {
+			g_audio_analysis->time_data[i][j] = (double)buffer->frames[i][j]; // Store time domain data
+		}
+	}
+	if (outputs & ANALYSIS_NORM_AVG) {
+		double sum = 0.0f;
+		for (ma_uint32 j = 0; j < buffer->size; j++) {
+			sum += buffer->frames[i][j];
+		}
+		g_audio_analysis->norm_avg[i] = sum / buffer->size; // Calculate average for this channel
+	}
+}
+
+void _analysis_fft(size_t i) {
+	// Every channel has its own arrays, so the shared plan runs through the thread-safe new-array execute.
+	// The transform is out of place and leaves time_data untouched, so it doubles as the FFT input
+	fftw_plan plan = _analysis_hop.fft_shift == 0 ? g_audio_analysis->fft_plan : g_audio_analysis->reduced_plans[_analysis_hop.fft_shift - 1];
+	fftw_execute_r2r(plan, g_audio_analysis->time_data[i], g_audio_analysis->fft_out[i]); // Execute FFT for this channel
+}
+
+void _analysis_magnitude(size_t i) {
+	AudioBuffer *buffer = &g_audio_analysis->buffer;
+	double *fft_out = g_audio_analysis->fft_out[i];
+	// A reduced transform fills the first bins, each as wide as 2^fft_shift bins of the full one.
+	// It is still normalized by the full size, so a tone keeps its height once pitch averages fewer bins
+	ma_uint32 size = buffer->size >> _analysis_hop.fft_shift;
+	for (ma_uint32 j = 0; j < size; j++) {
+		double ssample = fabs(fft_out[j]) / (buffer->size); // Normalize the FFT output
+		if (j == 0) {
+			g_audio_analysis->freq_data[i][j] = 0; // Store FFT output
+		} else {
+			g_audio_analysis->freq_data[i][j] = ssample;//log1p(ssample*j); // Store FFT output with exponential scaling
+		}
+	}
+	if (size < buffer->size) {
+		memset(g_audio_analysis->freq_data[i] + size, 0, sizeof(double) * (buffer->size - size));
+	}
+}
+
+void _analysis_smooth(size_t i) {
+	// Update the moving average for frequency data
+	calculate_moving_average_nd(g_audio_analysis->ma_freq[i], g_audio_analysis->freq_data[i], g_audio_analysis->freq_data[i]);
+}
+
+void _analysis_pitch(size_t i) {
+	// Calculate the pitch for this channel
+	int shift = _analysis_hop.fft_shift;
+	for (int j = 0; j < g_audio_analysis->num_bins; j++) {
+		int bin_start = g_audio_analysis->bin_start[j] >> shift;
+		int bin_end = g_audio_analysis->bin_end[j] >> shift;
+		if (bin_end <= bin_start) bin_end = bin_start + 1; // Low bands narrower than a reduced bin share it
+
+		double sum = 0.0;
+		for (int k = bin_start; k < bin_end; k++) {
+			sum += g_audio_analysis->freq_data[i][k];
+		}
+		g_audio_analysis->pitch[i][j] = log2(sum / (bin_end - bin_start) + 1);
+	}
+}
+
+void _analysis_task_fft(void *arg) {
+	if (!_analysis_hop.buffered) return; // Only the copy runs until the buffer is full
+	uint64_t start = profile_begin();
+	size_t i = (size_t)arg;
+	_analysis_time(i, _analysis_hop.outputs);
+	if (_analysis_hop.outputs & ANALYSIS_SPECTRUM) {
+		_analysis_fft(i);
+	}
+	profile_end_arg(PROFILE_FFT, start, i);
+}
+
+void _analysis_task_bands(void *arg) {
+	if (!_analysis_hop.buffered) return;
+	uint64_t start = profile_begin();
+	size_t i = (size_t)arg;
+	_analysis_magnitude(i);
+	if (_analysis_hop.quality < ANALYSIS_QUALITY_NO_SMOOTHING) {
+		_analysis_smooth(i);
+	}
+	if ((_analysis_hop.outputs & ANALYSIS_PITCH) && g_audio_analysis->multires == NULL) {
+		_analysis_pitch(i);
+		if (_analysis_hop.outputs & ANALYSIS_SPECTROGRAM) {
+			spectrogram_write(g_audio_analysis->spectrogram, i, g_audio_analysis->pitch[i]);
+		}
+	}
+	profile_end_arg(PROFILE_BANDS, start, i);
+}
+
+void _analysis_task_stereo(void *arg) {
+	if (!_analysis_hop.buffered || _analysis_hop.fft_shift != 0) return; // Reduced transforms have no stereo field
+	uint64_t start = profile_begin();
+	// Stereo field of the first two channels, once per hop
+	calculate_stereo_analysis(g_audio_analysis->stereo, g_audio_analysis->time_data[0], g_audio_analysis->time_data[1]);
+	profile_end(PROFILE_STEREO, start);
+}
+
+void _analysis_task_multires(void *arg) {
+	uint64_t start = profile_begin();
+	size_t i = (size_t)arg;
+	// Every captured frame goes through the filterbank, the bands follow each hop instead of each full buffer
+	multires_push(g_audio_analysis->multires, i, _analysis_hop.raw_data, _analysis_hop.frames);
+	multires_bands(g_audio_analysis->multires, i, g_audio_analysis->pitch[i]);
+	if (_analysis_hop.full && (_analysis_hop.outputs & ANALYSIS_SPECTROGRAM)) {
+		spectrogram_write(g_audio_analysis->spectrogram, i, g_audio_analysis->pitch[i]);
+	}
+	profile_end_arg(PROFILE_MULTIRES, start, i);
+}
+
+// Outputs stored in feature stream records
+#define ANALYSIS_RECORDED_OUTPUTS (ANALYSIS_PITCH | ANALYSIS_NORM_AVG | ANALYSIS_STEREO | ANALYSIS_LOUDNESS | ANALYSIS_TIME_DATA)
+
+// Append the results of the hop to the feature stream, dropped if the writer is behind
+void _analysis_record_hop(unsigned int outputs) {
+	FeatureRecorder *recorder = g_audio_analysis->recorder;
+	const FeatureStreamHeader *h = &recorder->header;
+	void *record = feature_recorder_reserve(recorder);
+	if (record == NULL) {
+		return;
+	}
+	size_t channels = g_audio_analysis->buffer.channels;
+	size_t num_bins = g_audio_analysis->num_bins;
+	StereoAnalysis *stereo = g_audio_analysis->stereo;
+	LoudnessMeter *loudness = g_audio_analysis->loudness;
+
+	if (stereo == NULL) {
+		outputs &= ~ANALYSIS_STEREO;
+	}
+	outputs &= ANALYSIS_RECORDED_OUTPUTS;
+	*feature_record_frame(h, record) = g_audio_analysis->frames_read;
+	*feature_record_outputs(h, record) = outputs;
+
+	// Fields not computed for this hop are zeroed, the ring slot still holds an older record
+	float *norm_avg = feature_record_norm_avg(h, record);
+	for (size_t i = 0; i < channels; i++) {
+		norm_avg[i] = (outputs & ANALYSIS_NORM_AVG) ? g_audio_analysis->norm_avg[i] : 0.0f;
+	}
+	float *summary = feature_record_stereo(h, record);
+	memset(summary, 0, sizeof(float) * 4);
+	if (outputs & ANALYSIS_STEREO) {
+		summary[0] = stereo->correlation;
+		summary[1] = stereo->balance;
+		summary[2] = stereo->delay;
+		summary[3] = stereo->delay_confidence;
+	}
+	float *meter = feature_record_loudness(h, record);
+	memset(meter, 0, sizeof(float) * 4);
+	if (outputs & ANALYSIS_LOUDNESS) {
+		meter[0] = loudness->momentary_lufs;
+		meter[1] = loudness->short_term_lufs;
+		meter[2] = loudness->integrated_lufs;
+		meter[3] = loudness->true_peak_dbtp;
+	}
+	for (size_t i = 0; i < channels; i++) {
+		float *pitch = feature_record_pitch(h, record, i);
+		for (size_t j = 0; j < num_bins; j++) {
+			pitch[j] = (outputs & ANALYSIS_PITCH) ? g_audio_analysis->pitch[i][j] : 0.0f;
+		}
+	}
+	// The time data decimated to the recorded waveform, one sample out of every buffer_size / waveform_samples
+	size_t size = g_audio_analysis->buffer.size;
+	for (size_t i = 0; i < channels; i++) {
+		float *waveform = feature_record_waveform(h, record, i);
+		for (size_t j = 0; j < h->waveform_samples; j++) {
+			waveform[j] = (outputs & ANALYSIS_TIME_DATA) ? (float)g_audio_analysis->time_data[i][j * size / h->waveform_samples] : 0.0f;
+		}
+	}
+	feature_recorder_commit(recorder);
+}
+
+// Silence gate: the analysis idles once every hop stayed under the gate for the timeout,
+// and the first hop above it wakes it before the hop is analysed
+void _analysis_gate(const SAMPLE_TYPE *raw_data, ma_uint32 frames) {
+	if (g_audio_analysis->silence_gate <= 0.0f) return;
+	size_t n = (size_t)frames * g_audio_analysis->buffer.channels;
+	float peak = 0.0f;
+	#pragma omp simd reduction(max:peak)
+	for (size_t i = 0; i < n; i++) {
+		float v = fabsf((float)raw_data[i]);
+		peak = v > peak ? v : peak;
+	}
+	uint64_t now = profile_now();
+	if (peak >= g_audio_analysis->silence_gate) {
+		g_audio_analysis->last_sound = now;
+		if (atomic_load(&_analysis_idle)) {
+			atomic_store(&_analysis_idle, 0);
+			printf("Sound is back, audio analysis resumed\n");
+		}
+	} else if (!atomic_load(&_analysis_idle) && now - g_audio_analysis->last_sound > g_audio_analysis->silence_timeout) {
+		atomic_store(&_analysis_idle, 1);
+		printf("Silent for %.1f s, audio analysis idle\n", g_audio_analysis->silence_timeout * 1e-9);
+	}
+}
+
+// Build the task graph of the stages `outputs` need, kept in the pool until they change.
+// Stages of the whole buffer are in the graph on every hop and return right away
+// until the buffer is full, so the graph doesn't alternate with the buffer fill.
+void _analysis_build_graph(unsigned int outputs) {
+	ThreadPool *pool = g_audio_analysis->pool;
+	size_t channels = g_audio_analysis->buffer.channels;
+	thread_pool_reset(pool);
+	if (outputs & ANALYSIS_LOUDNESS) {
+		thread_pool_add_task(pool, _analysis_task_loudness, NULL);
+	}
+	if ((outputs & ANALYSIS_TONES) && g_audio_analysis->tones != NULL) {
+		thread_pool_add_task(pool, _analysis_task_tones, NULL);
+	}
+	for (size_t i = 0; i < channels && (outputs & ANALYSIS_WAVEFORM) && g_audio_analysis->waveform != NULL; i++) {
+		thread_pool_add_task(pool, _analysis_task_waveform, (void *)i);
+	}
+	Task *fft_tasks[2] = {NULL, NULL};
+	for (size_t i = 0; i < channels && (outputs & ANALYSIS_FRAMES); i++) {
+		Task *copy = thread_pool_add_task(pool, _analysis_task_copy, (void *)i);
+		Task *fft = NULL;
+		if (outputs & (ANALYSIS_TIME_DATA | ANALYSIS_NORM_AVG | ANALYSIS_SPECTRUM)) {
+			fft = thread_pool_add_task(pool, _analysis_task_fft, (void *)i);
+			task_depends_on(fft, copy);
+		}
+		if (outputs & ANALYSIS_FREQ_DATA) {
+			Task *bands = thread_pool_add_task(pool, _analysis_task_bands, (void *)i);
+			task_depends_on(bands, fft);
+		}
+		if (i < 2) fft_tasks[i] = fft;
+	}
+	for (size_t i = 0; i < channels && (outputs & ANALYSIS_PITCH) && g_audio_analysis->multires != NULL; i++) {
+		thread_pool_add_task(pool, _analysis_task_multires, (void *)i);
+	}
+	if ((outputs & ANALYSIS_STEREO) && g_audio_analysis->stereo != NULL) {
+		Task *stereo = thread_pool_add_task(pool, _analysis_task_stereo, NULL);
+		task_depends_on(stereo, fft_tasks[0]);
+		task_depends_on(stereo, fft_tasks[1]);
+	}
+	g_audio_analysis->graph_outputs = outputs;
+	g_audio_analysis->graph_built = 1;
+}
+
+// Run the stages of one hop on `frames` interleaved frames, the caller keeps ownership of raw_data.
+// Every stage runs as a task on the analysis pool: the copy and FFT of each
+// channel, its bands, the stereo field and the loudness meter. Stages whose
+// outputs no consumer subscribed to are left out of the graph.
+void analysis_process_hop(SAMPLE_TYPE *raw_data, ma_uint32 sizeInFrames) {
+	AudioBuffer *buffer = &g_audio_analysis->buffer;
+	ThreadPool *pool = g_audio_analysis->pool;
+
+	_analysis_hop.raw_data = raw_data;
+	_analysis_hop.frames = sizeInFrames;
+	unsigned int outputs = analysis_resolve_outputs(analysis_subscriptions());
+	_analysis_hop.outputs = outputs;
+
+	// The frames count advances once per copied sample of every channel
+	size_t frames_count = buffer->frames_count + (size_t)sizeInFrames * buffer->channels;
+	if (frames_count > buffer->size) {
+		frames_count = buffer->size;
+	}
+	int full = frames_count >= buffer->size;
+	if (!(outputs & ANALYSIS_FRAMES)) {
+		buffer->stale = 1; // Nothing copied these frames, the buffer holds older samples where they belong
+	}
+	_analysis_hop.full = full;
+	_analysis_hop.buffered = full && !buffer->stale;
+	_analysis_hop.quality = g_audio_analysis->quality.level;
+	_analysis_hop.fft_shift = _analysis_hop.quality >= ANALYSIS_QUALITY_HALF_FFT ? _analysis_hop.quality - ANALYSIS_QUALITY_HALF_FFT + 1 : 0;
+
+	uint64_t start = profile_begin();
+	if (!g_audio_analysis->graph_built || g_audio_analysis->graph_outputs != outputs) {
+		_analysis_build_graph(outputs);
+	}
+	thread_pool_run(pool);
+	profile_end_arg(PROFILE_HOP, start, sizeInFrames);
+
+	start = profile_begin();
+	int rows = g_audio_analysis->multires != NULL ? full : _analysis_hop.buffered;
+	if (rows && (outputs & ANALYSIS_SPECTROGRAM)) {
+		// Every channel wrote its row, make them visible together
+		spectrogram_publish(g_audio_analysis->spectrogram);
+	}
+	if ((outputs & ANALYSIS_WAVEFORM) && g_audio_analysis->waveform != NULL) {
+		waveform_pyramid_publish(g_audio_analysis->waveform, sizeInFrames);
+	}
+	g_audio_analysis->frames_read += sizeInFrames;
+	if (full) {
+		g_audio_analysis->frames_analyzed = g_audio_analysis->frames_read;
+	}
+	if (full && g_audio_analysis->recorder != NULL) {
+		_analysis_record_hop(outputs);
+	}
+	profile_end(PROFILE_PUBLISH, start);
+
+	buffer->frames_cursor = (buffer->frames_cursor + sizeInFrames) % buffer->size; // Update the cursor for the next read
+	buffer->frames_count = frames_count;
+
+	//
+	if (full) {
+		buffer->frames_count = 0; // Reset the frames count after processing
+		buffer->frames_cursor = 0; // Reset the cursor after processing
+		buffer->stale = 0; // The next fill starts over
+
+	}
+}
+
 void *fft_loop(void *arg) {
 
 	// AudioAnalysisConfig *config = (AudioAnalysisConfig *)arg;
 
 	printf("FFT thread started\n");
+	profile_thread_name("analysis");
+	thread_schedule_apply("analysis", &g_audio_analysis->schedule);
+	if (g_audio_analysis->lock_memory) {
+		realtime_prefault_stack();
+	}
 	// This function is intended to run in a separate thread to process the audio
 	// data and perform FFT analysis on the captured audio. It will continuously
 	// read from the ring buffer and perform FFT on the data.
+	double fill_elapsed = 0.0; // Processing time of the reads of the current fill
 	while (_is_analysis_running) {
 		
 
@@ -75,144 +674,283 @@ void *fft_loop(void *arg) {
 		// The amount of frames to read. It might be less than the buffer size if not enough data is available. This will be set by the read_audio_data function.
 		ma_uint32 sizeInFrames = buffer->size; 
 
+		// The newest frames in the ring buffer, read below, came with the last callback
+		uint64_t capture_time = audio_capture_time();
+		uint64_t start = profile_begin();
 		SAMPLE_TYPE *raw_data = read_audio_data(&sizeInFrames);
 
 
 		if(raw_data == NULL || sizeInFrames == 0) {
 			// No data to process, sleep for a while and continue
-			usleep(1000); // Sleep for 1 ms
+			usleep(atomic_load(&_analysis_idle) ? ANALYSIS_IDLE_POLL_US : 1000);
 			continue;
 		}
 
-		// float *result = malloc(sizeof(float) * buffer->size);
-		// fill the buffer with the acquired frames
-		for (ma_uint32 i = 0; i < buffer->channels; i++) {
-			ma_uint32 buffer_frames_cursor;
-			for (ma_uint32 j = 0; j < sizeInFrames; j++) {
-
-				ma_uint32 frame_index = j * buffer->channels + i;
+		profile_end_arg(PROFILE_READ, start, sizeInFrames);
 
-				buffer_frames_cursor = (j + buffer->frames_cursor) % buffer->size;
-
-				buffer->frames[i][buffer_frames_cursor] = raw_data[frame_index]; // Copy data to the buffer
-				// Update the frames count
-				if (buffer->frames_count < buffer->size) {
-					buffer->frames_count++;
-				}
-				// Update the cursor for the next frame
-			}
+		_analysis_gate(raw_data, sizeInFrames);
+		uint64_t hop_start = profile_now();
+		analysis_process_hop(raw_data, sizeInFrames);
+		fill_elapsed += (profile_now() - hop_start) * 1e-9;
+		// The reads of a fill have to be done before the next fill is captured
+		if (_analysis_hop.full) {
+			double hop_interval = (double)(buffer->size / buffer->channels) / g_audio_analysis->sample_rate;
+			quality_governor_update(&g_audio_analysis->quality, fill_elapsed, hop_interval);
+			fill_elapsed = 0.0;
+		}
+		if (g_audio_analysis->frames_analyzed == g_audio_analysis->frames_read) {
+			g_audio_analysis->capture_time = capture_time; // The hop was analysed
 		}
 
 		free(raw_data); // Free the raw data after copying to the buffer
-		buffer->frames_cursor = (buffer->frames_cursor + sizeInFrames) % buffer->size; // Update the cursor for the next read
-
-		//
-		if (buffer->frames_count >= buffer->size) {
-			for (ma_uint32 i = 0; i < buffer->channels; i++) {
-				for (ma_uint32 j = 0; j < buffer->size; j++) {
-					g_audio_analysis->fft_in[j] = (double)buffer->frames[i][j]; // Fill FFT input with the buffer data
-					g_audio_analysis->time_data[i][j] = (double)buffer->frames[i][j]; // Store time domain data
-				}
-				fftw_execute(g_audio_analysis->fft_plan); // Execute FFT for this channel
-
-				for (ma_uint32 j = 0; j < buffer->size; j++) {
-					double ssample = fabs(g_audio_analysis->fft_out[j]) / (buffer->size); // Normalize the FFT output
-					if (j == 0) {
-						g_audio_analysis->freq_data[i][j] = 0; // Store FFT output
-					} else {
-						g_audio_analysis->freq_data[i][j] = ssample;//log1p(ssample*j); // Store FFT output with exponential scaling
-					}
-				}
-				// Update the moving average for frequency data
-				calculate_moving_average_nd(g_audio_analysis->ma_freq[i], g_audio_analysis->freq_data[i], g_audio_analysis->freq_data[i]);
-				// Calculate the pitch for this channel
-				int log_fcount = ceil(log2(buffer->size));
-				int num_bins = 125; // Number of bins for pitch calculation, can be adjusted based on requirements
-				for (int j = 0; j < num_bins; j++) {
-					int bin_start = floor(pow(2, j*(log_fcount/(float)num_bins)) - 1);
-					//quando chegar no ultimo bin, garantir que bin_end=buffer_size
-					int bin_end = ceil(pow(2, (j + 1)*(log_fcount/(float)num_bins)));
-					if (bin_end > buffer->size) {
-						bin_end = buffer->size;
-					}
-
-					double sum = 0.0;
-					for (int k = bin_start; k < bin_end; k++) {
-						sum += g_audio_analysis->freq_data[i][k];
-					}
-					g_audio_analysis->pitch[i][j] = log2(sum / (bin_end - bin_start) + 1);
-				}
-
-
-				double sum = 0.0f;
-				for (ma_uint32 j = 0; j < buffer->size; j++) {
-					sum += g_audio_analysis->fft_in[j];
-				}
-				g_audio_analysis->norm_avg[i] = sum / buffer->size; // Calculate average for this channel
-			}
-			buffer->frames_count = 0; // Reset the frames count after processing
-			buffer->frames_cursor = 0; // Reset the cursor after processing
-
-		}
 	}
 	// After processing, we can stop the FFT thread
 	return NULL;
 }
 
-int start_analysis(AudioAnalysisConfig *config) {
-
-	if(is_audio_initialized() == 0) {
-		printf("Audio data is not initialized\n");
-		return -1;
+// Workers take the cores after the one of the analysis thread, with its policy
+static void _analysis_worker_start(int index, void *arg) {
+	ThreadSchedule schedule = g_audio_analysis->schedule;
+	if (schedule.cpu >= 0) {
+		schedule.cpu += index;
+	}
+	thread_schedule_apply("analysis worker", &schedule);
+	if (g_audio_analysis->lock_memory) {
+		realtime_prefault_stack();
 	}
+}
 
-	if (_is_analysis_running) {
-		printf("FFT thread is already running\n");
-		return 0; // FFT thread is already running
+// Allocate the analysis state and its thread pool, without starting the analysis thread
+int create_analysis(AudioAnalysisConfig *config) {
+	// Every buffer of the analysis lives in one zeroed, cache line aligned block, so
+	// channels never share a cache line and the hot loop never touches a fresh page
+	AnalysisMemoryBudget budget = analysis_memory_budget(config);
+	Arena arena;
+	if (arena_init(&arena, budget.total) != 0) {
+		return -1;
 	}
+	printf("Audio analysis memory: %zu bytes (frames %zu, time %zu, spectrum %zu, smoothing %zu, pitch %zu, stereo %zu, loudness %zu, spectrogram %zu, multires %zu, tones %zu, waveform %zu)\n",
+		budget.total, budget.frames, budget.time, budget.spectrum, budget.smoothing, budget.pitch, budget.stereo, budget.loudness, budget.spectrogram, budget.multires, budget.tones, budget.waveform);
 
-	g_audio_analysis = malloc(sizeof(AudioAnalysis));
+	g_audio_analysis = arena_alloc(&arena, sizeof(AudioAnalysis));
 
-	g_audio_analysis->norm_avg = calloc(config->channels,sizeof(float));
-	g_audio_analysis->freq_data = malloc(sizeof(double *) * config->channels);
-	for (size_t i = 0; i < config->channels; i++) {
-		g_audio_analysis->freq_data[i] = calloc(config->buffer_size,sizeof(double));
-	}
-	g_audio_analysis->time_data = malloc(sizeof(double *) * config->channels);
-	for (size_t i = 0; i < config->channels; i++) {
-		g_audio_analysis->time_data[i] = calloc(config->buffer_size,sizeof(double));
-	}
 	g_audio_analysis->buffer.size = config->buffer_size;
 	g_audio_analysis->buffer.channels = config->channels;
 	g_audio_analysis->buffer.frames_count = 0;
 	g_audio_analysis->buffer.frames_cursor = 0;
-	g_audio_analysis->buffer.frames = malloc(sizeof(ma_int32 *) * config->channels);
-	for (size_t i = 0; i < config->channels;i++) {
-		g_audio_analysis->buffer.frames[i] = calloc(config->buffer_size,sizeof(ma_int32));
+	g_audio_analysis->buffer.stale = 0;
+	g_audio_analysis->buffer.frames = (SAMPLE_TYPE **)arena_alloc_rows(&arena, config->channels, sizeof(SAMPLE_TYPE) * config->buffer_size);
+
+	g_audio_analysis->time_data = (double **)arena_alloc_rows(&arena, config->channels, sizeof(double) * config->buffer_size);
+	g_audio_analysis->norm_avg = arena_alloc(&arena, sizeof(float) * config->channels);
+
+	g_audio_analysis->fft_out = (double **)arena_alloc_rows(&arena, config->channels, sizeof(double) * config->buffer_size);
+	g_audio_analysis->freq_data = (double **)arena_alloc_rows(&arena, config->channels, sizeof(double) * config->buffer_size);
+
+	g_audio_analysis->ma_freq = arena_alloc(&arena, sizeof(MovingAverageND *) * config->channels);
+	for (size_t i = 0; i < config->channels; i++) {
+		g_audio_analysis->ma_freq[i] = init_moving_average_nd_arena(&arena, config->buffer_size);
 	}
 
-	g_audio_analysis->fft_in = (double *)fftw_malloc(sizeof(double) * config->buffer_size);
-	g_audio_analysis->fft_out = (double *)fftw_malloc(sizeof(double) * config->buffer_size);
+	g_audio_analysis->pitch = (double **)arena_alloc_rows(&arena, config->channels, sizeof(double) * ANALYSIS_NUM_BINS);
+
+	// Logarithmic pitch bins, computed once instead of on every hop
+	g_audio_analysis->num_bins = ANALYSIS_NUM_BINS;
+	g_audio_analysis->bin_start = arena_alloc(&arena, sizeof(int) * ANALYSIS_NUM_BINS);
+	g_audio_analysis->bin_end = arena_alloc(&arena, sizeof(int) * ANALYSIS_NUM_BINS);
+	int log_fcount = ceil(log2(config->buffer_size));
+	for (int j = 0; j < ANALYSIS_NUM_BINS; j++) {
+		int bin_start = floor(pow(2, j*(log_fcount/(float)ANALYSIS_NUM_BINS)) - 1);
+		//quando chegar no ultimo bin, garantir que bin_end=buffer_size
+		int bin_end = ceil(pow(2, (j + 1)*(log_fcount/(float)ANALYSIS_NUM_BINS)));
+		if (bin_end > config->buffer_size) {
+			bin_end = config->buffer_size;
+		}
+		if (bin_start >= bin_end) {
+			bin_start = bin_end - 1; // Top bins may start past the end of a non power of two buffer
+		}
+		g_audio_analysis->bin_start[j] = bin_start;
+		g_audio_analysis->bin_end[j] = bin_end;
+	}
+
+	g_audio_analysis->stereo = NULL;
+	if (config->channels >= 2) {
+		g_audio_analysis->stereo = init_stereo_analysis(
+			&arena,
+			config->buffer_size,
+			g_audio_analysis->num_bins,
+			g_audio_analysis->bin_start,
+			g_audio_analysis->bin_end
+		);
+		if (g_audio_analysis->stereo != NULL) {
+			// The stereo analysis reads the spectrum of the first two channels in place
+			g_audio_analysis->stereo->coef[0] = g_audio_analysis->fft_out[0];
+			g_audio_analysis->stereo->coef[1] = g_audio_analysis->fft_out[1];
+		}
+	}
+
+	g_audio_analysis->loudness = init_loudness_meter(&arena, config->channels, config->sample_rate);
+	g_audio_analysis->spectrogram = init_spectrogram(&arena, config->channels, ANALYSIS_NUM_BINS, config->spectrogram_rows);
+
+	g_audio_analysis->tones = NULL;
+	if (config->tone_count > 0) {
+		g_audio_analysis->tones = init_tone_tracker(
+			&arena,
+			config->channels,
+			config->sample_rate,
+			config->tone_frequencies,
+			config->tone_count,
+			tone_tracker_window(config->tone_window, config->sample_rate)
+		);
+	}
+
+	g_audio_analysis->waveform = NULL;
+	if (_analysis_waveform_history(config) > 0) {
+		// Hops are at most a buffer of frames
+		g_audio_analysis->waveform = init_waveform_pyramid(&arena, config->channels, _analysis_waveform_history(config), config->buffer_size);
+	}
+
+	g_audio_analysis->multires = NULL;
+	if (config->multires_levels > 0) {
+		g_audio_analysis->multires = init_multires_analysis(
+			&arena,
+			config->channels,
+			_analysis_multires_size(config),
+			config->multires_levels,
+			config->sample_rate,
+			g_audio_analysis->num_bins,
+			g_audio_analysis->bin_start,
+			g_audio_analysis->bin_end,
+			config->buffer_size
+		);
+		if (g_audio_analysis->multires == NULL) {
+			printf("Falling back to single resolution pitch bands\n");
+		} else {
+			printf("Multi-resolution pitch bands: %zu levels of %zu samples\n", config->multires_levels, _analysis_multires_size(config));
+		}
+	}
+
+	// Arena rows are aligned like fftw_malloc, so the plan applies to every channel
 	g_audio_analysis->fft_plan = fftw_plan_r2r_1d(
 		config->buffer_size,
-		g_audio_analysis->fft_in,
-		g_audio_analysis->fft_out,
+		g_audio_analysis->time_data[0],
+		g_audio_analysis->fft_out[0],
 		FFTW_REDFT10,
 		FFTW_ESTIMATE
 	);
+	for (int k = 0; k < ANALYSIS_QUALITY_COUNT - ANALYSIS_QUALITY_HALF_FFT; k++) {
+		g_audio_analysis->reduced_plans[k] = fftw_plan_r2r_1d(
+			config->buffer_size >> (k + 1),
+			g_audio_analysis->time_data[0],
+			g_audio_analysis->fft_out[0],
+			FFTW_REDFT10,
+			FFTW_ESTIMATE
+		);
+	}
+	g_audio_analysis->sample_rate = config->sample_rate;
+	g_audio_analysis->quality = init_quality_governor("analysis", _analysis_quality_names, ANALYSIS_QUALITY_COUNT, config->adaptive_quality);
+	g_audio_analysis->arena = arena;
+	g_audio_analysis->schedule = config->schedule;
+	g_audio_analysis->lock_memory = config->lock_memory;
+	g_audio_analysis->silence_gate = config->silence_gate;
+	g_audio_analysis->silence_timeout = (uint64_t)(config->silence_timeout * 1e9);
+	g_audio_analysis->last_sound = profile_now();
+	atomic_store(&_analysis_idle, 0);
+	if (config->lock_memory && realtime_lock(arena.base, arena.capacity, "the analysis state") == 0) {
+		printf("Audio analysis memory locked\n");
+	}
 
-	g_audio_analysis->ma_freq = malloc(sizeof(MovingAverageND *) * config->channels);
-	for (size_t i = 0; i < config->channels; i++) {
-		g_audio_analysis->ma_freq[i] = init_moving_average_nd(config->buffer_size);
+	g_audio_analysis->recorder = NULL;
+	if (config->record_path != NULL) {
+		g_audio_analysis->recorder = feature_recorder_open(
+			config->record_path,
+			config->channels,
+			g_audio_analysis->num_bins,
+			config->sample_rate,
+			config->buffer_size
+		);
+		if (g_audio_analysis->recorder != NULL) {
+			analysis_subscribe(ANALYSIS_CONSUMER_RECORDER, ANALYSIS_RECORDED_OUTPUTS);
+		}
 	}
 
-	g_audio_analysis->pitch = malloc(sizeof(double *) * config->channels);
-	for (size_t i = 0; i < config->channels; i++) {
-		g_audio_analysis->pitch[i] = calloc(config->buffer_size, sizeof(double));
+	int workers = analysis_worker_count(config);
+	// Loudness, tones, copy, FFT, bands, multires and waveform per channel, stereo
+	g_audio_analysis->pool = thread_pool_create_with(workers, 5 * config->channels + 3, _analysis_worker_start, NULL);
+	g_audio_analysis->graph_built = 0; // Built on the first hop, from the subscriptions then
+	if (g_audio_analysis->pool == NULL) {
+		printf("Failed to create the analysis thread pool\n");
+		if (g_audio_analysis->recorder != NULL) {
+			analysis_subscribe(ANALYSIS_CONSUMER_RECORDER, 0);
+			feature_recorder_close(g_audio_analysis->recorder);
+		}
+		fftw_destroy_plan(g_audio_analysis->fft_plan);
+		for (int k = 0; k < ANALYSIS_QUALITY_COUNT - ANALYSIS_QUALITY_HALF_FFT; k++) {
+			fftw_destroy_plan(g_audio_analysis->reduced_plans[k]);
+		}
+		free_stereo_analysis(g_audio_analysis->stereo);
+		free_multires_analysis(g_audio_analysis->multires);
+		g_audio_analysis = NULL;
+		realtime_unlock(arena.base, arena.capacity);
+		arena_free(&arena);
+		return -1;
+	}
+	printf("Audio analysis running on %d threads\n", g_audio_analysis->pool->worker_count + 1);
+
+	return 0;
+}
+
+// Release what create_analysis allocated, the analysis thread must be stopped
+void destroy_analysis() {
+	thread_pool_destroy(g_audio_analysis->pool);
+
+	if (g_audio_analysis->recorder != NULL) {
+		analysis_subscribe(ANALYSIS_CONSUMER_RECORDER, 0);
+		feature_recorder_close(g_audio_analysis->recorder);
+	}
+
+	// Free the FFTW resources, plans must be destroyed before the cleanup
+	fftw_destroy_plan(g_audio_analysis->fft_plan);
+	for (int k = 0; k < ANALYSIS_QUALITY_COUNT - ANALYSIS_QUALITY_HALF_FFT; k++) {
+		fftw_destroy_plan(g_audio_analysis->reduced_plans[k]);
+	}
+	free_stereo_analysis(g_audio_analysis->stereo);
+	free_multires_analysis(g_audio_analysis->multires);
+	fftw_cleanup();
+
+	// The arena holds g_audio_analysis itself, so release it from a copy
+	Arena arena = g_audio_analysis->arena;
+	int locked = g_audio_analysis->lock_memory;
+	g_audio_analysis = NULL;
+	if (locked) {
+		realtime_unlock(arena.base, arena.capacity);
+	}
+	arena_free(&arena);
+}
+
+int start_analysis(AudioAnalysisConfig *config) {
+
+	if(is_audio_initialized() == 0) {
+		printf("Audio data is not initialized\n");
+		return -1;
+	}
+
+	if (_is_analysis_running) {
+		printf("FFT thread is already running\n");
+		return 0; // FFT thread is already running
+	}
+
+	if (create_analysis(config) != 0) {
+		return -1;
 	}
 
 	_is_analysis_running = 1; // Set the flag to indicate that the FFT thread should run
-	pthread_create(&fft_thread, NULL, fft_loop, config);
+	if (pthread_create(&fft_thread, NULL, fft_loop, config) != 0) {
+		printf("Failed to create the FFT thread\n");
+		_is_analysis_running = 0;
+		destroy_analysis();
+		return -1;
+	}
 
 	return 0;
 }
@@ -249,38 +987,130 @@ void close_analysis() {
 
 	_is_analysis_running = 0; // Stop the FFT thread
 
-	// Free the FFTW resources
-	fftw_destroy_plan(g_audio_analysis->fft_plan);
-	fftw_cleanup();
+	destroy_analysis();
 
-	// uninit moving averages
-	for (size_t i = 0; i < g_audio_analysis->buffer.channels; i++) {
-		free_moving_average_nd(g_audio_analysis->ma_freq[i]);
+}
+
+// Copy of the outputs a frame draws, taken from the live analysis or from a recorded feature stream
+typedef struct {
+	size_t channels;
+	size_t num_bins;
+	size_t num_tones;
+	size_t num_samples;
+	unsigned int outputs; // Outputs valid in the snapshot
+	uint64_t frame;       // Captured frames consumed when the hop ended
+	uint64_t capture_time; // profile_now() when the newest frames of the hop were captured, 0 for recorded hops
+	float *norm_avg;      // [channels]
+	float stereo[4];      // correlation, balance, delay (samples), delay confidence
+	float loudness[4];    // momentary, short-term, integrated (LUFS), true-peak (dBTP)
+	float *pitch;         // [channels][num_bins]
+	float *tones;         // [channels][num_tones] Amplitude of each tracked frequency
+	float *time_data;     // [channels][num_samples] Samples of the last full buffer, converted for upload
+} AnalysisSnapshot;
+
+AnalysisSnapshot* init_analysis_snapshot(size_t channels, size_t num_bins, size_t num_tones, size_t num_samples) {
+	AnalysisSnapshot *snapshot = (AnalysisSnapshot *)calloc(1, sizeof(AnalysisSnapshot));
+	if (!snapshot) return NULL;
+	snapshot->channels = channels;
+	snapshot->num_bins = num_bins;
+	snapshot->num_tones = num_tones;
+	snapshot->num_samples = num_samples;
+	snapshot->norm_avg = (float *)calloc(channels, sizeof(float));
+	snapshot->pitch = (float *)calloc(channels * num_bins, sizeof(float));
+	snapshot->tones = (float *)calloc(channels * num_tones + 1, sizeof(float)); // Never a zero sized allocation
+	snapshot->time_data = (float *)calloc(channels * num_samples + 1, sizeof(float));
+	if (!snapshot->norm_avg || !snapshot->pitch || !snapshot->tones || !snapshot->time_data) {
+		printf("Error: Failed to allocate memory for analysis snapshot\n");
+		free(snapshot->norm_avg);
+		free(snapshot->pitch);
+		free(snapshot->tones);
+		free(snapshot->time_data);
+		free(snapshot);
+		return NULL;
 	}
-	free(g_audio_analysis->ma_freq);
-	// Free analysis
-	for (size_t i = 0; i < g_audio_analysis->buffer.channels; i++) {
-		free(g_audio_analysis->buffer.frames[i]);
+	for (int i = 0; i < 4; i++) {
+		snapshot->loudness[i] = LOUDNESS_FLOOR;
 	}
-	free(g_audio_analysis->buffer.frames);
+	return snapshot;
+}
+
+void free_analysis_snapshot(AnalysisSnapshot *snapshot) {
+	if (!snapshot) return;
+	free(snapshot->norm_avg);
+	free(snapshot->pitch);
+	free(snapshot->tones);
+	free(snapshot->time_data);
+	free(snapshot);
+}
+
+// Take the latest results of the running analysis
+void analysis_snapshot_capture(AnalysisSnapshot *snapshot) {
+	if (g_audio_analysis == NULL) return;
+	size_t channels = snapshot->channels < g_audio_analysis->buffer.channels ? snapshot->channels : g_audio_analysis->buffer.channels;
+	size_t num_bins = snapshot->num_bins < g_audio_analysis->num_bins ? snapshot->num_bins : g_audio_analysis->num_bins;
+	StereoAnalysis *stereo = g_audio_analysis->stereo;
+	LoudnessMeter *loudness = g_audio_analysis->loudness;
+	ToneTracker *tones = g_audio_analysis->tones;
 
-	for (size_t i = 0; i < g_audio_analysis->buffer.channels; i++) {
-		free(g_audio_analysis->freq_data[i]);
+	snapshot->outputs = analysis_resolve_outputs(analysis_subscriptions()) & ANALYSIS_ALL;
+	snapshot->frame = g_audio_analysis->frames_analyzed;
+	snapshot->capture_time = g_audio_analysis->capture_time;
+	for (size_t i = 0; i < channels; i++) {
+		snapshot->norm_avg[i] = g_audio_analysis->norm_avg[i];
+		for (size_t j = 0; j < num_bins; j++) {
+			snapshot->pitch[i * snapshot->num_bins + j] = g_audio_analysis->pitch[i][j];
+		}
 	}
-	free(g_audio_analysis->freq_data);
-	for (size_t i = 0; i < g_audio_analysis->buffer.channels; i++) {
-		free(g_audio_analysis->time_data[i]);
+	if (stereo != NULL) {
+		snapshot->stereo[0] = stereo->correlation;
+		snapshot->stereo[1] = stereo->balance;
+		snapshot->stereo[2] = stereo->delay;
+		snapshot->stereo[3] = stereo->delay_confidence;
 	}
-	free(g_audio_analysis->time_data);
-
-	for (size_t i = 0; i < g_audio_analysis->buffer.channels; i++) {
-		free(g_audio_analysis->pitch[i]);
+	if (loudness != NULL) {
+		snapshot->loudness[0] = loudness->momentary_lufs;
+		snapshot->loudness[1] = loudness->short_term_lufs;
+		snapshot->loudness[2] = loudness->integrated_lufs;
+		snapshot->loudness[3] = loudness->true_peak_dbtp;
+	}
+	if (snapshot->outputs & ANALYSIS_TIME_DATA) {
+		size_t num_samples = snapshot->num_samples < g_audio_analysis->buffer.size ? snapshot->num_samples : g_audio_analysis->buffer.size;
+		for (size_t i = 0; i < channels; i++) {
+			float *time_data = snapshot->time_data + i * snapshot->num_samples;
+			for (size_t j = 0; j < num_samples; j++) {
+				time_data[j] = (float)g_audio_analysis->time_data[i][j];
+			}
+		}
 	}
-	free(g_audio_analysis->pitch);
+	if (tones != NULL) {
+		size_t num_tones = snapshot->num_tones < tones->targets ? snapshot->num_tones : tones->targets;
+		for (size_t i = 0; i < channels; i++) {
+			for (size_t k = 0; k < num_tones; k++) {
+				snapshot->tones[i * snapshot->num_tones + k] = tones->magnitude[i * tones->targets + k];
+			}
+		}
+	}
+}
 
-	free(g_audio_analysis->norm_avg);
-	free(g_audio_analysis);
-	g_audio_analysis = NULL;
+// Load a record of a feature stream
+void analysis_snapshot_from_record(AnalysisSnapshot *snapshot, const FeatureStreamHeader *h, void *record) {
+	size_t channels = snapshot->channels < h->channels ? snapshot->channels : h->channels;
+	size_t num_bins = snapshot->num_bins < h->num_bins ? snapshot->num_bins : h->num_bins;
 
+	snapshot->outputs = *feature_record_outputs(h, record);
+	snapshot->frame = *feature_record_frame(h, record);
+	snapshot->capture_time = 0;
+	memcpy(snapshot->norm_avg, feature_record_norm_avg(h, record), sizeof(float) * channels);
+	memcpy(snapshot->stereo, feature_record_stereo(h, record), sizeof(snapshot->stereo));
+	memcpy(snapshot->loudness, feature_record_loudness(h, record), sizeof(snapshot->loudness));
+	for (size_t i = 0; i < channels; i++) {
+		memcpy(snapshot->pitch + i * snapshot->num_bins, feature_record_pitch(h, record, i), sizeof(float) * num_bins);
+	}
+	memset(snapshot->tones, 0, sizeof(float) * snapshot->channels * snapshot->num_tones); // Not recorded
+	memset(snapshot->time_data, 0, sizeof(float) * snapshot->channels * snapshot->num_samples);
+	size_t num_samples = snapshot->num_samples < h->waveform_samples ? snapshot->num_samples : h->waveform_samples;
+	for (size_t i = 0; i < channels; i++) {
+		memcpy(snapshot->time_data + i * snapshot->num_samples, feature_record_waveform(h, record, i), sizeof(float) * num_samples);
+	}
 }
 #endif // AUDIO_ANALYSIS_H
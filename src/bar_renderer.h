@@ -0,0 +1,221 @@
+#ifndef BAR_RENDERER_H
+#define BAR_RENDERER_H
+#include <stdio.h>
+#include <stdlib.h>
+#include "raylib.h"
+#include "rlgl.h"
+#include "shader_cache.h"
+
+// Instanced bar renderer.
+// Draws a row of bars, one per value, in a single instanced draw call: the
+// values are uploaded as one per-instance vertex buffer and the vertex shader
+// places every bar from its instance index, so the cost on the CPU doesn't
+// grow with the number of bars the way DrawRectangle batches do. Ticks along
+// the left edge of the bars and their index labels are two more instanced
+// layers; the labels are drawn once into an atlas texture and only sampled
+// afterwards. Geometry follows the current raylib transform, so bars land
+// where DrawRectangle would put them, on screen or in a render texture.
+
+#define BAR_RENDERER_LABEL_SIZE 10 // Font size of the labels
+
+typedef enum {
+	BAR_STYLE_BARS,  // Bars grow from the baseline, negative values like positive ones
+	BAR_STYLE_TRACE, // A segment at the height of the value, below the baseline for negative values
+	BAR_STYLE_RANGE  // From a low to a high value, which come in pairs: 2 * count values
+} BarStyle;
+
+typedef struct {
+	float x;         // Left edge of the first bar, pixels
+	float baseline;  // Line the bars grow from, pixels
+	float width;     // Pixels per bar
+	float scale;     // Pixels per unit of value
+	float thickness; // Share of the length drawn, 1 fills it
+	float minimum;   // Pixels added to every drawn length
+	BarStyle style;
+	Color color;
+	int ticks;       // Draw a line along the left edge of every bar
+	int labels;      // Draw the index of every bar above it
+} BarLayout;
+
+typedef struct {
+	Shader shader;
+	int modelview_loc, projection_loc, bar_loc, shape_loc, layer_loc, label_loc, color_loc, labels_loc;
+	unsigned int vao;
+	unsigned int quad_vbo;   // Unit quad, two triangles
+	unsigned int value_vbo;  // [capacity] Per-instance values
+	int capacity;
+	float *values;           // [capacity] Staging area for callers converting their values
+	RenderTexture2D labels;  // Label atlas, one cell per bar
+	int label_count;
+	int label_width;         // Pixels per atlas cell
+	int label_wanted;        // Bars drawn past the atlas without labels, it grows before the next frame
+} BarRenderer;
+
+static const float _bar_renderer_quad[12] = {0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1};
+
+// (Re)create the per-instance buffer for `capacity` bars, the vertex array must be enabled
+static int _bar_renderer_reserve(BarRenderer *bars, int capacity) {
+	float *values = (float *)realloc(bars->values, sizeof(float) * capacity);
+	if (values == NULL) {
+		printf("Error: Failed to allocate memory for %d bars\n", capacity);
+		return -1;
+	}
+	bars->values = values;
+	if (bars->value_vbo != 0) rlUnloadVertexBuffer(bars->value_vbo);
+	bars->value_vbo = rlLoadVertexBuffer(NULL, (int)(sizeof(float) * capacity), true);
+	rlSetVertexAttribute(1, 1, RL_FLOAT, false, 0, 0);
+	rlSetVertexAttributeDivisor(1, 1);
+	rlEnableVertexAttribute(1);
+	bars->capacity = capacity;
+	return 0;
+}
+
+// Draw the labels 0..count-1 into the atlas, fewer bars use its first cells
+static void _bar_renderer_labels(BarRenderer *bars, int count) {
+	if (count <= bars->label_count) return;
+	if (bars->label_count > 0) UnloadRenderTexture(bars->labels);
+	bars->label_width = MeasureText(TextFormat("%d", count - 1), BAR_RENDERER_LABEL_SIZE) + 2;
+	bars->labels = LoadRenderTexture(bars->label_width * count, BAR_RENDERER_LABEL_SIZE);
+	BeginTextureMode(bars->labels);
+	ClearBackground(BLANK);
+	for (int i = 0; i < count; i++) {
+		DrawText(TextFormat("%d", i), i * bars->label_width, 0, BAR_RENDERER_LABEL_SIZE, WHITE);
+	}
+	EndTextureMode();
+	bars->label_count = count;
+}
+
+// Load the bar shaders and buffers for `capacity` bars, it grows with the bars drawn. NULL if instancing is unavailable
+BarRenderer* create_bar_renderer(int capacity) {
+	BarRenderer *bars = (BarRenderer *)calloc(1, sizeof(BarRenderer));
+	if (bars == NULL) {
+		printf("Error: Failed to allocate memory for the bar renderer\n");
+		return NULL;
+	}
+	bars->shader = load_cached_shader("resources/shaders/bars.vs.glsl", "resources/shaders/bars.fs.glsl");
+	if (bars->shader.id == 0 || bars->shader.id == rlGetShaderIdDefault()) {
+		printf("Error: Failed to load the bar shaders\n");
+		free(bars);
+		return NULL;
+	}
+	bars->modelview_loc = GetShaderLocation(bars->shader, "u_modelview");
+	bars->projection_loc = GetShaderLocation(bars->shader, "u_projection");
+	bars->bar_loc = GetShaderLocation(bars->shader, "u_bar");
+	bars->shape_loc = GetShaderLocation(bars->shader, "u_shape");
+	bars->layer_loc = GetShaderLocation(bars->shader, "u_layer");
+	bars->label_loc = GetShaderLocation(bars->shader, "u_label");
+	bars->color_loc = GetShaderLocation(bars->shader, "u_color");
+	bars->labels_loc = GetShaderLocation(bars->shader, "u_labels");
+
+	bars->vao = rlLoadVertexArray();
+	if (bars->vao == 0 || !rlEnableVertexArray(bars->vao)) {
+		printf("Error: Vertex arrays are not supported, bars are drawn one by one\n");
+		UnloadShader(bars->shader);
+		free(bars);
+		return NULL;
+	}
+	bars->quad_vbo = rlLoadVertexBuffer(_bar_renderer_quad, sizeof(_bar_renderer_quad), false);
+	rlSetVertexAttribute(0, 2, RL_FLOAT, false, 0, 0);
+	rlEnableVertexAttribute(0);
+	int result = _bar_renderer_reserve(bars, capacity > 0 ? capacity : 1);
+	rlDisableVertexArray();
+	if (result != 0) {
+		rlUnloadVertexBuffer(bars->quad_vbo);
+		rlUnloadVertexArray(bars->vao);
+		UnloadShader(bars->shader);
+		free(bars);
+		return NULL;
+	}
+	_bar_renderer_labels(bars, capacity); // Ahead of any drawing, the atlas needs its own render target
+	return bars;
+}
+
+void destroy_bar_renderer(BarRenderer *bars) {
+	if (bars == NULL) return;
+	if (bars->label_count > 0) UnloadRenderTexture(bars->labels);
+	rlUnloadVertexBuffer(bars->value_vbo);
+	rlUnloadVertexBuffer(bars->quad_vbo);
+	rlUnloadVertexArray(bars->vao);
+	UnloadShader(bars->shader);
+	free(bars->values);
+	free(bars);
+}
+
+// Grow the label atlas to the bars drawn so far. It renders into its own
+// target, so call it before BeginDrawing or any texture mode, never in between
+void bar_renderer_prepare(BarRenderer *bars) {
+	if (bars == NULL || bars->label_wanted <= bars->label_count) return;
+	_bar_renderer_labels(bars, bars->label_wanted);
+}
+
+// Staging area for `count` values, NULL if it can't grow
+float* bar_renderer_values(BarRenderer *bars, int count) {
+	if (count > bars->capacity) {
+		rlEnableVertexArray(bars->vao);
+		int result = _bar_renderer_reserve(bars, count);
+		rlDisableVertexArray();
+		if (result != 0) return NULL;
+	}
+	return bars->values;
+}
+
+// Draw `count` bars of `values`, which may be the staging area of the renderer
+void bar_renderer_draw(BarRenderer *bars, const float *values, int count, const BarLayout *layout) {
+	if (count <= 0) return;
+	int components = layout->style == BAR_STYLE_RANGE ? 2 : 1;
+	// The atlas can't grow while drawing, bars past it go without labels until bar_renderer_prepare
+	int labels = layout->labels && count <= bars->label_count;
+	if (layout->labels && count > bars->label_wanted) {
+		bars->label_wanted = count;
+	}
+	// What raylib has batched so far goes first, so the bars layer over it
+	rlDrawRenderBatchActive();
+
+	rlEnableVertexArray(bars->vao);
+	if (count * components > bars->capacity && _bar_renderer_reserve(bars, count * components) != 0) {
+		rlDisableVertexArray();
+		return;
+	}
+	rlUpdateVertexBuffer(bars->value_vbo, values, (int)(sizeof(float) * count * components), 0);
+	if (components > 1) {
+		// The buffer is still bound from the update, ranges read a pair per instance
+		rlSetVertexAttribute(1, 2, RL_FLOAT, false, 0, 0);
+	}
+
+	float bar[4] = {layout->x, layout->baseline, layout->width, layout->scale};
+	float shape[3] = {layout->thickness, layout->minimum, (float)layout->style};
+	float label[3] = {(float)bars->label_width, (float)BAR_RENDERER_LABEL_SIZE, (float)(bars->label_count > 0 ? bars->label_count : 1)};
+	Vector4 color = ColorNormalize(layout->color);
+	int unit = 0;
+	rlEnableShader(bars->shader.id);
+	rlSetUniformMatrix(bars->modelview_loc, rlGetMatrixModelview());
+	rlSetUniformMatrix(bars->projection_loc, rlGetMatrixProjection());
+	rlSetUniform(bars->bar_loc, bar, RL_SHADER_UNIFORM_VEC4, 1);
+	rlSetUniform(bars->shape_loc, shape, RL_SHADER_UNIFORM_VEC3, 1);
+	rlSetUniform(bars->label_loc, label, RL_SHADER_UNIFORM_VEC3, 1);
+	rlSetUniform(bars->color_loc, &color, RL_SHADER_UNIFORM_VEC4, 1);
+	rlSetUniform(bars->labels_loc, &unit, RL_SHADER_UNIFORM_INT, 1);
+
+	int layer = 0;
+	rlSetUniform(bars->layer_loc, &layer, RL_SHADER_UNIFORM_INT, 1);
+	rlDrawVertexArrayInstanced(0, 6, count);
+	if (layout->ticks) {
+		layer = 1;
+		rlSetUniform(bars->layer_loc, &layer, RL_SHADER_UNIFORM_INT, 1);
+		rlDrawVertexArrayInstanced(0, 6, count);
+	}
+	if (labels) {
+		layer = 2;
+		rlSetUniform(bars->layer_loc, &layer, RL_SHADER_UNIFORM_INT, 1);
+		rlActiveTextureSlot(0);
+		rlEnableTexture(bars->labels.texture.id);
+		rlDrawVertexArrayInstanced(0, 6, count);
+		rlDisableTexture();
+	}
+	if (components > 1) {
+		rlSetVertexAttribute(1, 1, RL_FLOAT, false, 0, 0);
+	}
+	rlDisableVertexArray();
+	rlDisableShader();
+}
+#endif // BAR_RENDERER_H
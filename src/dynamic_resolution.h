@@ -0,0 +1,192 @@
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "gl_context.h"
+#include "raylib.h"
+#include "rlgl.h"
+
+// Dynamic resolution for fullscreen shader passes.
+// A pass drawn between dynamic_resolution_begin and _end lands in an
+// offscreen target instead of the screen. The target is allocated at full
+// size once, the pass only renders into its bottom left `scale` share of the
+// width and height: the viewport shrinks, so callers keep drawing in full
+// size coordinates. dynamic_resolution_draw stretches that share back over
+// the screen with bilinear filtering. The GPU time of every pass is measured
+// with timer queries, read a few frames late so nothing waits for them, and
+// the scale follows it to hold the pass at a share of the frame interval;
+// the cost of a pass goes with its pixels, the square of the scale. It drops
+// at once when the pass runs over and grows back a little at a time. Without
+// timer queries the pass renders at full size.
+
+#define DYNAMIC_RESOLUTION_MIN_SCALE 0.25f  // Smallest share of the width and height rendered
+#define DYNAMIC_RESOLUTION_TARGET_LOAD 0.6  // Share of the frame interval the pass aims to take
+#define DYNAMIC_RESOLUTION_SMOOTHING 0.2    // Weight of a new measurement in the smoothed GPU time
+#define DYNAMIC_RESOLUTION_STEP 0.02f       // Smaller scale changes are ignored
+#define DYNAMIC_RESOLUTION_MAX_GROWTH 1.05f // Largest growth of the scale per measurement
+#define DYNAMIC_RESOLUTION_QUERIES 4        // Timer queries in flight
+
+// GL enums used here, rlgl doesn't export them
+#define _DYNAMIC_RESOLUTION_TIME_ELAPSED 0x88BF
+#define _DYNAMIC_RESOLUTION_QUERY_RESULT 0x8866
+#define _DYNAMIC_RESOLUTION_QUERY_RESULT_AVAILABLE 0x8867
+
+typedef struct {
+	RenderTexture2D target;  // Full size, bilinear
+	int width, height;       // Full size
+	float scale;             // Share of the width and height rendered
+	int enabled;             // A disabled scale stays at 1
+	double gpu_time;         // Smoothed GPU seconds of a pass, 0 before the first measurement
+	unsigned int queries[DYNAMIC_RESOLUTION_QUERIES]; // 0 when timer queries are unavailable
+	int issued[DYNAMIC_RESOLUTION_QUERIES]; // Ended and not read yet
+	int next;                // Query of the next pass
+	int oldest;              // Query read next
+	int timing;              // The current pass runs a query
+	int stale;               // Results left that were measured at another scale
+} DynamicResolution;
+
+static struct {
+	int loaded; // 1 when the entry points are loaded, -1 when they are unavailable
+	void (*gen_queries)(int n, unsigned int *ids);
+	void (*delete_queries)(int n, const unsigned int *ids);
+	void (*begin_query)(unsigned int target, unsigned int id);
+	void (*end_query)(unsigned int target);
+	void (*get_query_objectiv)(unsigned int id, unsigned int name, int *params);
+	void (*get_query_objectui64v)(unsigned int id, unsigned int name, uint64_t *params);
+} _dynamic_resolution_gl;
+
+#define _DYNAMIC_RESOLUTION_LOAD(field, name) (*(void **)&_dynamic_resolution_gl.field = (void *)gl_proc_address(name))
+
+// Load the timer query entry points once a context exists, 0 if passes can be timed
+static int _dynamic_resolution_load() {
+	if (_dynamic_resolution_gl.loaded != 0) return _dynamic_resolution_gl.loaded > 0 ? 0 : -1;
+	int loaded = _DYNAMIC_RESOLUTION_LOAD(gen_queries, "glGenQueries") != NULL;
+	loaded &= _DYNAMIC_RESOLUTION_LOAD(delete_queries, "glDeleteQueries") != NULL;
+	loaded &= _DYNAMIC_RESOLUTION_LOAD(begin_query, "glBeginQuery") != NULL;
+	loaded &= _DYNAMIC_RESOLUTION_LOAD(end_query, "glEndQuery") != NULL;
+	loaded &= _DYNAMIC_RESOLUTION_LOAD(get_query_objectiv, "glGetQueryObjectiv") != NULL;
+	loaded &= _DYNAMIC_RESOLUTION_LOAD(get_query_objectui64v, "glGetQueryObjectui64v") != NULL;
+	_dynamic_resolution_gl.loaded = loaded ? 1 : -1;
+	if (!loaded) {
+		printf("Warning: Timer queries are unavailable, shader passes render at full resolution\n");
+		return -1;
+	}
+	return 0;
+}
+
+// Create a width x height target, a disabled one renders at full size. NULL on failure
+DynamicResolution* create_dynamic_resolution(int width, int height, int enabled) {
+	DynamicResolution *resolution = (DynamicResolution *)calloc(1, sizeof(DynamicResolution));
+	if (resolution == NULL) {
+		printf("Error: Failed to allocate memory for the dynamic resolution\n");
+		return NULL;
+	}
+	resolution->target = LoadRenderTexture(width, height);
+	if (resolution->target.id == 0) {
+		printf("Error: Failed to create a %dx%d render target\n", width, height);
+		free(resolution);
+		return NULL;
+	}
+	SetTextureFilter(resolution->target.texture, TEXTURE_FILTER_BILINEAR);
+	resolution->width = width;
+	resolution->height = height;
+	resolution->scale = 1.0f;
+	resolution->enabled = enabled && _dynamic_resolution_load() == 0;
+	if (resolution->enabled) {
+		_dynamic_resolution_gl.gen_queries(DYNAMIC_RESOLUTION_QUERIES, resolution->queries);
+	}
+	return resolution;
+}
+
+void destroy_dynamic_resolution(DynamicResolution *resolution) {
+	if (resolution == NULL) return;
+	if (resolution->queries[0] != 0) {
+		_dynamic_resolution_gl.delete_queries(DYNAMIC_RESOLUTION_QUERIES, resolution->queries);
+	}
+	UnloadRenderTexture(resolution->target);
+	free(resolution);
+}
+
+// Pixels rendered along the width and height at the current scale
+void dynamic_resolution_size(const DynamicResolution *resolution, int *width, int *height) {
+	*width = (int)ceilf(resolution->width * resolution->scale);
+	*height = (int)ceilf(resolution->height * resolution->scale);
+}
+
+// Redirect drawing into the target, in full size coordinates
+void dynamic_resolution_begin(DynamicResolution *resolution) {
+	int width, height;
+	dynamic_resolution_size(resolution, &width, &height);
+	BeginTextureMode(resolution->target);
+	rlViewport(0, 0, width, height);
+	// Every query still in flight, this pass goes untimed
+	resolution->timing = resolution->enabled && !resolution->issued[resolution->next];
+	if (resolution->timing) {
+		_dynamic_resolution_gl.begin_query(_DYNAMIC_RESOLUTION_TIME_ELAPSED, resolution->queries[resolution->next]);
+	}
+}
+
+void dynamic_resolution_end(DynamicResolution *resolution) {
+	rlDrawRenderBatchActive(); // The pass is batched, it has to reach the GPU inside the query
+	if (resolution->timing) {
+		_dynamic_resolution_gl.end_query(_DYNAMIC_RESOLUTION_TIME_ELAPSED);
+		resolution->issued[resolution->next] = 1;
+		resolution->next = (resolution->next + 1) % DYNAMIC_RESOLUTION_QUERIES;
+		resolution->timing = 0;
+	}
+	EndTextureMode();
+}
+
+// Stretch the rendered share of the target over `dest`
+void dynamic_resolution_draw(const DynamicResolution *resolution, Rectangle dest) {
+	int width, height;
+	dynamic_resolution_size(resolution, &width, &height);
+	// Render textures are upside down
+	Rectangle source = {0.0f, 0.0f, (float)width, -(float)height};
+	DrawTexturePro(resolution->target.texture, source, dest, (Vector2){0.0f, 0.0f}, 0.0f, WHITE);
+}
+
+// Read the passes the GPU finished, and return the scale that holds the next ones to their share of `interval` seconds
+static float _dynamic_resolution_measure(DynamicResolution *resolution, double interval) {
+	while (resolution->issued[resolution->oldest]) {
+		unsigned int query = resolution->queries[resolution->oldest];
+		int available = 0;
+		_dynamic_resolution_gl.get_query_objectiv(query, _DYNAMIC_RESOLUTION_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) break;
+		uint64_t elapsed = 0;
+		_dynamic_resolution_gl.get_query_objectui64v(query, _DYNAMIC_RESOLUTION_QUERY_RESULT, &elapsed);
+		resolution->issued[resolution->oldest] = 0;
+		resolution->oldest = (resolution->oldest + 1) % DYNAMIC_RESOLUTION_QUERIES;
+		if (resolution->stale > 0) {
+			resolution->stale--;
+			continue;
+		}
+		double seconds = elapsed * 1e-9;
+		resolution->gpu_time = resolution->gpu_time > 0.0 ? resolution->gpu_time + DYNAMIC_RESOLUTION_SMOOTHING * (seconds - resolution->gpu_time) : seconds;
+	}
+	if (resolution->gpu_time <= 0.0 || interval <= 0.0) return resolution->scale;
+	double load = resolution->gpu_time / interval;
+	float scale = resolution->scale * (float)sqrt(DYNAMIC_RESOLUTION_TARGET_LOAD / load);
+	if (scale > resolution->scale * DYNAMIC_RESOLUTION_MAX_GROWTH) {
+		scale = resolution->scale * DYNAMIC_RESOLUTION_MAX_GROWTH;
+	}
+	return scale < DYNAMIC_RESOLUTION_MIN_SCALE ? DYNAMIC_RESOLUTION_MIN_SCALE : scale > 1.0f ? 1.0f : scale;
+}
+
+// Once per frame after the pass, with the seconds a frame is shown for
+void dynamic_resolution_update(DynamicResolution *resolution, double interval) {
+	if (!resolution->enabled) return;
+	float scale = _dynamic_resolution_measure(resolution, interval);
+	if (fabsf(scale - resolution->scale) < DYNAMIC_RESOLUTION_STEP && scale != 1.0f) return;
+	if (scale == resolution->scale) return;
+	// The passes in flight ran at the old scale, their times would move it again
+	resolution->stale = 0;
+	for (int i = 0; i < DYNAMIC_RESOLUTION_QUERIES; i++) {
+		resolution->stale += resolution->issued[i];
+	}
+	resolution->gpu_time *= (double)(scale * scale) / (resolution->scale * resolution->scale);
+	resolution->scale = scale;
+}
+#endif // DYNAMIC_RESOLUTION_H
@@ -0,0 +1,201 @@
+#ifndef FEATURE_ATLAS_H
+#define FEATURE_ATLAS_H
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "audio_analysis.h"
+#include "texture_stream.h"
+
+// Per-frame audio data of the shaders in one texture and one uniform block.
+// The atlas is an RGBA32F texture `width` texels wide. Every row packs up to
+// four channels in the components of a texel, channels past the input repeat
+// its last one, so shaders bind the same sampler whatever the channel count:
+//   FEATURE_ATLAS_ROW_WAVEFORM  samples of the last full buffer
+//   FEATURE_ATLAS_ROW_BANDS     pitch bins
+//   FEATURE_ATLAS_ROW_STEREO    per pitch bin: correlation, balance, mid, side
+//   FEATURE_ATLAS_ROW_TONES     amplitude of every tracked frequency
+//   FEATURE_ATLAS_ROW_HISTORY   first of `history` rows of pitch bins, a ring
+// A row holds fewer values than the atlas is wide; the uniform block tells
+// how many, and which history row is the newest. Texel x of row y is sampled
+// at ((x + 0.5) / width, (y + 0.5) / height). The fixed rows are uploaded in
+// one update per frame, history rows as the analysis adds them.
+//
+// The scalars live in the std140 block below, mirrored by FeatureUniforms:
+//   layout(std140) uniform AudioFeatures {
+//     vec4 u_stereo_summary; // correlation, balance, delay (samples), delay confidence
+//     vec4 u_loudness;       // momentary, short-term, integrated (LUFS), true-peak (dBTP)
+//     vec4 u_signal;         // average level of channels 0..3
+//     vec4 u_clock;          // seconds, resolution x, resolution y, frames analysed
+//     ivec4 u_layout;        // samples, bins, tones, channels
+//     ivec4 u_history;       // history rows, newest history row, atlas width, atlas height
+//   };
+
+#define FEATURE_ATLAS_CHANNELS 4  // Channels packed in the components of a texel
+#define FEATURE_ATLAS_BINDING 0   // Uniform buffer binding point of the AudioFeatures block
+#define FEATURE_ATLAS_BLOCK "AudioFeatures"
+
+typedef enum {
+	FEATURE_ATLAS_ROW_WAVEFORM,
+	FEATURE_ATLAS_ROW_BANDS,
+	FEATURE_ATLAS_ROW_STEREO,
+	FEATURE_ATLAS_ROW_TONES,
+	FEATURE_ATLAS_ROW_HISTORY
+} FeatureAtlasRow;
+
+typedef struct {
+	float stereo_summary[4];
+	float loudness[4];
+	float signal[4];
+	float clock[4];
+	int layout[4];
+	int history[4];
+} FeatureUniforms;
+
+_Static_assert(sizeof(FeatureUniforms) == 6 * 16, "FeatureUniforms must match the std140 AudioFeatures block");
+
+typedef struct {
+	TextureStream texture;   // RGBA32F, FEATURE_ATLAS_ROW_HISTORY + history rows
+	UniformStream block;     // AudioFeatures
+	FeatureUniforms uniforms;
+	int width;
+	int history;             // History rows
+	size_t channels;
+	float *staging;          // [FEATURE_ATLAS_ROW_HISTORY + history][width][4], kept between frames
+	unsigned long history_uploaded; // Spectrogram rows already in the atlas
+} FeatureAtlas;
+
+// Create the atlas for the outputs of an analysis, NULL on failure
+FeatureAtlas* create_feature_atlas(size_t channels, size_t num_samples, size_t num_bins, size_t num_tones, size_t history) {
+	size_t width = num_samples > num_bins ? num_samples : num_bins;
+	width = num_tones > width ? num_tones : width;
+	if (channels == 0 || width == 0) {
+		printf("Error: Invalid feature atlas layout (%zu channels, %zu texels wide)\n", channels, width);
+		return NULL;
+	}
+	FeatureAtlas *atlas = (FeatureAtlas *)calloc(1, sizeof(FeatureAtlas));
+	if (atlas == NULL) {
+		printf("Error: Failed to allocate memory for the feature atlas\n");
+		return NULL;
+	}
+	int height = FEATURE_ATLAS_ROW_HISTORY + (int)history;
+	atlas->width = (int)width;
+	atlas->history = (int)history;
+	atlas->channels = channels;
+	atlas->staging = (float *)calloc((size_t)height * width * 4, sizeof(float));
+	if (atlas->staging == NULL) {
+		printf("Error: Failed to allocate memory for the feature atlas\n");
+		free(atlas);
+		return NULL;
+	}
+	atlas->texture = create_texture_stream_with(atlas->width, height, RL_PIXELFORMAT_UNCOMPRESSED_R32G32B32A32, atlas->staging);
+	atlas->block = create_uniform_stream(sizeof(FeatureUniforms), FEATURE_ATLAS_BINDING);
+	int *layout = atlas->uniforms.layout;
+	layout[0] = (int)num_samples;
+	layout[1] = (int)num_bins;
+	layout[2] = (int)num_tones;
+	layout[3] = (int)channels;
+	atlas->uniforms.history[0] = (int)history;
+	atlas->uniforms.history[2] = atlas->width;
+	atlas->uniforms.history[3] = height;
+	for (int i = 0; i < 4; i++) {
+		atlas->uniforms.loudness[i] = LOUDNESS_FLOOR;
+	}
+	return atlas;
+}
+
+void destroy_feature_atlas(FeatureAtlas *atlas) {
+	if (atlas == NULL) return;
+	destroy_texture_stream(&atlas->texture);
+	destroy_uniform_stream(&atlas->block);
+	free(atlas->staging);
+	free(atlas);
+}
+
+// Attach a shader to the atlas, 0 if it reads the AudioFeatures block
+int feature_atlas_attach(FeatureAtlas *atlas, Shader shader) {
+	return uniform_stream_attach(&atlas->block, shader.id, FEATURE_ATLAS_BLOCK);
+}
+
+// Pack `count` values of each of `channels` channels, `stride` apart, into a row
+static void _feature_atlas_pack(FeatureAtlas *atlas, int row, const float *data, size_t count, size_t stride, size_t channels) {
+	float *texel = atlas->staging + (size_t)row * atlas->width * 4;
+	for (size_t j = 0; j < count; j++) {
+		for (size_t c = 0; c < FEATURE_ATLAS_CHANNELS; c++) {
+			size_t channel = c < channels ? c : channels - 1;
+			texel[j * 4 + c] = data[channel * stride + j];
+		}
+	}
+}
+
+// Upload the history rows the spectrogram added since the last frame
+static void _feature_atlas_history(FeatureAtlas *atlas, Spectrogram *spectrogram) {
+	if (spectrogram == NULL || atlas->history == 0 || spectrogram->rows != (size_t)atlas->history) return;
+	size_t bins = spectrogram->num_bins < (size_t)atlas->width ? spectrogram->num_bins : (size_t)atlas->width;
+	unsigned long written = spectrogram_written(spectrogram);
+	if (written < atlas->history_uploaded) {
+		atlas->history_uploaded = 0; // Restarted
+	}
+	unsigned long count = written - atlas->history_uploaded;
+	if (count > spectrogram->rows) {
+		count = spectrogram->rows;
+	}
+	size_t first = (written - count) % spectrogram->rows;
+	while (count > 0) {
+		// At most two spans, split where the ring wraps around
+		size_t span = spectrogram->rows - first < count ? spectrogram->rows - first : count;
+		for (size_t r = first; r < first + span; r++) {
+			float *texel = atlas->staging + (size_t)(FEATURE_ATLAS_ROW_HISTORY + r) * atlas->width * 4;
+			for (size_t c = 0; c < FEATURE_ATLAS_CHANNELS; c++) {
+				const float *bands = spectrogram_row(spectrogram, c < spectrogram->channels ? c : spectrogram->channels - 1, r);
+				for (size_t j = 0; j < bins; j++) {
+					texel[j * 4 + c] = bands[j];
+				}
+			}
+		}
+		texture_stream_update(&atlas->texture, 0, FEATURE_ATLAS_ROW_HISTORY + (int)first, atlas->width, (int)span,
+			atlas->staging + (size_t)(FEATURE_ATLAS_ROW_HISTORY + first) * atlas->width * 4);
+		count -= span;
+		first = 0;
+	}
+	atlas->history_uploaded = written;
+	atlas->uniforms.history[1] = (int)((written + spectrogram->rows - 1) % spectrogram->rows);
+}
+
+// Pack a snapshot, and the live stereo bands and spectrogram when there are any, then upload the atlas and the block
+void feature_atlas_update(FeatureAtlas *atlas, const AnalysisSnapshot *snapshot, const StereoAnalysis *stereo,
+		Spectrogram *spectrogram, float time, float width, float height) {
+	size_t channels = snapshot->channels < atlas->channels ? snapshot->channels : atlas->channels;
+	if (channels == 0) return;
+	size_t samples = snapshot->num_samples < (size_t)atlas->width ? snapshot->num_samples : (size_t)atlas->width;
+	size_t bins = snapshot->num_bins < (size_t)atlas->width ? snapshot->num_bins : (size_t)atlas->width;
+	size_t tones = snapshot->num_tones < (size_t)atlas->width ? snapshot->num_tones : (size_t)atlas->width;
+	_feature_atlas_pack(atlas, FEATURE_ATLAS_ROW_WAVEFORM, snapshot->time_data, samples, snapshot->num_samples, channels);
+	_feature_atlas_pack(atlas, FEATURE_ATLAS_ROW_BANDS, snapshot->pitch, bins, snapshot->num_bins, channels);
+	_feature_atlas_pack(atlas, FEATURE_ATLAS_ROW_TONES, snapshot->tones, tones, snapshot->num_tones, channels);
+	if (stereo != NULL) {
+		// The fields are the channels of this row
+		size_t stereo_bins = stereo->num_bins < (size_t)atlas->width ? stereo->num_bins : (size_t)atlas->width;
+		float *texel = atlas->staging + (size_t)FEATURE_ATLAS_ROW_STEREO * atlas->width * 4;
+		for (size_t j = 0; j < stereo_bins; j++) {
+			for (size_t f = 0; f < STEREO_FIELD_COUNT; f++) {
+				texel[j * 4 + f] = stereo->bands[f * stereo->num_bins + j];
+			}
+		}
+	}
+	texture_stream_update(&atlas->texture, 0, 0, atlas->width, FEATURE_ATLAS_ROW_HISTORY, atlas->staging);
+	_feature_atlas_history(atlas, spectrogram);
+
+	FeatureUniforms *uniforms = &atlas->uniforms;
+	memcpy(uniforms->stereo_summary, snapshot->stereo, sizeof(uniforms->stereo_summary));
+	memcpy(uniforms->loudness, snapshot->loudness, sizeof(uniforms->loudness));
+	for (size_t c = 0; c < FEATURE_ATLAS_CHANNELS; c++) {
+		uniforms->signal[c] = snapshot->norm_avg[c < channels ? c : channels - 1];
+	}
+	uniforms->clock[0] = time;
+	uniforms->clock[1] = width;
+	uniforms->clock[2] = height;
+	uniforms->clock[3] = (float)snapshot->frame;
+	uniform_stream_update(&atlas->block, uniforms);
+}
+#endif // FEATURE_ATLAS_H
@@ -0,0 +1,363 @@
+#ifndef FEATURE_STREAM_H
+#define FEATURE_STREAM_H
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// Binary feature stream: the analysis results of every hop, one fixed-size record each.
+//
+//   [FeatureStreamHeader, FEATURE_STREAM_HEADER_SIZE bytes]
+//   [record 0][record 1]...[record record_count - 1]
+//   [FeatureStreamIndexEntry x index_count]
+//
+// Record i starts at header_size + i * record_size, so a mapped file is read in
+// place without parsing. The header stores the byte offset of every field
+// inside a record, so readers don't depend on the layout of a given version.
+// The index keeps one entry every index_interval records for seeking by time.
+// All values are little endian, as written by the host. Version 2 added the
+// waveform; version 1 files read as streams without one (waveform_samples 0).
+//
+// FeatureStream maps a recorded file for reading.
+//
+// Records are written by the analysis thread into an in-memory ring and a
+// background thread writes them to disk in large chunks, so the analysis
+// thread never makes a syscall. When the writer falls behind, records are
+// dropped and counted instead of blocking the analysis.
+
+#define FEATURE_STREAM_MAGIC "VELAFEAT"
+#define FEATURE_STREAM_VERSION 2
+#define FEATURE_STREAM_HEADER_SIZE 256
+#define FEATURE_STREAM_INDEX_INTERVAL 256 // Records per index entry
+#define FEATURE_STREAM_RING_RECORDS 1024  // Records buffered for the writer
+#define FEATURE_STREAM_WAVEFORM_SAMPLES 256 // Samples per channel of the recorded waveform, at most
+
+typedef struct {
+	char magic[8];            // FEATURE_STREAM_MAGIC, not terminated
+	uint32_t version;
+	uint32_t header_size;     // Offset of the first record
+	uint32_t record_size;
+	uint32_t channels;
+	uint32_t num_bins;        // Pitch bands per channel
+	uint32_t sample_rate;
+	uint32_t buffer_size;     // Samples per channel analysed in each hop
+	uint32_t index_interval;
+	uint64_t record_count;    // Written on close, 0 while recording
+	uint64_t index_offset;    // Written on close
+	uint64_t index_count;
+	uint64_t dropped;         // Records lost because the writer fell behind
+	// Byte offsets of the fields inside a record
+	uint32_t time_offset;     // uint64_t, nanoseconds since the recording started
+	uint32_t frame_offset;    // uint64_t, captured frames consumed before the end of the hop
+	uint32_t outputs_offset;  // uint32_t, AnalysisOutput flags valid in this record
+	uint32_t norm_avg_offset; // float[channels]
+	uint32_t stereo_offset;   // float[4]: correlation, balance, delay (samples), delay confidence
+	uint32_t loudness_offset; // float[4]: momentary, short-term, integrated (LUFS), true-peak (dBTP)
+	uint32_t pitch_offset;    // float[channels][num_bins]
+	uint32_t waveform_samples; // Time data of the hop decimated to this many samples per channel, 0 if not recorded
+	uint32_t waveform_offset;  // float[channels][waveform_samples]
+} FeatureStreamHeader;
+
+_Static_assert(sizeof(FeatureStreamHeader) <= FEATURE_STREAM_HEADER_SIZE, "feature stream header too large");
+
+typedef struct {
+	uint64_t time;   // Nanoseconds since the recording started
+	uint64_t record; // Record number
+} FeatureStreamIndexEntry;
+
+typedef struct {
+	FILE *file;
+	FeatureStreamHeader header;
+	unsigned char *ring;      // FEATURE_STREAM_RING_RECORDS records
+	atomic_ulong head;        // Records committed by the analysis thread
+	atomic_ulong tail;        // Records written to the file
+	atomic_ulong dropped;
+	FeatureStreamIndexEntry *index;
+	size_t index_capacity;
+	uint64_t start_time;
+	atomic_int running;
+	pthread_t writer;
+} FeatureRecorder;
+
+static uint64_t _feature_stream_now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Field accessors, for a record being written or a record of a mapped file
+static inline uint64_t* feature_record_time(const FeatureStreamHeader *h, void *record) {
+	return (uint64_t*)((unsigned char*)record + h->time_offset);
+}
+static inline uint64_t* feature_record_frame(const FeatureStreamHeader *h, void *record) {
+	return (uint64_t*)((unsigned char*)record + h->frame_offset);
+}
+static inline uint32_t* feature_record_outputs(const FeatureStreamHeader *h, void *record) {
+	return (uint32_t*)((unsigned char*)record + h->outputs_offset);
+}
+static inline float* feature_record_norm_avg(const FeatureStreamHeader *h, void *record) {
+	return (float*)((unsigned char*)record + h->norm_avg_offset);
+}
+static inline float* feature_record_stereo(const FeatureStreamHeader *h, void *record) {
+	return (float*)((unsigned char*)record + h->stereo_offset);
+}
+static inline float* feature_record_loudness(const FeatureStreamHeader *h, void *record) {
+	return (float*)((unsigned char*)record + h->loudness_offset);
+}
+static inline float* feature_record_pitch(const FeatureStreamHeader *h, void *record, size_t channel) {
+	return (float*)((unsigned char*)record + h->pitch_offset) + channel * h->num_bins;
+}
+static inline float* feature_record_waveform(const FeatureStreamHeader *h, void *record, size_t channel) {
+	return (float*)((unsigned char*)record + h->waveform_offset) + channel * h->waveform_samples;
+}
+
+// Record layout of the current version
+static void _feature_stream_layout(FeatureStreamHeader *h) {
+	uint32_t offset = 0;
+	h->time_offset = offset;     offset += sizeof(uint64_t);
+	h->frame_offset = offset;    offset += sizeof(uint64_t);
+	h->outputs_offset = offset;  offset += sizeof(uint32_t);
+	h->norm_avg_offset = offset; offset += sizeof(float) * h->channels;
+	h->stereo_offset = offset;   offset += sizeof(float) * 4;
+	h->loudness_offset = offset; offset += sizeof(float) * 4;
+	h->pitch_offset = offset;    offset += sizeof(float) * h->channels * h->num_bins;
+	h->waveform_offset = offset; offset += sizeof(float) * h->channels * h->waveform_samples;
+	h->record_size = (offset + 7) & ~7u; // Keep the 64-bit fields of every record aligned
+}
+
+// Write the ring from tail up to head, in at most two chunks split where the ring wraps
+static void _feature_recorder_flush(FeatureRecorder *rec) {
+	unsigned long head = atomic_load_explicit(&rec->head, memory_order_acquire);
+	unsigned long tail = atomic_load_explicit(&rec->tail, memory_order_relaxed);
+	size_t record_size = rec->header.record_size;
+	while (tail < head) {
+		size_t slot = tail % FEATURE_STREAM_RING_RECORDS;
+		size_t count = head - tail;
+		if (count > FEATURE_STREAM_RING_RECORDS - slot) count = FEATURE_STREAM_RING_RECORDS - slot;
+
+		// Index the records of this chunk falling on an interval boundary
+		for (unsigned long r = tail; r < tail + count; r++) {
+			if (r % rec->header.index_interval != 0) continue;
+			if (rec->header.index_count == rec->index_capacity) {
+				size_t capacity = rec->index_capacity ? rec->index_capacity * 2 : 64;
+				FeatureStreamIndexEntry *index = realloc(rec->index, capacity * sizeof(FeatureStreamIndexEntry));
+				if (index == NULL) break; // The index is only a seek aid, keep recording without it
+				rec->index = index;
+				rec->index_capacity = capacity;
+			}
+			void *record = rec->ring + (r % FEATURE_STREAM_RING_RECORDS) * record_size;
+			rec->index[rec->header.index_count].time = *feature_record_time(&rec->header, record);
+			rec->index[rec->header.index_count].record = r;
+			rec->header.index_count++;
+		}
+
+		fwrite(rec->ring + slot * record_size, record_size, count, rec->file);
+		tail += count;
+		atomic_store_explicit(&rec->tail, tail, memory_order_release);
+	}
+}
+
+static void *_feature_recorder_loop(void *arg) {
+	FeatureRecorder *rec = (FeatureRecorder *)arg;
+	while (atomic_load(&rec->running)) {
+		_feature_recorder_flush(rec);
+		usleep(10000); // A hop takes tens of milliseconds, the ring holds many of them
+	}
+	_feature_recorder_flush(rec);
+	return NULL;
+}
+
+// Create a feature stream file and start its writer thread
+FeatureRecorder* feature_recorder_open(const char *path, size_t channels, size_t num_bins, unsigned int sample_rate, size_t buffer_size) {
+	size_t waveform_samples = buffer_size < FEATURE_STREAM_WAVEFORM_SAMPLES ? buffer_size : FEATURE_STREAM_WAVEFORM_SAMPLES;
+	FeatureRecorder *rec = (FeatureRecorder *)calloc(1, sizeof(FeatureRecorder));
+	if (!rec) return NULL;
+
+	rec->file = fopen(path, "wb");
+	if (rec->file == NULL) {
+		printf("Error: Failed to open feature stream %s\n", path);
+		free(rec);
+		return NULL;
+	}
+	// stdio gets a large buffer, so each chunk becomes a few big writes
+	setvbuf(rec->file, NULL, _IOFBF, 1 << 20);
+
+	FeatureStreamHeader *h = &rec->header;
+	memcpy(h->magic, FEATURE_STREAM_MAGIC, sizeof(h->magic));
+	h->version = FEATURE_STREAM_VERSION;
+	h->header_size = FEATURE_STREAM_HEADER_SIZE;
+	h->channels = channels;
+	h->num_bins = num_bins;
+	h->sample_rate = sample_rate;
+	h->buffer_size = buffer_size;
+	h->waveform_samples = waveform_samples;
+	h->index_interval = FEATURE_STREAM_INDEX_INTERVAL;
+	_feature_stream_layout(h);
+
+	rec->ring = (unsigned char *)calloc(FEATURE_STREAM_RING_RECORDS, h->record_size);
+	if (rec->ring == NULL) {
+		printf("Error: Failed to allocate memory for feature stream\n");
+		fclose(rec->file);
+		free(rec);
+		return NULL;
+	}
+
+	// The header is rewritten on close with the record count and the index
+	unsigned char header[FEATURE_STREAM_HEADER_SIZE] = {0};
+	memcpy(header, h, sizeof(FeatureStreamHeader));
+	fwrite(header, sizeof(header), 1, rec->file);
+
+	rec->start_time = _feature_stream_now();
+	atomic_store(&rec->running, 1);
+	if (pthread_create(&rec->writer, NULL, _feature_recorder_loop, rec) != 0) {
+		printf("Error: Failed to start the feature stream writer\n");
+		fclose(rec->file);
+		free(rec->ring);
+		free(rec);
+		return NULL;
+	}
+	printf("Recording features to %s (%u bytes per record)\n", path, h->record_size);
+	return rec;
+}
+
+// Slot for the next record, NULL if the ring is full. Fill it and call feature_recorder_commit.
+void *feature_recorder_reserve(FeatureRecorder *rec) {
+	unsigned long head = atomic_load_explicit(&rec->head, memory_order_relaxed);
+	unsigned long tail = atomic_load_explicit(&rec->tail, memory_order_acquire);
+	if (head - tail >= FEATURE_STREAM_RING_RECORDS) {
+		atomic_fetch_add(&rec->dropped, 1);
+		return NULL;
+	}
+	void *record = rec->ring + (head % FEATURE_STREAM_RING_RECORDS) * rec->header.record_size;
+	*feature_record_time(&rec->header, record) = _feature_stream_now() - rec->start_time;
+	return record;
+}
+
+// Hand the reserved record over to the writer
+void feature_recorder_commit(FeatureRecorder *rec) {
+	atomic_fetch_add_explicit(&rec->head, 1, memory_order_release);
+}
+
+// Flush the pending records, append the index and finalize the header
+void feature_recorder_close(FeatureRecorder *rec) {
+	if (!rec) return;
+
+	atomic_store(&rec->running, 0);
+	pthread_join(rec->writer, NULL);
+
+	FeatureStreamHeader *h = &rec->header;
+	h->record_count = atomic_load(&rec->tail);
+	h->dropped = atomic_load(&rec->dropped);
+	h->index_offset = (uint64_t)h->header_size + h->record_count * h->record_size;
+	fwrite(rec->index, sizeof(FeatureStreamIndexEntry), h->index_count, rec->file);
+	fseek(rec->file, 0, SEEK_SET);
+	fwrite(h, sizeof(FeatureStreamHeader), 1, rec->file);
+	fclose(rec->file);
+	printf("Recorded %llu feature records (%llu dropped)\n", (unsigned long long)h->record_count, (unsigned long long)h->dropped);
+
+	free(rec->index);
+	free(rec->ring);
+	free(rec);
+}
+typedef struct {
+	unsigned char *base;                  // Mapped file
+	size_t size;
+	const FeatureStreamHeader *header;
+	size_t record_count;
+	const FeatureStreamIndexEntry *index; // NULL if the recording was not closed
+	size_t index_count;
+} FeatureStream;
+
+// Map a recorded feature stream, NULL if it can't be read
+FeatureStream* feature_stream_open(const char *path) {
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		printf("Error: Failed to open feature stream %s\n", path);
+		return NULL;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < FEATURE_STREAM_HEADER_SIZE) {
+		printf("Error: %s is not a feature stream\n", path);
+		close(fd);
+		return NULL;
+	}
+	void *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); // The mapping keeps the file referenced
+	if (base == MAP_FAILED) {
+		printf("Error: Failed to map feature stream %s\n", path);
+		return NULL;
+	}
+
+	const FeatureStreamHeader *h = (const FeatureStreamHeader *)base;
+	// Fields added after version 1 are zero in its header, so older files read without them
+	if (memcmp(h->magic, FEATURE_STREAM_MAGIC, sizeof(h->magic)) != 0 || h->version == 0 || h->version > FEATURE_STREAM_VERSION ||
+		h->record_size == 0 || h->header_size > (size_t)st.st_size) {
+		printf("Error: %s is not a version 1 to %d feature stream\n", path, FEATURE_STREAM_VERSION);
+		munmap(base, st.st_size);
+		return NULL;
+	}
+
+	FeatureStream *fs = (FeatureStream *)calloc(1, sizeof(FeatureStream));
+	if (!fs) {
+		munmap(base, st.st_size);
+		return NULL;
+	}
+	fs->base = (unsigned char *)base;
+	fs->size = st.st_size;
+	fs->header = h;
+	fs->record_count = h->record_count;
+	size_t index_end = h->index_offset + h->index_count * sizeof(FeatureStreamIndexEntry);
+	if (h->record_count > 0 && h->index_offset > 0 && index_end <= fs->size) {
+		fs->index = (const FeatureStreamIndexEntry *)(fs->base + h->index_offset);
+		fs->index_count = h->index_count;
+	} else {
+		// The recorder did not close the file, use every complete record
+		fs->record_count = (fs->size - h->header_size) / h->record_size;
+	}
+
+	// Replays read forward
+	madvise(fs->base, fs->size, MADV_SEQUENTIAL);
+	return fs;
+}
+
+// Record i of a mapped stream
+void *feature_stream_record(FeatureStream *fs, size_t i) {
+	return fs->base + fs->header->header_size + i * fs->header->record_size;
+}
+
+// Last record recorded at or before `time` nanoseconds, 0 if there is none
+size_t feature_stream_seek(FeatureStream *fs, uint64_t time) {
+	if (fs->record_count == 0) return 0;
+
+	// The index narrows the search to one interval, so only a few pages are touched
+	size_t low = 0, high = fs->record_count;
+	if (fs->index_count > 0) {
+		size_t a = 0, b = fs->index_count;
+		while (b - a > 1) {
+			size_t m = (a + b) / 2;
+			if (fs->index[m].time <= time) a = m; else b = m;
+		}
+		low = fs->index[a].record;
+		if (b < fs->index_count) high = fs->index[b].record;
+	}
+	while (high - low > 1) {
+		size_t m = (low + high) / 2;
+		if (*feature_record_time(fs->header, feature_stream_record(fs, m)) <= time) low = m; else high = m;
+	}
+	return low;
+}
+
+void feature_stream_close(FeatureStream *fs) {
+	if (!fs) return;
+	munmap(fs->base, fs->size);
+	free(fs);
+}
+#endif // FEATURE_STREAM_H
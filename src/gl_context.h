@@ -0,0 +1,159 @@
+#ifndef GL_CONTEXT_H
+#define GL_CONTEXT_H
+#include <stdio.h>
+#include <string.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include "raylib.h"
+#include "rlgl.h"
+
+// OpenGL contexts and their entry points.
+// The app draws into a window, raylib creates its context with the platform.
+// A headless context renders without a window or a display: it is made with
+// EGL on the surfaceless platform of the driver, or on a 1x1 pbuffer where
+// there is none, and everything is drawn into render textures. rlgl is set
+// up on it directly, with the default font raylib would load in InitWindow.
+// The modules loading entry points raylib doesn't export go through
+// gl_proc_address, which asks whichever created the current context.
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+
+// GL enums used here, rlgl doesn't export them
+#define _GL_CONTEXT_EXTENSIONS 0x1F03
+#define _GL_CONTEXT_NUM_EXTENSIONS 0x821D
+
+typedef void (*GLProc)(void);
+
+static struct {
+	int headless; // The current context was made here, not by raylib
+	EGLDisplay display;
+	EGLContext context;
+	EGLSurface surface; // EGL_NO_SURFACE when the driver draws without one
+} _gl_context;
+
+#if defined(PLATFORM_DESKTOP)
+// raylib links GLFW in, its loader returns the entry points of the current context
+GLProc glfwGetProcAddress(const char *procname);
+#define _GL_CONTEXT_PLATFORM_PROC(name) glfwGetProcAddress(name)
+#else
+// The other raylib platforms create their contexts with EGL
+#define _GL_CONTEXT_PLATFORM_PROC(name) ((GLProc)eglGetProcAddress(name))
+#endif
+
+// raylib loads its default font when it opens a window, both are exported for its core module
+void LoadFontDefault(void);
+void UnloadFontDefault(void);
+
+// Entry point `name` of the current context, NULL when it has none
+GLProc gl_proc_address(const char *name) {
+	if (_gl_context.headless) return (GLProc)eglGetProcAddress(name);
+	return _GL_CONTEXT_PLATFORM_PROC(name);
+}
+
+// The current context supports the extension `name`
+int gl_extension_supported(const char *name) {
+	void (*get_integerv)(unsigned int name, int *params);
+	const unsigned char* (*get_stringi)(unsigned int name, unsigned int index);
+	*(void **)&get_integerv = (void *)gl_proc_address("glGetIntegerv");
+	*(void **)&get_stringi = (void *)gl_proc_address("glGetStringi");
+	if (get_integerv == NULL || get_stringi == NULL) return 0;
+	int count = 0;
+	get_integerv(_GL_CONTEXT_NUM_EXTENSIONS, &count);
+	for (int i = 0; i < count; i++) {
+		const char *extension = (const char *)get_stringi(_GL_CONTEXT_EXTENSIONS, (unsigned int)i);
+		if (extension != NULL && strcmp(extension, name) == 0) return 1;
+	}
+	return 0;
+}
+
+// The EGL display or client string `extensions` lists `name`
+static int _gl_context_egl_extension(const char *extensions, const char *name) {
+	size_t length = strlen(name);
+	for (const char *found = extensions; found != NULL && (found = strstr(found, name)) != NULL; found += length) {
+		if ((found == extensions || found[-1] == ' ') && (found[length] == ' ' || found[length] == '\0')) return 1;
+	}
+	return 0;
+}
+
+// Display of the surfaceless platform, the default display when the driver has none
+static EGLDisplay _gl_context_display() {
+	const char *client = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS); // NULL without client extensions
+	if (_gl_context_egl_extension(client, "EGL_MESA_platform_surfaceless")) {
+		PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+		if (get_platform_display != NULL) {
+			EGLDisplay display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+			if (display != EGL_NO_DISPLAY) return display;
+		}
+	}
+	return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+// Make an OpenGL 3.3 core context without a window and set rlgl up on it for a width x height framebuffer, 0 on success
+int create_headless_context(int width, int height) {
+	memset(&_gl_context, 0, sizeof(_gl_context));
+	_gl_context.display = _gl_context_display();
+	if (_gl_context.display == EGL_NO_DISPLAY || !eglInitialize(_gl_context.display, NULL, NULL)) {
+		printf("Error: Failed to open an EGL display for headless rendering\n");
+		return -1;
+	}
+	_gl_context.context = EGL_NO_CONTEXT;
+	_gl_context.surface = EGL_NO_SURFACE;
+	const EGLint config_attributes[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_ALPHA_SIZE, 8,
+		EGL_DEPTH_SIZE, 24,
+		EGL_NONE
+	};
+	const EGLint context_attributes[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 3,
+		EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	EGLConfig config;
+	EGLint configs = 0;
+	if (!eglBindAPI(EGL_OPENGL_API) || !eglChooseConfig(_gl_context.display, config_attributes, &config, 1, &configs) || configs == 0) {
+		printf("Error: The EGL display has no OpenGL configuration for headless rendering\n");
+		eglTerminate(_gl_context.display);
+		return -1;
+	}
+	_gl_context.context = eglCreateContext(_gl_context.display, config, EGL_NO_CONTEXT, context_attributes);
+	if (_gl_context.context == EGL_NO_CONTEXT) {
+		printf("Error: Failed to create an OpenGL 3.3 context for headless rendering\n");
+		eglTerminate(_gl_context.display);
+		return -1;
+	}
+	// Everything is drawn into render textures, the pbuffer is only there for drivers that want a surface
+	if (!_gl_context_egl_extension(eglQueryString(_gl_context.display, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context")) {
+		const EGLint pbuffer_attributes[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+		_gl_context.surface = eglCreatePbufferSurface(_gl_context.display, config, pbuffer_attributes);
+	}
+	if (!eglMakeCurrent(_gl_context.display, _gl_context.surface, _gl_context.surface, _gl_context.context)) {
+		printf("Error: Failed to make the headless OpenGL context current\n");
+		if (_gl_context.surface != EGL_NO_SURFACE) eglDestroySurface(_gl_context.display, _gl_context.surface);
+		eglDestroyContext(_gl_context.display, _gl_context.context);
+		eglTerminate(_gl_context.display);
+		return -1;
+	}
+	_gl_context.headless = 1;
+
+	rlLoadExtensions((void *)eglGetProcAddress);
+	rlglInit(width, height);
+	LoadFontDefault();
+	return 0;
+}
+
+void destroy_headless_context() {
+	if (!_gl_context.headless) return;
+	UnloadFontDefault();
+	rlglClose();
+	eglMakeCurrent(_gl_context.display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	if (_gl_context.surface != EGL_NO_SURFACE) eglDestroySurface(_gl_context.display, _gl_context.surface);
+	eglDestroyContext(_gl_context.display, _gl_context.context);
+	eglTerminate(_gl_context.display);
+	_gl_context.headless = 0;
+}
+#endif // GL_CONTEXT_H
@@ -263,6 +263,7 @@ void AudioConfigSaveButton(GuiAudioConfigState *state, AudioConfig *audio_config
 
 	audio_analysis_config.buffer_size = audio_config->buffer_size;
 	audio_analysis_config.channels = audio_config->capture_channels;
+	audio_analysis_config.sample_rate = audio_config->sample_rate;
 
 	if(start_analysis(&audio_analysis_config) != 0) {
 		printf("Failed to start audio analysis\n");
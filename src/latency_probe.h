@@ -0,0 +1,217 @@
+#ifndef LATENCY_PROBE_H
+#define LATENCY_PROBE_H
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "audio.h"
+
+// End-to-end latency harness.
+// A generator thread stands in for the capture device of an
+// AUDIO_SOURCE_TYPE_GENERATOR source: every `period` frames, paced by the
+// monotonic clock like a device callback, it writes silence into the ring
+// buffer with single-sample clicks at known stream positions. The renderer
+// reports the frames covered by every snapshot it takes and the end of every
+// frame it presents. A click is published by the first snapshot covering its
+// position and presented with the frame drawing that snapshot. Arrival is
+// decided by stream positions instead of detecting the click in the signal,
+// so runs are reproducible without a loopback cable.
+
+#define LATENCY_PROBE_DEFAULT_PERIOD 256    // Frames per simulated callback
+#define LATENCY_PROBE_DEFAULT_INTERVAL 0.25 // Mean seconds between clicks
+
+typedef struct {
+	uint64_t position;  // Frame of the click in the captured stream
+	uint64_t injected;  // profile_now() when its period reached the ring buffer
+	uint64_t published; // profile_now() when a snapshot covering it was taken, 0 until then
+	uint64_t presented; // profile_now() when the frame drawing that snapshot was presented, 0 until then
+} LatencyImpulse;
+
+typedef struct {
+	ma_uint32 sample_rate;
+	ma_uint32 channels;
+	ma_uint32 period;       // Frames written per simulated callback
+	ma_uint32 interval;     // Mean frames between clicks, the gaps are jittered so clicks don't lock to the hop
+	size_t count;           // Clicks to inject
+	LatencyImpulse *impulses;
+	atomic_size_t injected; // Clicks written to the ring buffer
+	size_t published;       // Clicks covered by a snapshot, renderer side
+	size_t presented;       // Clicks presented, renderer side
+	uint64_t position;      // Frames written to the ring buffer
+	uint64_t next_position; // Position of the next click
+	unsigned int seed;
+	size_t overruns;        // Periods cut short because the ring buffer was full
+	atomic_int running;
+	pthread_t thread;
+} LatencyProbe;
+
+// Gap before the next click, uniform in [interval / 2, 3 * interval / 2)
+static uint64_t _latency_probe_gap(LatencyProbe *probe) {
+	probe->seed = probe->seed * 1664525u + 1013904223u;
+	return probe->interval / 2 + (probe->seed >> 8) % probe->interval;
+}
+
+// Write one period of silence, and the click falling in it, to the ring buffer
+static void _latency_probe_write(LatencyProbe *probe, uint64_t now) {
+	AudioData *audio_data = get_audio_data();
+	ma_uint32 remaining = probe->period;
+	while (remaining > 0) {
+		ma_uint32 frames = remaining;
+		void *buffer;
+		if (ma_pcm_rb_acquire_write(&audio_data->rb, &frames, &buffer) != MA_SUCCESS || frames == 0) {
+			probe->overruns++; // The analysis fell behind, the frames are lost like on a device
+			return;
+		}
+		float *samples = (float *)buffer;
+		memset(samples, 0, sizeof(float) * frames * probe->channels);
+		size_t injected = atomic_load_explicit(&probe->injected, memory_order_relaxed);
+		if (injected < probe->count && probe->next_position < probe->position + frames) {
+			uint64_t offset = probe->next_position - probe->position;
+			for (ma_uint32 c = 0; c < probe->channels; c++) {
+				samples[offset * probe->channels + c] = 1.0f;
+			}
+			LatencyImpulse *impulse = &probe->impulses[injected];
+			impulse->position = probe->next_position;
+			impulse->injected = now;
+			probe->next_position += _latency_probe_gap(probe);
+			atomic_store_explicit(&probe->injected, injected + 1, memory_order_release);
+		}
+		ma_pcm_rb_commit_write(&audio_data->rb, frames);
+		probe->position += frames;
+		remaining -= frames;
+	}
+}
+
+static void *_latency_probe_loop(void *arg) {
+	LatencyProbe *probe = (LatencyProbe *)arg;
+	profile_thread_name("generator");
+	thread_schedule_apply("generator", &_audio_schedule); // Scheduled like the device thread it stands in for
+	uint64_t period_ns = (uint64_t)probe->period * 1000000000ull / probe->sample_rate;
+	uint64_t deadline = profile_now();
+	while (atomic_load(&probe->running)) {
+		deadline += period_ns;
+		struct timespec ts = {(time_t)(deadline / 1000000000ull), (long)(deadline % 1000000000ull)};
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+
+		// Like a device callback: the period was captured by now
+		uint64_t start = profile_now();
+		_latency_probe_write(probe, start);
+		atomic_store_explicit(&_audio_capture_time, start, memory_order_release);
+		profile_record_arg(PROFILE_CALLBACK, start, profile_now(), probe->period);
+	}
+	return NULL;
+}
+
+// Start injecting `count` clicks into the ring buffer of a generator source, every `period` frames
+LatencyProbe* latency_probe_start(AudioConfig *config, ma_uint32 period, size_t count) {
+	AudioData *audio_data = get_audio_data();
+	if (audio_data == NULL || config->source_type != AUDIO_SOURCE_TYPE_GENERATOR) {
+		printf("Error: The latency probe needs an initialized generator source\n");
+		return NULL;
+	}
+	if (audio_data->rb.format != ma_format_f32 || period == 0 || count == 0) {
+		printf("Error: Invalid latency probe configuration\n");
+		return NULL;
+	}
+
+	LatencyProbe *probe = (LatencyProbe *)calloc(1, sizeof(LatencyProbe));
+	if (!probe) return NULL;
+	probe->sample_rate = config->sample_rate;
+	probe->channels = audio_data->rb.channels;
+	probe->period = period;
+	probe->interval = (ma_uint32)(config->sample_rate * LATENCY_PROBE_DEFAULT_INTERVAL);
+	probe->count = count;
+	probe->seed = 1;
+	probe->impulses = (LatencyImpulse *)calloc(count, sizeof(LatencyImpulse));
+	if (!probe->impulses) {
+		printf("Error: Failed to allocate memory for latency probe\n");
+		free(probe);
+		return NULL;
+	}
+	probe->next_position = _latency_probe_gap(probe);
+	atomic_init(&probe->injected, 0);
+	atomic_init(&probe->running, 1);
+	if (pthread_create(&probe->thread, NULL, _latency_probe_loop, probe) != 0) {
+		printf("Error: Failed to start latency probe thread\n");
+		free(probe->impulses);
+		free(probe);
+		return NULL;
+	}
+	printf("Latency probe: %zu clicks, one every %.2f s on average\n", count, LATENCY_PROBE_DEFAULT_INTERVAL);
+	return probe;
+}
+
+// A snapshot covering the captured frames before `frame` was taken
+void latency_probe_published(LatencyProbe *probe, uint64_t frame) {
+	uint64_t now = profile_now();
+	size_t injected = atomic_load_explicit(&probe->injected, memory_order_acquire);
+	while (probe->published < injected && probe->impulses[probe->published].position < frame) {
+		probe->impulses[probe->published++].published = now;
+	}
+}
+
+// The frame drawing the last snapshot was presented
+void latency_probe_presented(LatencyProbe *probe) {
+	uint64_t now = profile_now();
+	while (probe->presented < probe->published) {
+		probe->impulses[probe->presented++].presented = now;
+	}
+}
+
+// Every click was presented
+int latency_probe_done(LatencyProbe *probe) {
+	return probe->presented >= probe->count;
+}
+
+static int _latency_probe_compare(const void *a, const void *b) {
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+static void _latency_probe_print(const char *label, double *ms, size_t n) {
+	if (n == 0) {
+		printf("  %-18s no clicks\n", label);
+		return;
+	}
+	qsort(ms, n, sizeof(double), _latency_probe_compare);
+	printf("  %-18s n %4zu  min %7.2f  p50 %7.2f  p90 %7.2f  p99 %7.2f  max %7.2f ms\n", label, n,
+		ms[0], ms[(size_t)(0.50 * (n - 1) + 0.5)], ms[(size_t)(0.90 * (n - 1) + 0.5)], ms[(size_t)(0.99 * (n - 1) + 0.5)], ms[n - 1]);
+}
+
+// Print the latency distributions, along with the configuration they were measured with
+void latency_probe_report(LatencyProbe *probe, size_t ring_size, size_t buffer_size, int target_fps) {
+	double *published = (double *)malloc(sizeof(double) * (probe->count + 1));
+	double *presented = (double *)malloc(sizeof(double) * (probe->count + 1));
+	if (!published || !presented) {
+		printf("Error: Failed to allocate memory for latency report\n");
+		free(published);
+		free(presented);
+		return;
+	}
+	size_t n_published = 0, n_presented = 0;
+	for (size_t i = 0; i < probe->presented; i++) {
+		LatencyImpulse *impulse = &probe->impulses[i];
+		published[n_published++] = (impulse->published - impulse->injected) * 1e-6;
+		presented[n_presented++] = (impulse->presented - impulse->injected) * 1e-6;
+	}
+	printf("Latency: rate %u Hz, %u channels, period %u, ring %zu, buffer %zu, target %d fps, %zu overruns\n",
+		probe->sample_rate, probe->channels, probe->period, ring_size, buffer_size, target_fps, probe->overruns);
+	_latency_probe_print("capture->snapshot", published, n_published);
+	_latency_probe_print("capture->present", presented, n_presented);
+	free(published);
+	free(presented);
+}
+
+// Stop the generator thread, before the audio source is closed
+void latency_probe_stop(LatencyProbe *probe) {
+	if (!probe) return;
+	atomic_store(&probe->running, 0);
+	pthread_join(probe->thread, NULL);
+	free(probe->impulses);
+	free(probe);
+}
+#endif // LATENCY_PROBE_H
@@ -0,0 +1,348 @@
+#ifndef LOUDNESS_H
+#define LOUDNESS_H
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+// EBU R128 / ITU-R BS.1770 loudness meter.
+// Samples are K-weighted and accumulated in 100ms sub-blocks; momentary loudness
+// covers the last 4 of them (400ms), short-term the last 30 (3s) and integrated
+// loudness gates the 400ms blocks through a 0.1 LU histogram so memory stays bounded.
+// Every per-sample loop runs across channels, so the IIR state is laid out per
+// channel and the channel loop vectorizes.
+
+#define LOUDNESS_MOMENTARY_BLOCKS 4    // 400ms
+#define LOUDNESS_SHORT_TERM_BLOCKS 30  // 3s
+#define LOUDNESS_ABSOLUTE_GATE -70.0   // LUFS
+#define LOUDNESS_RELATIVE_GATE -10.0   // LU below the absolute-gated loudness
+#define LOUDNESS_FLOOR -120.0          // Reported instead of -inf for silence
+#define LOUDNESS_HISTOGRAM_MIN -70.0   // LUFS, blocks below are gated out anyway
+#define LOUDNESS_HISTOGRAM_MAX 10.0    // LUFS
+#define LOUDNESS_HISTOGRAM_STEP 0.1    // LU per histogram bin
+#define LOUDNESS_HISTOGRAM_BINS 800    // (MAX - MIN) / STEP
+
+#define TRUE_PEAK_OVERSAMPLING 4
+#define TRUE_PEAK_TAPS 12              // Taps per polyphase branch, 48 in total
+
+typedef struct {
+	double b0, b1, b2, a1, a2;
+} LoudnessBiquad;
+
+typedef struct {
+	size_t channels;
+	unsigned int sample_rate;
+	size_t sub_block_size;   // Frames per 100ms sub-block
+	size_t sub_block_pos;    // Frames accumulated in the current sub-block
+
+	LoudnessBiquad shelf;    // K-weighting stage 1, high frequency shelf
+	LoudnessBiquad highpass; // K-weighting stage 2, RLB high-pass
+	double *shelf_z1, *shelf_z2; // Filter state per channel
+	double *highpass_z1, *highpass_z2;
+	double *energy;          // Sum of squares of the current sub-block per channel
+	double *sub_blocks;      // [LOUDNESS_SHORT_TERM_BLOCKS][channels] mean squares of past sub-blocks
+	size_t sub_block_index;  // Next row of sub_blocks to be written
+	size_t sub_block_count;  // Rows filled so far
+	double *weights;         // Channel weights, 1.0 by default, 1.41 for surrounds, 0 for LFE
+
+	double tp_coefs[TRUE_PEAK_OVERSAMPLING][TRUE_PEAK_TAPS]; // Polyphase interpolation filter
+	double *tp_history;      // [2*TRUE_PEAK_TAPS][channels], doubled so the taps read contiguous rows
+	size_t tp_pos;
+	double *tp_peak;         // Linear true-peak since the last reset per channel
+
+	unsigned int *histogram; // Gated 400ms block counts for the integrated loudness
+	double *histogram_energy; // Summed mean squares of the blocks in each histogram bin
+	size_t histogram_total;
+
+	double *momentary;       // LUFS per channel
+	double *short_term;      // LUFS per channel
+	double *true_peak;       // dBTP per channel
+	double momentary_lufs;   // Program loudness over all weighted channels
+	double short_term_lufs;
+	double integrated_lufs;
+	double true_peak_dbtp;   // Maximum over all channels
+} LoudnessMeter;
+
+static double _loudness_to_lufs(double mean_square) {
+	if (mean_square <= 0.0) return LOUDNESS_FLOOR;
+	double lufs = -0.691 + 10.0 * log10(mean_square);
+	return lufs < LOUDNESS_FLOOR ? LOUDNESS_FLOOR : lufs;
+}
+
+static double _loudness_to_dbtp(double peak) {
+	if (peak <= 0.0) return LOUDNESS_FLOOR;
+	double db = 20.0 * log10(peak);
+	return db < LOUDNESS_FLOOR ? LOUDNESS_FLOOR : db;
+}
+
+// K-weighting filters for an arbitrary sample rate, from the BS.1770 analog prototypes
+static void _loudness_init_filters(LoudnessMeter *lm) {
+	double rate = (double)lm->sample_rate;
+
+	double f0 = 1681.974450955533;
+	double gain = 3.999843853973347;
+	double q = 0.7071752369554196;
+	double k = tan(M_PI * f0 / rate);
+	double vh = pow(10.0, gain / 20.0);
+	double vb = pow(vh, 0.4996667741545416);
+	double a0 = 1.0 + k / q + k * k;
+	lm->shelf.b0 = (vh + vb * k / q + k * k) / a0;
+	lm->shelf.b1 = 2.0 * (k * k - vh) / a0;
+	lm->shelf.b2 = (vh - vb * k / q + k * k) / a0;
+	lm->shelf.a1 = 2.0 * (k * k - 1.0) / a0;
+	lm->shelf.a2 = (1.0 - k / q + k * k) / a0;
+
+	f0 = 38.13547087602444;
+	q = 0.5003270373238773;
+	k = tan(M_PI * f0 / rate);
+	a0 = 1.0 + k / q + k * k;
+	lm->highpass.b0 = 1.0;
+	lm->highpass.b1 = -2.0;
+	lm->highpass.b2 = 1.0;
+	lm->highpass.a1 = 2.0 * (k * k - 1.0) / a0;
+	lm->highpass.a2 = (1.0 - k / q + k * k) / a0;
+}
+
+// 4x interpolation filter, a Hann windowed sinc split into polyphase branches
+static void _loudness_init_true_peak(LoudnessMeter *lm) {
+	int length = TRUE_PEAK_OVERSAMPLING * TRUE_PEAK_TAPS;
+	double center = (length - 1) / 2.0;
+	for (int p = 0; p < TRUE_PEAK_OVERSAMPLING; p++) {
+		double sum = 0.0;
+		for (int k = 0; k < TRUE_PEAK_TAPS; k++) {
+			int n = p + k * TRUE_PEAK_OVERSAMPLING;
+			double x = (n - center) / TRUE_PEAK_OVERSAMPLING;
+			double sinc = fabs(x) < 1e-12 ? 1.0 : sin(M_PI * x) / (M_PI * x);
+			double window = 0.5 - 0.5 * cos(2.0 * M_PI * (n + 0.5) / length);
+			// Taps are stored oldest sample first to match the history rows
+			lm->tp_coefs[p][TRUE_PEAK_TAPS - 1 - k] = sinc * window;
+			sum += sinc * window;
+		}
+		for (int k = 0; k < TRUE_PEAK_TAPS; k++) {
+			lm->tp_coefs[p][k] /= sum; // Unity DC gain per branch
+		}
+	}
+}
+
+// Reset the integrated loudness and the true-peak hold
+void reset_loudness_meter(LoudnessMeter *lm) {
+	if (!lm) return;
+	memset(lm->histogram, 0, sizeof(unsigned int) * LOUDNESS_HISTOGRAM_BINS);
+	memset(lm->histogram_energy, 0, sizeof(double) * LOUDNESS_HISTOGRAM_BINS);
+	lm->histogram_total = 0;
+	memset(lm->tp_peak, 0, sizeof(double) * lm->channels);
+	lm->integrated_lufs = LOUDNESS_FLOOR;
+	lm->true_peak_dbtp = LOUDNESS_FLOOR;
+	for (size_t c = 0; c < lm->channels; c++) {
+		lm->true_peak[c] = LOUDNESS_FLOOR;
+	}
+}
+
+// Bytes taken in an arena by init_loudness_meter
+size_t loudness_meter_arena_size(size_t channels) {
+	return arena_size(sizeof(LoudnessMeter)) +
+		12 * arena_size(sizeof(double) * channels) +
+		arena_size(sizeof(double) * LOUDNESS_SHORT_TERM_BLOCKS * channels) +
+		arena_size(sizeof(double) * 2 * TRUE_PEAK_TAPS * channels) +
+		arena_size(sizeof(unsigned int) * LOUDNESS_HISTOGRAM_BINS) +
+		arena_size(sizeof(double) * LOUDNESS_HISTOGRAM_BINS);
+}
+
+// Initialize a loudness meter for interleaved input, it is released with the arena
+LoudnessMeter* init_loudness_meter(Arena *arena, size_t channels, unsigned int sample_rate) {
+	if (channels == 0 || sample_rate < 8000) {
+		printf("Error: Invalid loudness meter configuration (%zu channels at %u Hz)\n", channels, sample_rate);
+		return NULL;
+	}
+
+	LoudnessMeter *lm = (LoudnessMeter*)arena_alloc(arena, sizeof(LoudnessMeter));
+	if (!lm) return NULL;
+
+	lm->channels = channels;
+	lm->sample_rate = sample_rate;
+	lm->sub_block_size = sample_rate / 10;
+
+	// Per channel state is on separate cache lines, the channel loops run over each row
+	lm->shelf_z1 = (double*)arena_alloc(arena, sizeof(double) * channels);
+	lm->shelf_z2 = (double*)arena_alloc(arena, sizeof(double) * channels);
+	lm->highpass_z1 = (double*)arena_alloc(arena, sizeof(double) * channels);
+	lm->highpass_z2 = (double*)arena_alloc(arena, sizeof(double) * channels);
+	lm->energy = (double*)arena_alloc(arena, sizeof(double) * channels);
+	lm->sub_blocks = (double*)arena_alloc(arena, sizeof(double) * LOUDNESS_SHORT_TERM_BLOCKS * channels);
+	lm->weights = (double*)arena_alloc(arena, sizeof(double) * channels);
+	lm->tp_history = (double*)arena_alloc(arena, sizeof(double) * 2 * TRUE_PEAK_TAPS * channels);
+	lm->tp_peak = (double*)arena_alloc(arena, sizeof(double) * channels);
+	lm->histogram = (unsigned int*)arena_alloc(arena, sizeof(unsigned int) * LOUDNESS_HISTOGRAM_BINS);
+	lm->histogram_energy = (double*)arena_alloc(arena, sizeof(double) * LOUDNESS_HISTOGRAM_BINS);
+	lm->momentary = (double*)arena_alloc(arena, sizeof(double) * channels);
+	lm->short_term = (double*)arena_alloc(arena, sizeof(double) * channels);
+	lm->true_peak = (double*)arena_alloc(arena, sizeof(double) * channels);
+	if (!lm->shelf_z1 || !lm->shelf_z2 || !lm->highpass_z1 || !lm->highpass_z2 || !lm->energy ||
+		!lm->sub_blocks || !lm->weights || !lm->tp_history || !lm->tp_peak || !lm->histogram || !lm->histogram_energy ||
+		!lm->momentary || !lm->short_term || !lm->true_peak) {
+		printf("Error: Failed to allocate memory for loudness meter\n");
+		return NULL;
+	}
+
+	for (size_t c = 0; c < channels; c++) {
+		lm->weights[c] = 1.0;
+		lm->momentary[c] = LOUDNESS_FLOOR;
+		lm->short_term[c] = LOUDNESS_FLOOR;
+	}
+	lm->momentary_lufs = LOUDNESS_FLOOR;
+	lm->short_term_lufs = LOUDNESS_FLOOR;
+
+	_loudness_init_filters(lm);
+	_loudness_init_true_peak(lm);
+	reset_loudness_meter(lm);
+
+	return lm;
+}
+
+// Mean square of the last `blocks` sub-blocks of channel c
+static double _loudness_window(LoudnessMeter *lm, size_t c, size_t blocks) {
+	size_t count = lm->sub_block_count < blocks ? lm->sub_block_count : blocks;
+	if (count == 0) return 0.0;
+	double sum = 0.0;
+	for (size_t i = 1; i <= count; i++) {
+		size_t row = (lm->sub_block_index + LOUDNESS_SHORT_TERM_BLOCKS - i) % LOUDNESS_SHORT_TERM_BLOCKS;
+		sum += lm->sub_blocks[row * lm->channels + c];
+	}
+	// Until the window fills up, average over the full window length like a meter starting from silence
+	return sum / blocks;
+}
+
+static void _loudness_update_integrated(LoudnessMeter *lm) {
+	// Blocks in the histogram already passed the absolute gate
+	double sum = 0.0;
+	for (size_t i = 0; i < LOUDNESS_HISTOGRAM_BINS; i++) {
+		sum += lm->histogram_energy[i];
+	}
+	if (lm->histogram_total == 0) {
+		lm->integrated_lufs = LOUDNESS_FLOOR;
+		return;
+	}
+	double relative_gate = _loudness_to_lufs(sum / lm->histogram_total) + LOUDNESS_RELATIVE_GATE;
+
+	size_t first = 0;
+	if (relative_gate > LOUDNESS_HISTOGRAM_MIN) {
+		first = (size_t)((relative_gate - LOUDNESS_HISTOGRAM_MIN) / LOUDNESS_HISTOGRAM_STEP);
+	}
+	double gated_sum = 0.0;
+	size_t gated_count = 0;
+	for (size_t i = first; i < LOUDNESS_HISTOGRAM_BINS; i++) {
+		gated_sum += lm->histogram_energy[i];
+		gated_count += lm->histogram[i];
+	}
+	lm->integrated_lufs = gated_count > 0 ? _loudness_to_lufs(gated_sum / gated_count) : LOUDNESS_FLOOR;
+}
+
+// Close the current 100ms sub-block and refresh every published value
+static void _loudness_finish_sub_block(LoudnessMeter *lm) {
+	size_t channels = lm->channels;
+	double *row = lm->sub_blocks + lm->sub_block_index * channels;
+	for (size_t c = 0; c < channels; c++) {
+		row[c] = lm->energy[c] / lm->sub_block_size;
+		lm->energy[c] = 0.0;
+	}
+	lm->sub_block_index = (lm->sub_block_index + 1) % LOUDNESS_SHORT_TERM_BLOCKS;
+	if (lm->sub_block_count < LOUDNESS_SHORT_TERM_BLOCKS) lm->sub_block_count++;
+	lm->sub_block_pos = 0;
+
+	double momentary = 0.0, short_term = 0.0, peak = 0.0;
+	for (size_t c = 0; c < channels; c++) {
+		double m = _loudness_window(lm, c, LOUDNESS_MOMENTARY_BLOCKS);
+		double s = _loudness_window(lm, c, LOUDNESS_SHORT_TERM_BLOCKS);
+		lm->momentary[c] = _loudness_to_lufs(m);
+		lm->short_term[c] = _loudness_to_lufs(s);
+		lm->true_peak[c] = _loudness_to_dbtp(lm->tp_peak[c]);
+		momentary += lm->weights[c] * m;
+		short_term += lm->weights[c] * s;
+		if (lm->tp_peak[c] > peak) peak = lm->tp_peak[c];
+	}
+	lm->momentary_lufs = _loudness_to_lufs(momentary);
+	lm->short_term_lufs = _loudness_to_lufs(short_term);
+	lm->true_peak_dbtp = _loudness_to_dbtp(peak);
+
+	// Every sub-block closes a 400ms gating block with 75% overlap
+	if (lm->sub_block_count >= LOUDNESS_MOMENTARY_BLOCKS && lm->momentary_lufs >= LOUDNESS_ABSOLUTE_GATE) {
+		double bin = (lm->momentary_lufs - LOUDNESS_HISTOGRAM_MIN) / LOUDNESS_HISTOGRAM_STEP;
+		size_t index = bin >= LOUDNESS_HISTOGRAM_BINS ? LOUDNESS_HISTOGRAM_BINS - 1 : (size_t)bin;
+		lm->histogram[index]++;
+		lm->histogram_energy[index] += momentary;
+		lm->histogram_total++;
+		_loudness_update_integrated(lm);
+	}
+}
+
+// K-weight and accumulate `frames` interleaved frames, all within one sub-block
+static void _loudness_process_block(LoudnessMeter *lm, const float *restrict in, size_t frames) {
+	size_t channels = lm->channels;
+	const LoudnessBiquad s = lm->shelf;
+	const LoudnessBiquad h = lm->highpass;
+	double *restrict sz1 = lm->shelf_z1;
+	double *restrict sz2 = lm->shelf_z2;
+	double *restrict hz1 = lm->highpass_z1;
+	double *restrict hz2 = lm->highpass_z2;
+	double *restrict energy = lm->energy;
+	double *restrict peak = lm->tp_peak;
+
+	for (size_t t = 0; t < frames; t++) {
+		const float *restrict x = in + t * channels;
+
+		// Push the frame into the doubled true-peak history
+		lm->tp_pos = (lm->tp_pos + 1) % TRUE_PEAK_TAPS;
+		double *restrict newest = lm->tp_history + (lm->tp_pos + TRUE_PEAK_TAPS) * channels;
+		double *restrict mirror = lm->tp_history + lm->tp_pos * channels;
+		const double *restrict window = lm->tp_history + (lm->tp_pos + 1) * channels;
+
+		#pragma omp simd
+		for (size_t c = 0; c < channels; c++) {
+			double v = x[c];
+			newest[c] = v;
+			mirror[c] = v;
+
+			// Transposed direct form II, two cascaded stages
+			double y = s.b0 * v + sz1[c];
+			sz1[c] = s.b1 * v - s.a1 * y + sz2[c];
+			sz2[c] = s.b2 * v - s.a2 * y;
+			double z = h.b0 * y + hz1[c];
+			hz1[c] = h.b1 * y - h.a1 * z + hz2[c];
+			hz2[c] = h.b2 * y - h.a2 * z;
+			energy[c] += z * z;
+		}
+
+		for (int p = 0; p < TRUE_PEAK_OVERSAMPLING; p++) {
+			const double *coefs = lm->tp_coefs[p];
+			#pragma omp simd
+			for (size_t c = 0; c < channels; c++) {
+				double y = 0.0;
+				for (int k = 0; k < TRUE_PEAK_TAPS; k++) {
+					y += coefs[k] * window[k * channels + c];
+				}
+				y = fabs(y);
+				peak[c] = y > peak[c] ? y : peak[c];
+			}
+		}
+	}
+	lm->sub_block_pos += frames;
+}
+
+// Feed interleaved samples from the capture stream
+void process_loudness_meter(LoudnessMeter *lm, const float *in, size_t frames) {
+	if (!lm || !in) return;
+
+	while (frames > 0) {
+		size_t n = lm->sub_block_size - lm->sub_block_pos;
+		if (n > frames) n = frames;
+		_loudness_process_block(lm, in, n);
+		in += n * lm->channels;
+		frames -= n;
+		if (lm->sub_block_pos == lm->sub_block_size) {
+			_loudness_finish_sub_block(lm);
+		}
+	}
+}
+#endif // LOUDNESS_H
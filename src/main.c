@@ -1,6 +1,7 @@
 ////----------------------------------------------------------------------------------
 //// Audio Visualizer
 ////----------------------------------------------------------------------------------
+#define _GNU_SOURCE // Thread affinity in realtime.h
 #include <math.h>
 #include <stdio.h>
 #define GLSL_VERSION 330
@@ -10,6 +11,16 @@
 #include "application.h"
 #include "audio.h"
 #include "audio_analysis.h"
+#include "bar_renderer.h"
+#include "dynamic_resolution.h"
+#include "feature_atlas.h"
+#include "gl_context.h"
+#include "latency_probe.h"
+#include "power.h"
+#include "shader_cache.h"
+#include "snapshot_interpolator.h"
+#include "texture_stream.h"
+#include "video_writer.h"
 #include "raylib.h"
 
 #define RAYGUI_IMPLEMENTATION
@@ -21,35 +32,68 @@
 static const Color background = CLITERAL(Color){0x00, 0x00, 0x00, 0xff};
 static const Color foreground = CLITERAL(Color){0xff, 0xff, 0xff, 0xff};
 
-void render_analysis_time_data(AudioAnalysis *analysis) {
-  // This function can be used to render the time domain data
+// Quality levels of the renderer, stepped through by its QualityGovernor when frames miss the display interval
+typedef enum {
+	RENDER_QUALITY_FULL,
+	RENDER_QUALITY_NO_LABELS, // Bars without their band numbers
+	RENDER_QUALITY_REDUCED,   // One bar per pair of bands, shader inputs uploaded every 4th frame
+	RENDER_QUALITY_COUNT
+} RenderQuality;
+
+static const char *const render_quality_names[RENDER_QUALITY_COUNT] = {"full", "no labels", "reduced"};
+
+// Waveform of the first channel over its last `span` samples, one min/max envelope with the RMS inside it per column.
+// The columns are read into `envelope`, which holds `capacity` of them
+void render_analysis_time_data(AudioAnalysis *analysis, uint64_t span, WaveformColumn *envelope, int capacity, BarRenderer *bars) {
+  if (analysis->waveform == NULL || envelope == NULL || span == 0) {
+	 return;
+  }
   int rw = GetRenderWidth();
   int rh = GetRenderHeight();
-  int fcount = analysis->buffer.size;
+  // One column per pixel, fewer when there are fewer samples or columns
+  int fcount = span < (uint64_t)rw ? (int)span : rw;
+  fcount = fcount < capacity ? fcount : capacity;
+  if (fcount <= 0) {
+	 return;
+  }
   float w = ceil(((float)rw) / (float)fcount);
-
-  double *time_data =
-		analysis->time_data[0]; // Use the first channel for visualization
+  // The pyramid is read in whole columns, however long the span
+  waveform_pyramid_columns(analysis->waveform, 0, span / fcount, envelope, fcount);
+
+  Color peak = ColorAlpha(foreground, 0.4f);
+  float *values = bars != NULL ? bar_renderer_values(bars, 2 * fcount) : NULL;
+  if (values != NULL) {
+	 // Two instanced draws, the peaks and the RMS over them
+	 BarLayout layout = {0, (float)rh / 2, w, (float)rh / 2, 1.0f, 1.0f, BAR_STYLE_RANGE, peak, 0, 0};
+	 for (int i = 0; i < fcount; i++) {
+		values[2 * i] = envelope[i].min;
+		values[2 * i + 1] = envelope[i].max;
+	 }
+	 bar_renderer_draw(bars, values, fcount, &layout);
+	 for (int i = 0; i < fcount; i++) {
+		values[2 * i] = -envelope[i].rms;
+		values[2 * i + 1] = envelope[i].rms;
+	 }
+	 layout.color = foreground;
+	 bar_renderer_draw(bars, values, fcount, &layout);
+	 return;
+  }
 
   for (int i = 0; i < fcount; i++) {
-	 float td = (float)time_data[i];
-	 int td_h = (int)(((float)rh / 2) * td);
-
-	 if (td > 0) {
-		DrawRectangle(i * w, rh - td_h, w, td_h / 5 + 1, foreground);
-	 } else if (td < 0) {
-		td_h = -td_h;
-		DrawRectangle(i * w, rh, w, td_h / 5 + 1, foreground);
-	 }
+	 int top = (int)(rh / 2 - envelope[i].max * rh / 2);
+	 int bottom = (int)(rh / 2 - envelope[i].min * rh / 2);
+	 DrawRectangle(i * w, top, w, bottom - top + 1, peak);
+	 int rms_h = (int)(envelope[i].rms * rh / 2);
+	 DrawRectangle(i * w, rh / 2 - rms_h, w, 2 * rms_h + 1, foreground);
   }
 }
-void render_analysis_freq_data(AudioAnalysis *analysis) {
+void render_analysis_freq_data(AnalysisSnapshot *snapshot, int quality, BarRenderer *bars) {
 	// This function can be used to render the frequency domain data
 	int rw = GetRenderWidth();
 	int rh = GetRenderHeight();
-	int fcount = 125;
+	int fcount = snapshot->num_bins;
 
-	double *pitch = analysis->pitch[0]; // Use the first channel for visualization
+	float *pitch = snapshot->pitch; // Use the first channel for visualization
 
 	//vamos agrupar as frequencias em bins logaritmicos
 	// int log_fcount = ceil(log2(fcount));
@@ -75,10 +119,37 @@ void render_analysis_freq_data(AudioAnalysis *analysis) {
 	// 	// printf("bin %d: start: %d, end: %d, pitch: %f\n", i, bin_start, bin_end, pitch[i]);
 	// }
 
-	// Render the frequency data as bars
+	// Render the frequency data as bars, reduced quality draws the loudest band of each group
+	int group = quality >= RENDER_QUALITY_REDUCED ? 2 : 1;
+	int labels = quality < RENDER_QUALITY_NO_LABELS;
+	w *= group;
+
+	if (bars != NULL) {
+		// One instanced draw for the bars, one per layer for the ticks and the cached labels
+		const float *values = pitch;
+		if (group > 1) {
+			float *merged = bar_renderer_values(bars, fcount / group);
+			if (merged == NULL) return;
+			for (int i = 0; i < fcount / group; i++) {
+				merged[i] = pitch[i * group];
+				for (int k = 1; k < group; k++) {
+					merged[i] = pitch[i * group + k] > merged[i] ? pitch[i * group + k] : merged[i];
+				}
+			}
+			values = merged;
+		}
+		BarLayout layout = {0, (float)rh, w, (float)rh / 2 * 50, 0.2f, 1.0f, BAR_STYLE_BARS,
+			CLITERAL(Color){0x00, 0xff, 0x00, 0xff}, labels, labels};
+		bar_renderer_draw(bars, values, fcount / group, &layout);
+		return;
+	}
 
-	for (int i = 0; i < fcount; i++) {
-		double fd = pitch[i]*50;
+	for (int i = 0; i < fcount / group; i++) {
+		float band = pitch[i * group];
+		for (int k = 1; k < group; k++) {
+			band = pitch[i * group + k] > band ? pitch[i * group + k] : band;
+		}
+		double fd = band*50;
 		int fd_h = (int)(((float)rh / 2) * fd);
 		if (fd > 0) {
 			DrawRectangle(i * w, rh - (fd_h / 5 + 1), w, fd_h / 5 + 1,
@@ -89,7 +160,7 @@ void render_analysis_freq_data(AudioAnalysis *analysis) {
 					  CLITERAL(Color){0x00, 0xff, 0x00, 0xff});
 		}
 		//render a line with ticks for the frequency data
-		if (i % 1 == 0) {
+		if (labels) {
 			DrawLine(i * w, rh - (fd_h / 5 + 1), i * w, rh, CLITERAL(Color){0x00, 0xff, 0x00, 0xff});
 			DrawText(TextFormat("%d", i), i * w + 2, rh - (fd_h / 5 + 1) - 10, 10, CLITERAL(Color){0x00, 0xff, 0x00, 0xff});
 		}
@@ -154,44 +225,281 @@ void render_audio_analysis(AudioAnalysis *analysis) {
   free(freq_bins);
 }
 
-void parse_args(int argc, char **argv, AudioConfig *audio_config, Application *app) {
+// Parse the --realtime spec into the schedule of the analysis thread, -1 if it is invalid
+int parse_realtime(const char *spec, ThreadSchedule *schedule, int *isolate, int *lock_memory) {
+  char copy[256];
+  snprintf(copy, sizeof(copy), "%s", spec);
+  for (char *item = strtok(copy, ","); item != NULL; item = strtok(NULL, ",")) {
+    if (strncmp(item, "fifo", 4) == 0 || strncmp(item, "rr", 2) == 0) {
+      schedule->policy = item[0] == 'f' ? SCHED_FIFO : SCHED_RR;
+      schedule->priority = REALTIME_DEFAULT_PRIORITY;
+      char *priority = strchr(item, ':');
+      if (priority != NULL) {
+        schedule->priority = atoi(priority + 1);
+        if (schedule->priority <= 0) return -1;
+      }
+    } else if (strncmp(item, "cpu=", 4) == 0) {
+      schedule->cpu = atoi(item + 4);
+      if (schedule->cpu < 0) return -1;
+    } else if (strcmp(item, "isolate") == 0) {
+      *isolate = 1;
+    } else if (strcmp(item, "mlock") == 0) {
+      *lock_memory = 1;
+    } else {
+      return -1;
+    }
+  }
+  if (*isolate && schedule->cpu < 0) {
+    schedule->cpu = 0; // Isolation needs the cores the analysis is pinned to
+  }
+  return 0;
+}
 
-  if (argc > 1) {
-    if (strcmp(argv[1], "--help") == 0 || strcmp(argv[1], "-h") == 0) {
+// Wake condition of power_governor_wait
+static int analysis_awake() {
+  return !analysis_idle();
+}
+
+// Level of every tracked frequency of the first channel, in the top right corner
+void render_tones(AnalysisSnapshot *snapshot, const double *frequencies) {
+	const int font_size = 10;
+	const int line_height = 12;
+	const int bar_width = 100;
+	int x = GetScreenWidth() - bar_width - 80;
+	int y = 10;
+	for (size_t k = 0; k < snapshot->num_tones; k++) {
+		float amplitude = snapshot->tones[k];
+		float db = amplitude > 1e-6f ? 20.0f * log10f(amplitude) : -120.0f;
+		float level = (db + 60.0f) / 60.0f; // -60..0 dBFS
+		level = level < 0.0f ? 0.0f : level > 1.0f ? 1.0f : level;
+		DrawText(TextFormat("%7.1f Hz", frequencies[k]), x, y, font_size, foreground);
+		DrawRectangle(x + 60, y, (int)(bar_width * level), line_height - 2, CLITERAL(Color){0x00, 0xff, 0x00, 0xff});
+		y += line_height;
+	}
+}
+
+// Rolling p50/p99 of every profiled stage, toggled with F3
+void render_profiler_overlay() {
+	const int font_size = 10;
+	const int line_height = 12;
+	int x = 10;
+	int y = 10;
+	profile_collect();
+	DrawRectangle(x - 4, y - 4, 220, (PROFILE_STAGE_COUNT + 1) * line_height + 8, CLITERAL(Color){0x00, 0x00, 0x00, 0xb0});
+	DrawText(TextFormat("%-12s %8s %8s", "stage", "p50 ms", "p99 ms"), x, y, font_size, foreground);
+	for (int i = 0; i < PROFILE_STAGE_COUNT; i++) {
+		y += line_height;
+		double p50 = profile_percentile((ProfileStage)i, 0.50);
+		double p99 = profile_percentile((ProfileStage)i, 0.99);
+		if (p50 < 0.0) {
+			DrawText(TextFormat("%-12s %8s %8s", profile_stage_name((ProfileStage)i), "-", "-"), x, y, font_size, GRAY);
+			continue;
+		}
+		DrawText(TextFormat("%-12s %8.3f %8.3f", profile_stage_name((ProfileStage)i), 1000.0 * p50, 1000.0 * p99), x, y, font_size, foreground);
+	}
+}
+
+// Value of an option that takes one, exits when it is missing
+static char *option_value(int argc, char **argv, int *i, const char *what) {
+  if (*i + 1 >= argc) {
+    fprintf(stderr, "Error: No %s provided.\n", what);
+    exit(1);
+  }
+  return argv[++*i];
+}
+
+// Value of an option that may go without one: the next argument, unless it is another option
+static char *optional_value(int argc, char **argv, int *i) {
+  if (*i + 1 >= argc) return NULL;
+  const char *next = argv[*i + 1];
+  if (next[0] == '-' && !(next[1] >= '0' && next[1] <= '9')) return NULL; // Negative numbers are values
+  return argv[++*i];
+}
+
+void parse_args(int argc, char **argv, AudioConfig *audio_config, Application *app) {
+  for (int i = 1; i < argc; i++) {
+    const char *option = argv[i];
+    if (strcmp(option, "--help") == 0 || strcmp(option, "-h") == 0) {
       printf("Usage: %s [options]\n", argv[0]);
       printf("Options:\n");
       printf("  --help, -h       Show this help message\n");
       printf("  --fullscreen, -f Toggle fullscreen mode\n");
       printf("  --file, -f <path> Specify audio file path\n");
+      printf("  --record, -r <path> Record the analysis features to a file\n");
+      printf("  --replay, -p <path> [realtime|step] Draw a recorded feature file instead of capturing audio\n");
+      printf("  --trace, -t <path> Write a Chrome trace of the audio, analysis and render threads on exit\n");
+      printf("  --latency, -l [clicks] Measure capture to screen latency with generated clicks, then exit\n");
+      printf("  --multires, -m <levels> Read the pitch bands from a multi-resolution filterbank\n");
+      printf("  --tones, -n <hz,hz,...> Track the magnitude of a few frequencies on every sample\n");
+      printf("  --realtime, -R [spec] Real-time scheduling of the audio path, spec is a comma separated list of\n");
+      printf("                   fifo[:priority] or rr[:priority], cpu=<core>, isolate and mlock (default fifo,mlock)\n");
+      printf("  --power, -P [gate_db[:seconds]] Throttle when unfocused, or silent under the gate for a while (default -60:30)\n");
+      printf("  --quality, -q <auto|all|fixed> Step render quality down under load, all steps analysis down too (default auto)\n");
+      printf("  --interpolate, -i <on|off> Blend the two newest hops for the time each frame is shown (default on)\n");
+      printf("  --visual, -v     Start with the shader visual shown, F2 toggles it (replays measure it this way)\n");
+      printf("  --waveform, -w [seconds] Draw the waveform of the last seconds under the bars (default 60)\n");
+      printf("  --ring <frames>  Frames the ring buffer holds between the capture and the analysis (default 1200)\n");
+      printf("  --buffer <samples> Samples of the analysis buffer (default twice the screen width)\n");
+      printf("  --fps <n>        Frames drawn per second (default the refresh rate of the display)\n");
+      printf("  --render, -o <audio> <path|-> [WxH] [fps] Render an audio file offscreen to a Y4M video, raw RGBA for .rgba\n");
+      printf("                   or .raw, stdout for -, as fast as it renders, then exit (default 1920x1080 at 60)\n");
+      printf("                   Must be the first option, the others don't apply to it\n");
+      printf("Options combine, e.g. %s --file song.flac --record song.vfs --realtime\n", argv[0]);
+      printf("or %s --latency --ring 512 --buffer 1024 --fps 144 to measure another configuration\n", argv[0]);
       exit(0);
-    } else if (strcmp(argv[1], "--file") == 0 || strcmp(argv[1], "-f") == 0) {
-      if (argc < 3) {
-        fprintf(stderr, "Error: No file path provided.\n");
-        exit(1);
-      }
+    } else if (strcmp(option, "--file") == 0 || strcmp(option, "-f") == 0) {
       audio_config->source_type = AUDIO_SOURCE_TYPE_FILE;
-      audio_config->file_path = argv[2];
+      audio_config->file_path = option_value(argc, argv, &i, "file path");
       printf("Using audio file: %s\n", audio_config->file_path);
-    } else if (strcmp(argv[1], "--fullscreen") == 0 || strcmp(argv[1], "-f") == 0) {
-      if (argv[2] != NULL &&
-          (strcmp(argv[2], "true") == 0 || strcmp(argv[2], "1") == 0)) {
+    } else if (strcmp(option, "--record") == 0 || strcmp(option, "-r") == 0) {
+      app->record_path = option_value(argc, argv, &i, "record path");
+    } else if (strcmp(option, "--replay") == 0 || strcmp(option, "-p") == 0) {
+      app->replay_path = option_value(argc, argv, &i, "replay path");
+      char *mode = optional_value(argc, argv, &i);
+      if (mode != NULL && strcmp(mode, "step") == 0) {
+        app->replay_step = 1;
+      } else if (mode != NULL && strcmp(mode, "realtime") != 0) {
+        fprintf(stderr, "Error: Invalid argument for --replay option.\n");
+        exit(1);
+      }
+    } else if (strcmp(option, "--trace") == 0 || strcmp(option, "-t") == 0) {
+      app->trace_path = option_value(argc, argv, &i, "trace path");
+    } else if (strcmp(option, "--latency") == 0 || strcmp(option, "-l") == 0) {
+      app->latency_clicks = 50;
+      char *clicks = optional_value(argc, argv, &i);
+      if (clicks != NULL) {
+        app->latency_clicks = strtoul(clicks, NULL, 10);
+        if (app->latency_clicks == 0) {
+          fprintf(stderr, "Error: Invalid argument for --latency option.\n");
+          exit(1);
+        }
+      }
+      audio_config->source_type = AUDIO_SOURCE_TYPE_GENERATOR;
+    } else if (strcmp(option, "--multires") == 0 || strcmp(option, "-m") == 0) {
+      app->multires_levels = strtoul(option_value(argc, argv, &i, "level count"), NULL, 10);
+      if (app->multires_levels == 0 || app->multires_levels > MULTIRES_MAX_LEVELS) {
+        fprintf(stderr, "Error: Invalid argument for --multires option.\n");
+        exit(1);
+      }
+    } else if (strcmp(option, "--tones") == 0 || strcmp(option, "-n") == 0) {
+      char *cursor = option_value(argc, argv, &i, "tone frequencies");
+      if (app->tone_frequencies == NULL) {
+        app->tone_frequencies = (double *)malloc(sizeof(double) * TONE_TRACKER_MAX_TARGETS);
+        if (app->tone_frequencies == NULL) {
+          fprintf(stderr, "Error: Failed to allocate memory for tone frequencies.\n");
+          exit(1);
+        }
+      }
+      app->tone_count = 0; // The last --tones wins
+      while (*cursor != '\0') {
+        char *end;
+        double frequency = strtod(cursor, &end);
+        if (end == cursor || frequency <= 0.0 || app->tone_count == TONE_TRACKER_MAX_TARGETS ||
+            (*end != ',' && *end != '\0')) {
+          fprintf(stderr, "Error: Invalid argument for --tones option.\n");
+          exit(1);
+        }
+        app->tone_frequencies[app->tone_count++] = frequency;
+        cursor = *end == ',' ? end + 1 : end;
+      }
+    } else if (strcmp(option, "--realtime") == 0 || strcmp(option, "-R") == 0) {
+      char *spec = optional_value(argc, argv, &i);
+      app->realtime = spec != NULL ? spec : "fifo,mlock";
+    } else if (strcmp(option, "--power") == 0 || strcmp(option, "-P") == 0) {
+      app->power_save = 1;
+      char *gate = optional_value(argc, argv, &i);
+      if (gate != NULL) {
+        char *end;
+        app->silence_gate_db = strtof(gate, &end);
+        if (end == gate || app->silence_gate_db >= 0.0f) {
+          fprintf(stderr, "Error: Invalid argument for --power option.\n");
+          exit(1);
+        }
+        if (*end == ':') {
+          app->silence_timeout = strtod(end + 1, NULL);
+          if (app->silence_timeout <= 0.0) {
+            fprintf(stderr, "Error: Invalid argument for --power option.\n");
+            exit(1);
+          }
+        }
+      }
+    } else if (strcmp(option, "--quality") == 0 || strcmp(option, "-q") == 0) {
+      char *mode = i + 1 < argc ? argv[++i] : NULL;
+      if (mode != NULL && strcmp(mode, "auto") == 0) {
+        app->adaptive_quality = 1;
+        app->adaptive_analysis = 0;
+      } else if (mode != NULL && strcmp(mode, "all") == 0) {
+        app->adaptive_quality = 1;
+        app->adaptive_analysis = 1;
+      } else if (mode != NULL && strcmp(mode, "fixed") == 0) {
+        app->adaptive_quality = 0;
+        app->adaptive_analysis = 0;
+      } else {
+        fprintf(stderr, "Error: Invalid argument for --quality option.\n");
+        exit(1);
+      }
+    } else if (strcmp(option, "--interpolate") == 0 || strcmp(option, "-i") == 0) {
+      char *mode = i + 1 < argc ? argv[++i] : NULL;
+      if (mode != NULL && strcmp(mode, "on") == 0) {
+        app->interpolate = 1;
+      } else if (mode != NULL && strcmp(mode, "off") == 0) {
+        app->interpolate = 0;
+      } else {
+        fprintf(stderr, "Error: Invalid argument for --interpolate option.\n");
+        exit(1);
+      }
+    } else if (strcmp(option, "--visual") == 0 || strcmp(option, "-v") == 0) {
+      app->show_visual = 1;
+    } else if (strcmp(option, "--waveform") == 0 || strcmp(option, "-w") == 0) {
+      app->waveform_seconds = WAVEFORM_PYRAMID_DEFAULT_SECONDS;
+      char *seconds = optional_value(argc, argv, &i);
+      if (seconds != NULL) {
+        app->waveform_seconds = strtod(seconds, NULL);
+        if (app->waveform_seconds <= 0.0) {
+          fprintf(stderr, "Error: Invalid argument for --waveform option.\n");
+          exit(1);
+        }
+      }
+    } else if (strcmp(option, "--ring") == 0) {
+      audio_config->ring_size = strtoul(option_value(argc, argv, &i, "ring size"), NULL, 10);
+      if (audio_config->ring_size == 0) {
+        fprintf(stderr, "Error: Invalid argument for --ring option.\n");
+        exit(1);
+      }
+    } else if (strcmp(option, "--buffer") == 0) {
+      app->buffer_size = strtoul(option_value(argc, argv, &i, "buffer size"), NULL, 10);
+      if (app->buffer_size < 2) {
+        fprintf(stderr, "Error: Invalid argument for --buffer option.\n");
+        exit(1);
+      }
+    } else if (strcmp(option, "--fps") == 0) {
+      app->fps = atoi(option_value(argc, argv, &i, "frame rate"));
+      if (app->fps <= 0) {
+        fprintf(stderr, "Error: Invalid argument for --fps option.\n");
+        exit(1);
+      }
+    } else if (strcmp(option, "--fullscreen") == 0 || strcmp(option, "-f") == 0) {
+      char *value = optional_value(argc, argv, &i);
+      if (value != NULL &&
+          (strcmp(value, "true") == 0 || strcmp(value, "1") == 0)) {
         app->fullscreen = true;
         printf("Fullscreen mode enabled.\n");
-      } else if (argv[2] != NULL &&
-                 (strcmp(argv[2], "false") == 0 || strcmp(argv[2], "0") == 0)) {
+      } else if (value != NULL &&
+                 (strcmp(value, "false") == 0 || strcmp(value, "0") == 0)) {
         app->fullscreen = false;
         printf("Fullscreen mode disabled.\n");
-      } else if (argc > 2) {
+      } else if (value != NULL) {
         fprintf(stderr, "Error: Invalid argument for --fullscreen option.\n");
         exit(1);
+      } else {
+        app->fullscreen = true;
+        printf("Fullscreen mode enabled.\n");
       }
-      app->fullscreen = true;
-      printf("Fullscreen mode enabled.\n");
     } else {
-      fprintf(stderr, "Error: Unknown option '%s'.\n", argv[1]);
+      fprintf(stderr, "Error: Unknown option '%s'.\n", option);
       exit(1);
-		}
-	}
+    }
+  }
 }
 void GenerateExampleMonoAudio(double *monoData, int numSamples) {
   float frequency1 = 440.0f;  // A4 note for left channel
@@ -203,35 +511,302 @@ void GenerateExampleMonoAudio(double *monoData, int numSamples) {
 
   }
 }
-Texture2D CreateWaveformTexture(double *monoData, int numSamples) {
-
-	float *textureData = (float *)calloc(numSamples, sizeof(float));
-	for (int i = 0; i < numSamples; i++) {
-		textureData[i] = (float)monoData[i];
+TextureStream CreateWaveformTexture(const float *samples, int numSamples) {
+	// The snapshot converted the samples to floats already
+	return create_texture_stream(numSamples, 1, samples);
+}
+void UpdateWaveformTexture(TextureStream *texture, const float *samples, int numSamples) {
+	if (texture->texture.id == 0 || texture->texture.width != numSamples) {
+		destroy_texture_stream(texture);
+		*texture = CreateWaveformTexture(samples, numSamples);
+	} else {
+		texture_stream_update(texture, 0, 0, numSamples, 1, samples);
 	}
-
-	unsigned int textureId = rlLoadTexture(monoData, numSamples, 1, RL_PIXELFORMAT_UNCOMPRESSED_R32, 1);
-	Texture2D waveformTexture = {0};
-	waveformTexture.id = textureId;
-	waveformTexture.width = numSamples;
-	waveformTexture.height = 1;
-	waveformTexture.mipmaps = 1;
-	waveformTexture.format = RL_PIXELFORMAT_UNCOMPRESSED_R32;
-
-	free(textureData);
-	return waveformTexture;
 }
-void UpdateWaveformTexture(Texture2D *texture, double *monoData, int numSamples) {
-	if (texture->id == 0 || texture->width != numSamples) {
-		UnloadTexture(*texture);
-		*texture = CreateWaveformTexture(monoData, numSamples);
+TextureStream CreateBandsTexture(const float *bands, int numBands) {
+	// Bands are floats already, uploaded as they are
+	return create_texture_stream(numBands, 1, bands);
+}
+void UpdateBandsTexture(TextureStream *texture, const float *bands, int numBands) {
+	if (texture->texture.id == 0 || texture->texture.width != numBands) {
+		destroy_texture_stream(texture);
+		*texture = CreateBandsTexture(bands, numBands);
 	} else {
-		float *textureData = (float *)calloc(numSamples, sizeof(float));
-		for (int i = 0; i < numSamples; i++) {
-			textureData[i] = (float)monoData[i];
+		texture_stream_update(texture, 0, 0, numBands, 1, bands);
+	}
+}
+// Uniform locations of the visualizer shader, -1 for the inputs it doesn't read
+typedef struct {
+	int time, signal, resolution;
+	int audio_channel_0, audio_channel_1, spectrum_channel_0, spectrum_channel_1;
+	int stereo, stereo_summary, loudness, spectrogram, spectrogram_row;
+	int features;
+} ShaderInputs;
+
+ShaderInputs GetShaderInputs(Shader shader) {
+	ShaderInputs inputs;
+	inputs.time = GetShaderLocation(shader, "u_time");
+	inputs.signal = GetShaderLocation(shader, "u_signal");
+	inputs.resolution = GetShaderLocation(shader, "u_resolution");
+	inputs.audio_channel_0 = GetShaderLocation(shader, "u_audio_channel_0");
+	inputs.audio_channel_1 = GetShaderLocation(shader, "u_audio_channel_1");
+	inputs.spectrum_channel_0 = GetShaderLocation(shader, "u_spectrum_channel_0");
+	inputs.spectrum_channel_1 = GetShaderLocation(shader, "u_spectrum_channel_1");
+	inputs.stereo = GetShaderLocation(shader, "u_stereo");
+	inputs.stereo_summary = GetShaderLocation(shader, "u_stereo_summary");
+	inputs.loudness = GetShaderLocation(shader, "u_loudness");
+	inputs.spectrogram = GetShaderLocation(shader, "u_spectrogram");
+	inputs.spectrogram_row = GetShaderLocation(shader, "u_spectrogram_row");
+	inputs.features = GetShaderLocation(shader, "u_features");
+	return inputs;
+}
+// The separate textures are only streamed to shaders that still read them
+int ShaderReadsTextures(const ShaderInputs *inputs) {
+	return inputs->audio_channel_0 >= 0 || inputs->audio_channel_1 >= 0 || inputs->spectrum_channel_0 >= 0 ||
+		inputs->spectrum_channel_1 >= 0 || inputs->stereo >= 0 || inputs->spectrogram >= 0;
+}
+// Point the samplers of a newly loaded shader at the analysis textures, and its uniform block at the atlas
+void BindShaderTextures(Shader shader, const ShaderInputs *inputs, Texture2D audio_channel_0, Texture2D audio_channel_1,
+		Texture2D spectrum_channel_0, Texture2D spectrum_channel_1, Texture2D stereo, Texture2D spectrogram, FeatureAtlas *atlas) {
+	SetShaderValueTexture(shader, inputs->audio_channel_0, audio_channel_0);
+	SetShaderValueTexture(shader, inputs->audio_channel_1, audio_channel_1);
+	SetShaderValueTexture(shader, inputs->spectrum_channel_0, spectrum_channel_0);
+	SetShaderValueTexture(shader, inputs->spectrum_channel_1, spectrum_channel_1);
+	SetShaderValueTexture(shader, inputs->stereo, stereo);
+	SetShaderValueTexture(shader, inputs->spectrogram, spectrogram);
+	if (atlas != NULL && inputs->features >= 0) {
+		feature_atlas_attach(atlas, shader);
+		SetShaderValueTexture(shader, inputs->features, atlas->texture.texture);
+	}
+}
+unsigned int ShaderAnalysisOutputs(Shader shader) {
+	// The GLSL compiler drops unused uniforms, so a location of -1 means the shader never reads it
+	unsigned int outputs = 0;
+	if (GetShaderLocation(shader, "u_audio_channel_0") >= 0 || GetShaderLocation(shader, "u_audio_channel_1") >= 0) {
+		outputs |= ANALYSIS_TIME_DATA;
+	}
+	if (GetShaderLocation(shader, "u_spectrum_channel_0") >= 0 || GetShaderLocation(shader, "u_spectrum_channel_1") >= 0) {
+		outputs |= ANALYSIS_PITCH;
+	}
+	if (GetShaderLocation(shader, "u_signal") >= 0) {
+		outputs |= ANALYSIS_NORM_AVG;
+	}
+	if (GetShaderLocation(shader, "u_stereo") >= 0 || GetShaderLocation(shader, "u_stereo_summary") >= 0) {
+		outputs |= ANALYSIS_STEREO;
+	}
+	if (GetShaderLocation(shader, "u_loudness") >= 0) {
+		outputs |= ANALYSIS_LOUDNESS;
+	}
+	if (GetShaderLocation(shader, "u_spectrogram") >= 0) {
+		outputs |= ANALYSIS_SPECTROGRAM;
+	}
+	if (GetShaderLocation(shader, "u_features") >= 0) {
+		// Everything the feature atlas and its uniform block carry
+		outputs |= ANALYSIS_TIME_DATA | ANALYSIS_PITCH | ANALYSIS_NORM_AVG | ANALYSIS_STEREO | ANALYSIS_LOUDNESS | ANALYSIS_SPECTROGRAM | ANALYSIS_TONES;
+	}
+	return outputs;
+}
+TextureStream CreateStereoTexture(StereoAnalysis *stereo) {
+	// One row per StereoField, one column per pitch bin
+	if (stereo == NULL) {
+		return create_texture_stream(0, 0, NULL); // Mono input, shaders get an unbound sampler
+	}
+	return create_texture_stream(stereo->num_bins, STEREO_FIELD_COUNT, stereo->bands);
+}
+void UpdateStereoTexture(TextureStream *texture, StereoAnalysis *stereo) {
+	if (stereo == NULL || texture->texture.id == 0) {
+		return;
+	}
+	// The bands are already floats, no conversion needed
+	texture_stream_update(texture, 0, 0, stereo->num_bins, STEREO_FIELD_COUNT, stereo->bands);
+}
+TextureStream CreateSpectrogramTexture(Spectrogram *spectrogram) {
+	// One column per pitch bin, `rows` lines per channel stacked vertically, used as a circular buffer
+	if (spectrogram == NULL) {
+		return create_texture_stream(0, 0, NULL);
+	}
+	return create_texture_stream(spectrogram->num_bins, spectrogram->channels * spectrogram->rows, spectrogram->data);
+}
+void UpdateSpectrogramTexture(TextureStream *texture, Spectrogram *spectrogram, unsigned long *uploaded) {
+	if (spectrogram == NULL) {
+		return;
+	}
+	if (texture->texture.id == 0 || texture->texture.width != (int)spectrogram->num_bins || texture->texture.height != (int)(spectrogram->channels * spectrogram->rows)) {
+		// The analysis was restarted with another layout
+		destroy_texture_stream(texture);
+		*texture = CreateSpectrogramTexture(spectrogram);
+		*uploaded = spectrogram_written(spectrogram);
+		return;
+	}
+	unsigned long written = spectrogram_written(spectrogram);
+	if (written < *uploaded) {
+		*uploaded = 0; // Restarted with the same layout
+	}
+	// Only the rows added since the last frame are uploaded, the whole ring if we fell behind
+	unsigned long count = written - *uploaded;
+	if (count > spectrogram->rows) {
+		count = spectrogram->rows;
+	}
+	size_t first = (written - count) % spectrogram->rows;
+	while (count > 0) {
+		// At most two spans, split where the ring wraps around
+		size_t span = spectrogram->rows - first < count ? spectrogram->rows - first : count;
+		for (size_t c = 0; c < spectrogram->channels; c++) {
+			texture_stream_update(texture, 0, c * spectrogram->rows + first, spectrogram->num_bins, span,
+				spectrogram_row(spectrogram, c, first));
+		}
+		count -= span;
+		first = 0;
+	}
+	*uploaded = written;
+}
+
+// Render an audio file to a video without a window or a display: --render <audio> <path|-> [WxH] [fps].
+// Time comes from the file, frame k shows the analysis of the audio up to k / fps
+// seconds, so the output only depends on the input and runs as fast as the GPU
+// renders; frames are read back a few frames late through pixel buffers.
+int RenderVideo(int argc, char **argv) {
+	if (argc < 4) {
+		fprintf(stderr, "Error: --render needs an audio file and an output path.\n");
+		return 1;
+	}
+	const char *audio_path = argv[2];
+	int width = 1920, height = 1080, fps = 60;
+	if (argc > 4 && (sscanf(argv[4], "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0)) {
+		fprintf(stderr, "Error: Invalid size for --render option.\n");
+		return 1;
+	}
+	if (argc > 5 && (fps = atoi(argv[5])) <= 0) {
+		fprintf(stderr, "Error: Invalid frame rate for --render option.\n");
+		return 1;
+	}
+	// First, a stream on stdout moves the prints below to stderr
+	VideoWriter *writer = create_video_writer(argv[3], width, height, fps);
+	if (writer == NULL) {
+		return 1;
+	}
+	// Decoded at the rate and channels of the file
+	ma_decoder decoder;
+	ma_decoder_config decoder_config = ma_decoder_config_init(ma_format_f32, 0, 0);
+	if (ma_decoder_init_file(audio_path, &decoder_config, &decoder) != MA_SUCCESS) {
+		printf("Error: Failed to open %s\n", audio_path);
+		destroy_video_writer(writer);
+		return 1;
+	}
+	size_t channels = decoder.outputChannels;
+	ma_uint32 sample_rate = decoder.outputSampleRate;
+
+	// No window, it runs without a display
+	if (create_headless_context(width, height) != 0) {
+		ma_decoder_uninit(&decoder);
+		destroy_video_writer(writer);
+		return 1;
+	}
+	profile_thread_name("render");
+
+	// Run on this thread, one hop per chunk of decoded audio
+	AudioAnalysisConfig analysis_config = init_audio_analysis_config();
+	analysis_config.buffer_size = width * 2;
+	analysis_config.channels = channels;
+	analysis_config.sample_rate = sample_rate;
+	analysis_config.adaptive_quality = 0; // Every frame at full quality, however long it takes
+	if (create_analysis(&analysis_config) != 0) {
+		ma_decoder_uninit(&decoder);
+		destroy_video_writer(writer);
+		destroy_headless_context();
+		return 1;
+	}
+	AnalysisSnapshot *snapshot = init_analysis_snapshot(channels, g_audio_analysis->num_bins, 0, g_audio_analysis->buffer.size);
+	Shader shader = load_cached_shader(NULL, "resources/shaders/ray.fs.glsl");
+	ShaderInputs inputs = GetShaderInputs(shader);
+	// Shaders reading the separate textures get them unbound, the atlas carries every input
+	size_t history = g_audio_analysis->spectrogram != NULL ? g_audio_analysis->spectrogram->rows : 0;
+	FeatureAtlas *atlas = inputs.features >= 0 ? create_feature_atlas(channels, snapshot->num_samples, snapshot->num_bins, 0, history) : NULL;
+	Texture2D blank = {0};
+	BindShaderTextures(shader, &inputs, blank, blank, blank, blank, blank, blank, atlas);
+	analysis_subscribe(ANALYSIS_CONSUMER_RENDERER, ANALYSIS_PITCH | ShaderAnalysisOutputs(shader));
+	BarRenderer *bars = create_bar_renderer((int)snapshot->num_bins);
+	Image image = GenImageColor(width, height, BLANK);
+	Texture2D texture = LoadTextureFromImage(image);
+	UnloadImage(image);
+	RenderTexture2D target = LoadRenderTexture(width, height);
+	PixelReadback readback = create_pixel_readback(width, height);
+	float resolution[2] = {(float)width, (float)height};
+
+	size_t chunk = g_audio_analysis->buffer.size / channels; // Frames filling the analysis buffer
+	SAMPLE_TYPE *samples = (SAMPLE_TYPE *)malloc(sizeof(SAMPLE_TYPE) * chunk * channels);
+	uint64_t decoded = 0;
+	int failed = samples == NULL || target.id == 0 || snapshot == NULL;
+	uint64_t start = profile_now();
+	for (unsigned long k = 0; !failed; k++) {
+		// The audio up to the time of this frame, the first one is drawn from silence
+		uint64_t until = (uint64_t)k * sample_rate / fps;
+		int ended = 0;
+		while (decoded < until) {
+			ma_uint64 frames = until - decoded < chunk ? until - decoded : chunk;
+			ma_uint64 read = 0;
+			ma_decoder_read_pcm_frames(&decoder, samples, frames, &read);
+			if (read == 0) {
+				ended = 1;
+				break;
+			}
+			analysis_process_hop(samples, (ma_uint32)read);
+			decoded += read;
 		}
-		rlUpdateTexture(texture->id,0,0,numSamples,1,RL_PIXELFORMAT_UNCOMPRESSED_R32, textureData);
+		if (ended) break;
+		analysis_snapshot_capture(snapshot);
+		float time = (float)k / fps;
+		if (atlas != NULL) {
+			feature_atlas_update(atlas, snapshot, g_audio_analysis->stereo, g_audio_analysis->spectrogram, time, resolution[0], resolution[1]);
+		}
+		bar_renderer_prepare(bars);
+		BeginTextureMode(target);
+			ClearBackground(BLACK);
+			BeginShaderMode(shader);
+				SetShaderValue(shader, inputs.time, &time, SHADER_UNIFORM_FLOAT);
+				SetShaderValue(shader, inputs.signal, &snapshot->norm_avg[0], SHADER_UNIFORM_FLOAT);
+				SetShaderValue(shader, inputs.resolution, &resolution, SHADER_UNIFORM_VEC2);
+				SetShaderValue(shader, inputs.stereo_summary, snapshot->stereo, SHADER_UNIFORM_VEC4);
+				SetShaderValue(shader, inputs.loudness, snapshot->loudness, SHADER_UNIFORM_VEC4);
+				DrawTextureRec(texture, (Rectangle){0, 0, (float)width, -(float)height}, (Vector2){0, 0}, WHITE);
+			EndShaderMode();
+			render_analysis_freq_data(snapshot, RENDER_QUALITY_FULL, bars);
+			// Write the oldest frame before its buffer is read into again
+			if (pixel_readback_full(&readback)) {
+				const unsigned char *pixels = pixel_readback_map(&readback);
+				if (pixels != NULL) {
+					failed = video_writer_frame(writer, pixels, readback.bottom_up) != 0;
+					pixel_readback_unmap(&readback);
+				}
+			}
+			pixel_readback_start(&readback);
+		EndTextureMode();
 	}
+	// The frames still in flight
+	while (!failed && readback.pending > 0) {
+		const unsigned char *pixels = pixel_readback_map(&readback);
+		if (pixels != NULL) {
+			failed = video_writer_frame(writer, pixels, readback.bottom_up) != 0;
+			pixel_readback_unmap(&readback);
+		}
+	}
+	double seconds = (profile_now() - start) * 1e-9;
+	printf("Rendered %lu frames of %.1f s of audio in %.1f s, %.1f fps\n", writer->frames, (double)decoded / sample_rate,
+		seconds, seconds > 0.0 ? writer->frames / seconds : 0.0);
+
+	destroy_pixel_readback(&readback);
+	UnloadRenderTexture(target);
+	UnloadTexture(texture);
+	destroy_bar_renderer(bars);
+	destroy_feature_atlas(atlas);
+	UnloadShader(shader);
+	free(samples);
+	free_analysis_snapshot(snapshot);
+	destroy_analysis();
+	ma_decoder_uninit(&decoder);
+	destroy_video_writer(writer);
+	destroy_headless_context();
+	return failed ? 1 : 0;
 }
 
 //------------------------------------------------------------------------------------
@@ -239,6 +814,11 @@ void UpdateWaveformTexture(Texture2D *texture, double *monoData, int numSamples)
 //------------------------------------------------------------------------------------
 int main(int argc, char **argv) {
 
+	if (argc > 1 && (strcmp(argv[1], "--render") == 0 || strcmp(argv[1], "-o") == 0)) {
+		// Offline, without the audio device or a visible window
+		return RenderVideo(argc, argv);
+	}
+
 	Application *app = init_application();
 
 	InitWindow(0, 0, "Vizualizer");
@@ -247,7 +827,9 @@ int main(int argc, char **argv) {
 	int screenWidth = GetMonitorWidth(display);
 	int screenHeight = GetMonitorHeight(display);
 	SetWindowSize(screenWidth, screenHeight);
-	SetTargetFPS(60); 
+	// Frames are drawn at the refresh rate of the display, the hops in between are interpolated
+	int target_fps = GetMonitorRefreshRate(display) > 0 ? GetMonitorRefreshRate(display) : 60;
+	SetTargetFPS(target_fps); 
 	GuiLoadStyleDark();
 	ToggleFullscreen();
 	screenWidth = GetMonitorWidth(display);
@@ -261,13 +843,84 @@ int main(int argc, char **argv) {
 	AudioConfig audio_config = init_audio_config();
 
 	parse_args(argc, argv, &audio_config, app);
+	profile_thread_name("render");
+	if (app->trace_path != NULL && profile_trace_open(app->trace_path) != 0) {
+		return 1;
+	}
 
-	audio_config.buffer_size = screenWidth*2;
+	audio_config.buffer_size = app->buffer_size > 0 ? app->buffer_size : screenWidth*2;
+	if (app->fps > 0) {
+		target_fps = app->fps;
+		SetTargetFPS(target_fps);
+	}
 
-	init_audio(&audio_config);
-	start_analysis(&(AudioAnalysisConfig){
-		.buffer_size = audio_config.buffer_size,
-		.channels = audio_config.capture_channels});
+	AudioAnalysisConfig analysis_config = init_audio_analysis_config();
+	if (app->realtime != NULL) {
+		int isolate = 0;
+		if (parse_realtime(app->realtime, &analysis_config.schedule, &isolate, &analysis_config.lock_memory) != 0) {
+			fprintf(stderr, "Error: Invalid argument for --realtime option.\n");
+			return 1;
+		}
+		// Capture outranks the analysis, an overloaded analysis then drops hops instead of captured frames
+		audio_config.schedule.policy = analysis_config.schedule.policy;
+		audio_config.schedule.priority = analysis_config.schedule.priority + 5;
+		if (isolate) {
+			// Before the audio threads are spawned, they inherit the reduced affinity of this one
+			analysis_config.channels = audio_config.capture_channels;
+			realtime_isolate_cpus(analysis_config.schedule.cpu, 1 + analysis_worker_count(&analysis_config));
+		}
+	}
+	FeatureStream *replay = NULL;
+	LatencyProbe *latency_probe = NULL;
+	AnalysisSnapshot *snapshot = NULL;
+	SnapshotInterpolator *interpolator = NULL; // Live hops only, replays draw their records as they are
+	if (app->replay_path != NULL) {
+		// Replay: the recorded hops drive the visuals, no audio is captured or analysed
+		replay = feature_stream_open(app->replay_path);
+		if (replay == NULL) {
+			return 1;
+		}
+		printf("Replaying %zu recorded hops from %s%s\n", replay->record_count, app->replay_path, app->replay_step ? ", one per frame" : "");
+		snapshot = init_analysis_snapshot(replay->header->channels, replay->header->num_bins, 0, replay->header->waveform_samples);
+		if (app->replay_step) {
+			target_fps = 0;
+			SetTargetFPS(target_fps); // Render as fast as possible, frame times then measure the render cost alone
+		}
+	} else {
+		init_audio(&audio_config);
+		analysis_config.buffer_size = audio_config.buffer_size;
+		analysis_config.channels = audio_config.capture_channels;
+		analysis_config.sample_rate = audio_config.sample_rate;
+		analysis_config.record_path = app->record_path;
+		analysis_config.multires_levels = app->multires_levels;
+		analysis_config.tone_frequencies = app->tone_frequencies;
+		analysis_config.tone_count = app->tone_count;
+		analysis_config.adaptive_quality = app->adaptive_analysis;
+		analysis_config.waveform_seconds = app->waveform_seconds;
+		if (app->power_save) {
+			analysis_config.silence_gate = powf(10.0f, app->silence_gate_db / 20.0f);
+			analysis_config.silence_timeout = app->silence_timeout;
+		}
+		start_analysis(&analysis_config);
+		snapshot = init_analysis_snapshot(analysis_config.channels, g_audio_analysis->num_bins,
+			g_audio_analysis->tones != NULL ? g_audio_analysis->tones->targets : 0, g_audio_analysis->buffer.size);
+		if (app->latency_clicks > 0) {
+			latency_probe = latency_probe_start(&audio_config, LATENCY_PROBE_DEFAULT_PERIOD, app->latency_clicks);
+			if (latency_probe == NULL) {
+				return 1;
+			}
+		}
+		if (app->interpolate && latency_probe == NULL && snapshot != NULL) {
+			// The probe times the first frame showing a click, blending would spread it over two hops
+			interpolator = create_snapshot_interpolator(snapshot);
+			audio_capture_timing(interpolator != NULL); // Hops are placed by the time they were captured
+		}
+	}
+	size_t replay_record = 0;     // Record drawn by the current frame
+	double replay_start = GetTime();
+	double frame_time_total = 0.0; // Frame time statistics of a replay
+	double frame_time_worst = 0.0;
+	size_t frame_count = 0;
 
 	//--------------------------------------------------------------------------------------
 	// Graphics Initialization
@@ -279,28 +932,69 @@ int main(int argc, char **argv) {
 
 	Texture2D texture = LoadTextureFromImage(imBlank);
 	UnloadImage(imBlank);
-
-	Texture audio_channel_0 	= CreateWaveformTexture( g_audio_analysis->time_data[0], g_audio_analysis->buffer.size);
-	Texture audio_channel_1 	= CreateWaveformTexture( g_audio_analysis->time_data[1], g_audio_analysis->buffer.size);
-	Texture spectrum_channel_0 = CreateWaveformTexture( g_audio_analysis->pitch[0], 125);
-	Texture spectrum_channel_1 = CreateWaveformTexture( g_audio_analysis->pitch[1], 125);
-	Shader shader = LoadShader(0, "resources/shaders/ray.fs.glsl");
+	// The shader visual renders offscreen, at the share of the screen its frame-time budget allows
+	DynamicResolution *visual_target = create_dynamic_resolution(screenWidth, screenHeight, app->adaptive_quality && target_fps > 0);
+
+	// The last channel stands in for the second one with mono input
+	size_t second_channel = snapshot->channels > 1 ? 1 : 0;
+	// Stereo bands and the spectrogram are not recorded, replays leave them unbound, and the
+	// waveform too when the recording has none
+	TextureStream audio_channel_0 = create_texture_stream(0, 0, NULL);
+	TextureStream audio_channel_1 = create_texture_stream(0, 0, NULL);
+	TextureStream stereo_bands = create_texture_stream(0, 0, NULL);
+	TextureStream spectrogram = create_texture_stream(0, 0, NULL);
+	if (snapshot->num_samples > 0) {
+		audio_channel_0 = CreateWaveformTexture(snapshot->time_data, snapshot->num_samples);
+		audio_channel_1 = CreateWaveformTexture(snapshot->time_data + second_channel * snapshot->num_samples, snapshot->num_samples);
+	}
+	if (replay == NULL) {
+		stereo_bands = CreateStereoTexture(g_audio_analysis->stereo);
+		spectrogram = CreateSpectrogramTexture(g_audio_analysis->spectrogram);
+	}
+	TextureStream spectrum_channel_0 = CreateBandsTexture(snapshot->pitch, snapshot->num_bins);
+	TextureStream spectrum_channel_1 = CreateBandsTexture(snapshot->pitch + second_channel * snapshot->num_bins, snapshot->num_bins);
+	unsigned long spectrogram_uploaded = 0; // Spectrogram rows already on the GPU
+	int spectrogram_cursor[2] = {0, (int)analysis_config.spectrogram_rows}; // newest row, rows per channel
+	float stereo_summary[4] = {0}; // correlation, balance, delay (samples), delay confidence
+	float loudness[4] = {LOUDNESS_FLOOR, LOUDNESS_FLOOR, LOUDNESS_FLOOR, LOUDNESS_FLOOR}; // momentary, short-term, integrated (LUFS), true-peak (dBTP)
+	// Loaded from the shader cache when it was built before, edits are swapped in once they link
+	ShaderProgram *shader_program = create_shader_program(NULL, "resources/shaders/ray.fs.glsl");
+	Shader shader = shader_program != NULL ? shader_program->shader : LoadShader(0, "resources/shaders/ray.fs.glsl");
+	BarRenderer *bars = create_bar_renderer((int)snapshot->num_bins); // NULL falls back to drawing bars one by one
 
 	float time = 0.0f;
-	int timeLoc = GetShaderLocation(shader, "u_time");
-	int signalLoc = GetShaderLocation(shader, "u_signal");
-	int resolutionLoc = GetShaderLocation(shader, "u_resolution");
-	int audio_channel_0_loc = GetShaderLocation(shader, "u_audio_channel_0");
-	int audio_channel_1_loc = GetShaderLocation(shader, "u_audio_channel_1");
-	int spectrum_channel_0_loc = GetShaderLocation(shader, "u_spectrum_channel_0");
-	int spectrum_channel_1_loc = GetShaderLocation(shader, "u_spectrum_channel_1");
-	SetShaderValue(shader, timeLoc, &time, SHADER_UNIFORM_FLOAT);
-	SetShaderValue(shader, signalLoc, &g_audio_analysis->norm_avg[0], SHADER_UNIFORM_FLOAT);
-	SetShaderValue(shader, resolutionLoc, &resolution, SHADER_UNIFORM_VEC2);
-	SetShaderValueTexture(shader, audio_channel_0_loc, audio_channel_0);
-	SetShaderValueTexture(shader, audio_channel_1_loc, audio_channel_1);
-	SetShaderValueTexture(shader, spectrum_channel_0_loc, spectrum_channel_0);
-	SetShaderValueTexture(shader, spectrum_channel_1_loc, spectrum_channel_1);
+	ShaderInputs inputs = GetShaderInputs(shader);
+	SetShaderValue(shader, inputs.time, &time, SHADER_UNIFORM_FLOAT);
+	SetShaderValue(shader, inputs.signal, &snapshot->norm_avg[0], SHADER_UNIFORM_FLOAT);
+	SetShaderValue(shader, inputs.resolution, &resolution, SHADER_UNIFORM_VEC2);
+	SetShaderValue(shader, inputs.stereo_summary, stereo_summary, SHADER_UNIFORM_VEC4);
+	SetShaderValue(shader, inputs.loudness, loudness, SHADER_UNIFORM_VEC4);
+	SetShaderValue(shader, inputs.spectrogram_row, spectrogram_cursor, SHADER_UNIFORM_IVEC2);
+	// Shaders reading the feature atlas take every input from it and the AudioFeatures block
+	size_t atlas_history = replay == NULL && g_audio_analysis->spectrogram != NULL ? g_audio_analysis->spectrogram->rows : 0;
+	FeatureAtlas *atlas = NULL;
+	if (inputs.features >= 0) {
+		atlas = create_feature_atlas(snapshot->channels, snapshot->num_samples, snapshot->num_bins, snapshot->num_tones, atlas_history);
+	}
+	BindShaderTextures(shader, &inputs, audio_channel_0.texture, audio_channel_1.texture, spectrum_channel_0.texture,
+		spectrum_channel_1.texture, stereo_bands.texture, spectrogram.texture, atlas);
+	int shader_textures = ShaderReadsTextures(&inputs);
+
+	// Only compute what is drawn: the frequency bars read the pitch bins
+	unsigned int render_outputs = ANALYSIS_PITCH; // render_analysis_freq_data
+	// render_outputs |= ANALYSIS_FREQ_DATA; // render_audio_analysis
+	// render_outputs |= ANALYSIS_SPECTROGRAM; // waterfall
+	if (snapshot->num_tones > 0) {
+		render_outputs |= ANALYSIS_TONES; // render_tones
+	}
+	// The history of the live analysis, replays have none
+	uint64_t waveform_span = replay == NULL && g_audio_analysis->waveform != NULL ? (uint64_t)(app->waveform_seconds * analysis_config.sample_rate) : 0;
+	int waveform_columns = waveform_span > 0 ? GetMonitorWidth(GetCurrentMonitor()) : 0; // One per pixel of the widest the window gets
+	WaveformColumn *waveform = waveform_columns > 0 ? (WaveformColumn *)malloc(sizeof(WaveformColumn) * waveform_columns) : NULL;
+	if (waveform != NULL) {
+		render_outputs |= ANALYSIS_WAVEFORM; // render_analysis_time_data
+	}
+	analysis_subscribe(ANALYSIS_CONSUMER_RENDERER, render_outputs | (app->show_visual ? ShaderAnalysisOutputs(shader) : 0)); // shader pass
 
 	// AudioData *g_audio_data = get_audio_data();
 
@@ -308,14 +1002,38 @@ int main(int argc, char **argv) {
 
 	// -------------------------------------------------------------------------------------------------------------
 	// Main game loop
+	uint32_t frame_number = 0;
+	PowerGovernor power = init_power_governor(target_fps, app->power_save);
+	// Unpaced replays measure the render cost, they always draw at full quality
+	QualityGovernor render_quality = init_quality_governor("render", render_quality_names, RENDER_QUALITY_COUNT, app->adaptive_quality && target_fps > 0);
 	while (!WindowShouldClose()) // Detect window close button or ESC key
 	{
 		SetExitKey(KEY_NULL);
 		if (app->is_running) {
+			uint64_t frame_start = profile_begin();
+			uint64_t power_start = power_frame_start();
+			int hidden = IsWindowHidden() || IsWindowMinimized();
+			if (power_governor_update(&power, hidden, IsWindowFocused(), replay == NULL && analysis_idle())) {
+				// Idle frames are paced by power_governor_wait, so sound wakes them within a hop
+				SetTargetFPS(power_governor_idle(&power) ? 0 : power.fps[power.state]);
+				analysis_pause(ANALYSIS_CONSUMER_RENDERER, power.state == POWER_HIDDEN);
+			}
 			// Update
 			//----------------------------------------------------------------------------------
 			time = (float)GetTime();
 			float dt = GetFrameTime();
+			if (shader_program != NULL && shader_program_update(shader_program)) {
+				// An edited shader linked, it starts without any of the inputs of the old one
+				shader = shader_program->shader;
+				inputs = GetShaderInputs(shader);
+				if (inputs.features >= 0 && atlas == NULL) {
+					atlas = create_feature_atlas(snapshot->channels, snapshot->num_samples, snapshot->num_bins, snapshot->num_tones, atlas_history);
+				}
+				BindShaderTextures(shader, &inputs, audio_channel_0.texture, audio_channel_1.texture, spectrum_channel_0.texture,
+					spectrum_channel_1.texture, stereo_bands.texture, spectrogram.texture, atlas);
+				shader_textures = ShaderReadsTextures(&inputs);
+				analysis_subscribe(ANALYSIS_CONSUMER_RENDERER, render_outputs | (app->show_visual ? ShaderAnalysisOutputs(shader) : 0));
+			}
 			//----------------------------------------------------------------------------------
 			// check for alt + enter
 			if (IsKeyPressed(KEY_ENTER) &&
@@ -330,41 +1048,146 @@ int main(int argc, char **argv) {
 					app->show_menu = true;
 				}
 			}
-			UpdateWaveformTexture(&audio_channel_0, g_audio_analysis->time_data[0], g_audio_analysis->buffer.size);
-			UpdateWaveformTexture(&audio_channel_1, g_audio_analysis->time_data[1], g_audio_analysis->buffer.size);
-			UpdateWaveformTexture(&spectrum_channel_0, g_audio_analysis->pitch[0], 125);
-			UpdateWaveformTexture(&spectrum_channel_1, g_audio_analysis->pitch[1], 125);
+			if (IsKeyPressed(KEY_F2)) {
+				app->show_visual = !app->show_visual;
+				analysis_subscribe(ANALYSIS_CONSUMER_RENDERER, render_outputs | (app->show_visual ? ShaderAnalysisOutputs(shader) : 0));
+			}
+			if (IsKeyPressed(KEY_F3)) {
+				app->show_profiler = !app->show_profiler;
+				profile_set_enabled(app->show_profiler); // Nothing is timed while the overlay is hidden
+			}
+			uint64_t upload_start = 0;
+			if (replay != NULL) {
+				if (replay->record_count == 0) {
+					break;
+				}
+				if (app->replay_step) {
+					// One hop per frame, the replay ends after the last one
+					if (replay_record >= replay->record_count) {
+						break;
+					}
+				} else {
+					// Follow the recording clock, starting over at the end
+					uint64_t replay_time = (uint64_t)((GetTime() - replay_start) * 1e9);
+					void *last = feature_stream_record(replay, replay->record_count - 1);
+					if (replay_time > *feature_record_time(replay->header, last)) {
+						replay_start = GetTime();
+						replay_time = 0;
+					}
+					replay_record = feature_stream_seek(replay, replay_time);
+				}
+				void *record = feature_stream_record(replay, replay_record);
+				analysis_snapshot_from_record(snapshot, replay->header, record);
+				if (app->replay_step) {
+					// The visual animates on the recording clock, so every build draws the same frames
+					time = (float)(*feature_record_time(replay->header, record) * 1e-9);
+					replay_record++;
+				}
+				if (frame_count > 0) {
+					frame_time_total += dt;
+					frame_time_worst = dt > frame_time_worst ? dt : frame_time_worst;
+				}
+				frame_count++;
+				upload_start = profile_begin();
+				if (shader_textures && snapshot->num_samples > 0) {
+					UpdateWaveformTexture(&audio_channel_0, snapshot->time_data, snapshot->num_samples);
+					UpdateWaveformTexture(&audio_channel_1, snapshot->time_data + second_channel * snapshot->num_samples, snapshot->num_samples);
+				}
+			} else {
+				uint64_t start = profile_begin();
+				analysis_snapshot_capture(snapshot);
+				if (interpolator != NULL) {
+					uint64_t now = profile_now();
+					snapshot_interpolator_push(interpolator, snapshot, now);
+					// Drawn for when the frame reaches the screen, an interval from now
+					snapshot_interpolator_apply(interpolator, snapshot, now + (power.fps[power.state] > 0 ? 1000000000ull / power.fps[power.state] : 0));
+				}
+				profile_end(PROFILE_SNAPSHOT, start);
+				if (latency_probe != NULL) {
+					latency_probe_published(latency_probe, snapshot->frame);
+				}
+				upload_start = profile_begin();
+				if (shader_textures && (render_quality.level < RENDER_QUALITY_REDUCED || frame_number % 4 == 0)) {
+					UpdateWaveformTexture(&audio_channel_0, snapshot->time_data, snapshot->num_samples);
+					UpdateWaveformTexture(&audio_channel_1, snapshot->time_data + second_channel * snapshot->num_samples, snapshot->num_samples);
+					UpdateStereoTexture(&stereo_bands, g_audio_analysis->stereo);
+					UpdateSpectrogramTexture(&spectrogram, g_audio_analysis->spectrogram, &spectrogram_uploaded);
+				}
+				if (g_audio_analysis->spectrogram != NULL) {
+					spectrogram_cursor[0] = (int)((spectrogram_uploaded + g_audio_analysis->spectrogram->rows - 1) % g_audio_analysis->spectrogram->rows);
+					spectrogram_cursor[1] = (int)g_audio_analysis->spectrogram->rows;
+				}
+			}
+			if (shader_textures) {
+				UpdateBandsTexture(&spectrum_channel_0, snapshot->pitch, snapshot->num_bins);
+				UpdateBandsTexture(&spectrum_channel_1, snapshot->pitch + second_channel * snapshot->num_bins, snapshot->num_bins);
+			}
+			if (atlas != NULL && (render_quality.level < RENDER_QUALITY_REDUCED || frame_number % 4 == 0)) {
+				feature_atlas_update(atlas, snapshot, replay == NULL ? g_audio_analysis->stereo : NULL,
+					replay == NULL ? g_audio_analysis->spectrogram : NULL, time, resolution[0], resolution[1]);
+			}
+			profile_end(PROFILE_UPLOAD, upload_start);
+			memcpy(stereo_summary, snapshot->stereo, sizeof(stereo_summary));
+			memcpy(loudness, snapshot->loudness, sizeof(loudness));
+			bar_renderer_prepare(bars); // Ahead of the frame, the label atlas has its own target
 			// Draw
 			//----------------------------------------------------------------------------------
 			BeginDrawing();
 
 				// ClearBackground(GetColor(GuiGetStyle(DEFAULT, BACKGROUND_COLOR)));
 				ClearBackground(BLACK);
+				if (app->show_visual) {
+					// Drawn in screen coordinates, into the shrunk viewport of the target when there is one
+					if (visual_target != NULL) dynamic_resolution_begin(visual_target);
+					BeginShaderMode(shader);
+						SetShaderValue(shader, inputs.time, &time, SHADER_UNIFORM_FLOAT);
+						SetShaderValue(shader, inputs.signal, &snapshot->norm_avg[0], SHADER_UNIFORM_FLOAT);
+						SetShaderValue(shader, inputs.resolution, &resolution, SHADER_UNIFORM_VEC2);
+						SetShaderValue(shader, inputs.stereo_summary, stereo_summary, SHADER_UNIFORM_VEC4);
+						SetShaderValue(shader, inputs.loudness, loudness, SHADER_UNIFORM_VEC4);
+						SetShaderValue(shader, inputs.spectrogram_row, spectrogram_cursor, SHADER_UNIFORM_IVEC2);
+						DrawTextureRec(texture, (Rectangle){0, 0, (float)screenWidth, -(float)screenHeight}, (Vector2){0, 0}, WHITE);
+					EndShaderMode();
+					if (visual_target != NULL) {
+						dynamic_resolution_end(visual_target);
+						dynamic_resolution_draw(visual_target, (Rectangle){0, 0, (float)screenWidth, (float)screenHeight});
+					}
+				}
 				// render_audio_analysis(g_audio_analysis);
-				// render_analysis_time_data(g_audio_analysis);
-				render_analysis_freq_data(g_audio_analysis);
+				render_analysis_time_data(g_audio_analysis, waveform_span, waveform, waveform_columns, bars);
+				render_analysis_freq_data(snapshot, render_quality.level, bars);
+				render_tones(snapshot, app->tone_frequencies);
 
 				// raygui: controls drawing
 				//----------------------------------------------------------------------------------
-				// BeginShaderMode(shader);
-				// 	SetShaderValue(shader, timeLoc, &time, SHADER_UNIFORM_FLOAT);
-				// 	SetShaderValue(shader, signalLoc, &g_audio_analysis->norm_avg[0], SHADER_UNIFORM_FLOAT);
-				// 	SetShaderValue(shader, resolutionLoc, &resolution, SHADER_UNIFORM_VEC2);
-				// 	SetShaderValueTexture(shader, audio_channel_0_loc, audio_channel_0);
-				// 	SetShaderValueTexture(shader, audio_channel_1_loc, audio_channel_1);
-				// 	SetShaderValueTexture(shader, spectrum_channel_0_loc, spectrum_channel_0);
-				// 	SetShaderValueTexture(shader, spectrum_channel_1_loc, spectrum_channel_1);
-				// 	DrawTextureRec(
-				// 		texture, (Rectangle){0, 0, screenWidth, -screenHeight},
-				// 		(Vector2){
-				// 			0,
-				// 		},
-				// 		WHITE);
-				// EndShaderMode(); //
 				if (app->show_menu) {
 					GuiAudioConfig(&state, &audio_config, app);
 				}
+				if (app->show_profiler) {
+					render_profiler_overlay();
+				}
+			if (!power_governor_idle(&power) && power.fps[power.state] > 0) {
+				// The work of the frame, up to the swap, against the interval it is shown for
+				quality_governor_update(&render_quality, (power_frame_start() - power_start) * 1e-9, 1.0 / power.fps[power.state]);
+				if (visual_target != NULL && app->show_visual) {
+					dynamic_resolution_update(visual_target, 1.0 / power.fps[power.state]);
+				}
+			}
+			uint64_t end_drawing_start = profile_begin();
 			EndDrawing();
+			profile_end(PROFILE_END_DRAWING, end_drawing_start);
+			if (end_drawing_start != 0 && snapshot->capture_time != 0) {
+				// The swap is as close to the photons as we can observe
+				profile_record(PROFILE_LATENCY, snapshot->capture_time, profile_now());
+			}
+			profile_end_arg(PROFILE_FRAME, frame_start, frame_number++);
+			if (latency_probe != NULL) {
+				latency_probe_presented(latency_probe);
+				if (latency_probe_done(latency_probe)) {
+					break;
+				}
+			}
+			power_governor_wait(&power, power_start, analysis_awake);
 
 		} else {
 			CloseWindow();
@@ -374,16 +1197,43 @@ int main(int argc, char **argv) {
 
 	// De-Initialization
 	//--------------------------------------------------------------------------------------
-	UnloadShader(shader);
+	if (shader_program != NULL) {
+		destroy_shader_program(shader_program);
+	} else {
+		UnloadShader(shader);
+	}
+	destroy_bar_renderer(bars);
+	free(waveform);
+	destroy_dynamic_resolution(visual_target);
+	destroy_feature_atlas(atlas);
 	UnloadTexture(texture);
-	UnloadTexture(audio_channel_0);
-	UnloadTexture(audio_channel_1);
-	UnloadTexture(spectrum_channel_0);
-	UnloadTexture(spectrum_channel_1);
-
-	stop_analysis();
-	close_analysis();
-	close_audio();
+	destroy_texture_stream(&audio_channel_0);
+	destroy_texture_stream(&audio_channel_1);
+	destroy_texture_stream(&spectrum_channel_0);
+	destroy_texture_stream(&spectrum_channel_1);
+	destroy_texture_stream(&stereo_bands);
+	destroy_texture_stream(&spectrogram);
+
+	if (replay != NULL) {
+		// Comparable across builds when replaying the same file in step mode
+		if (frame_count > 1) {
+			printf("Replay rendered %zu frames with the visual %s, average %.3f ms, worst %.3f ms\n", frame_count,
+				app->show_visual ? "on" : "off", 1000.0 * frame_time_total / (frame_count - 1), 1000.0 * frame_time_worst);
+		}
+		feature_stream_close(replay);
+	} else {
+		if (latency_probe != NULL) {
+			latency_probe_report(latency_probe, audio_config.ring_size, analysis_config.buffer_size, target_fps);
+			latency_probe_stop(latency_probe);
+		}
+		stop_analysis();
+		close_analysis();
+		close_audio();
+	}
+	// The audio and analysis threads are gone, their buffers can be written
+	profile_trace_close();
+	destroy_snapshot_interpolator(interpolator);
+	free_analysis_snapshot(snapshot);
 	uinit_application(app);
 	//--------------------------------------------------------------------------------------
 
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "arena.h"
 
 // Define the window size for the moving average
 #define WINDOW_SIZE 5
@@ -66,6 +67,33 @@ MovingAverageND* init_moving_average_nd(int dimensions) {
 	return ma;
 }
 
+// Bytes taken in an arena by init_moving_average_nd_arena
+size_t moving_average_nd_arena_size(int dimensions) {
+	return arena_size(sizeof(MovingAverageND)) +
+		arena_rows_size(WINDOW_SIZE, dimensions * sizeof(MA_TYPE)) +
+		arena_size(dimensions * sizeof(MA_TYPE));
+}
+
+// Initialize the n-dimensional moving average structure inside an arena, it is released with the arena
+MovingAverageND* init_moving_average_nd_arena(Arena *arena, int dimensions) {
+	if (dimensions <= 0 || dimensions > MAX_DIMENSIONS) {
+		printf("Error: Invalid number of dimensions (1-%d allowed)\n", MAX_DIMENSIONS);
+		return NULL;
+	}
+
+	MovingAverageND *ma = (MovingAverageND*)arena_alloc(arena, sizeof(MovingAverageND));
+	if (!ma) return NULL;
+
+	ma->dimensions = dimensions;
+	ma->buffer_index = 0;
+	ma->data_count = 0;
+	ma->data_buffer = (MA_TYPE**)arena_alloc_rows(arena, WINDOW_SIZE, dimensions * sizeof(MA_TYPE));
+	ma->current_sum = (MA_TYPE*)arena_alloc(arena, dimensions * sizeof(MA_TYPE));
+	if (!ma->data_buffer || !ma->current_sum) return NULL;
+
+	return ma;
+}
+
 // Calculate moving average for n-dimensional data
 void calculate_moving_average_nd(MovingAverageND *ma, const MA_TYPE *new_values, MA_TYPE *result) {
 	if (!ma || !new_values || !result) return;
@@ -0,0 +1,207 @@
+#ifndef MULTIRES_H
+#define MULTIRES_H
+#include <fftw3.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+// Multi-resolution filterbank.
+// Level 0 is the capture stream, every following level is the previous one
+// low-passed and decimated by two. Each level keeps the last `size` samples
+// and runs the same `size` point DCT on them, so level l spans 2^l times
+// longer than level 0 with 2^l times finer bins. A band is read from the
+// shortest window that still resolves it: highs get short, fast windows and
+// lows the long decimated ones. With `levels` levels the deepest one matches
+// a single transform of size << (levels - 1) for a fraction of its cost.
+
+#define MULTIRES_MAX_LEVELS 8
+#define MULTIRES_MIN_SIZE 64
+#define MULTIRES_TAPS 63          // Decimation low-pass, odd so it is symmetric around one tap
+#define MULTIRES_CUTOFF 0.22      // Of the input rate, a bit under the decimated Nyquist
+#define MULTIRES_USABLE 0.6       // Fraction of a decimated level's Nyquist clear of the filter roll-off
+
+typedef struct {
+	double *ring;       // [2 * size], every sample is written twice so the last `size` are contiguous
+	size_t pos;         // Next write position, 0..size-1
+	unsigned long count; // Samples pushed since init
+} MultiResLevel;
+
+typedef struct {
+	MultiResLevel levels[MULTIRES_MAX_LEVELS];
+	double *in;         // Aligned copy of a window, the DCT input
+	double *out;        // DCT output
+} MultiResChannel;
+
+typedef struct {
+	size_t channels;
+	size_t size;        // Window and transform length of every level
+	size_t levels;
+	unsigned int sample_rate;
+	size_t num_bins;
+	int *band_level;    // Level each band is read from
+	int *band_start;    // First DCT bin of each band in its level
+	int *band_end;      // One past the last DCT bin of each band in its level
+	double *band_scale; // Per band normalization, see init_multires_analysis
+	double taps[MULTIRES_TAPS];
+	MultiResChannel *channel;
+	fftw_plan plan;     // REDFT10 of `size`, shared by every level and channel
+} MultiResAnalysis;
+
+// Bytes taken in an arena by init_multires_analysis
+size_t multires_arena_size(size_t channels, size_t size, size_t levels, size_t num_bins) {
+	return arena_size(sizeof(MultiResAnalysis)) +
+		3 * arena_size(sizeof(int) * num_bins) + arena_size(sizeof(double) * num_bins) +
+		arena_size(sizeof(MultiResChannel) * channels) +
+		channels * (levels * arena_size(sizeof(double) * 2 * size) + 2 * arena_size(sizeof(double) * size));
+}
+
+// Windowed-sinc low-pass, Blackman window, unity gain at DC
+static void _multires_design_taps(double *taps) {
+	int mid = MULTIRES_TAPS / 2;
+	double sum = 0.0;
+	for (int k = 0; k < MULTIRES_TAPS; k++) {
+		int n = k - mid;
+		double sinc = n == 0 ? 2.0 * MULTIRES_CUTOFF : sin(2.0 * M_PI * MULTIRES_CUTOFF * n) / (M_PI * n);
+		double w = 0.42 - 0.5 * cos(2.0 * M_PI * k / (MULTIRES_TAPS - 1)) + 0.08 * cos(4.0 * M_PI * k / (MULTIRES_TAPS - 1));
+		taps[k] = sinc * w;
+		sum += taps[k];
+	}
+	for (int k = 0; k < MULTIRES_TAPS; k++) {
+		taps[k] /= sum;
+	}
+}
+
+// Initialize a filterbank of `levels` levels with `size` point windows for the
+// bands bin_start/bin_end of a spectrum_size point REDFT10 at sample_rate.
+// Bands keep the scale of that single transform: a band sums the magnitudes of
+// its bins in its level and divides by its width in the single transform, so
+// a tone draws the same height in both.
+MultiResAnalysis* init_multires_analysis(Arena *arena, size_t channels, size_t size, size_t levels, unsigned int sample_rate,
+	size_t num_bins, const int *bin_start, const int *bin_end, size_t spectrum_size) {
+	if (channels == 0 || size < MULTIRES_MIN_SIZE || size < MULTIRES_TAPS || levels == 0 || levels > MULTIRES_MAX_LEVELS ||
+		num_bins == 0 || spectrum_size == 0 || sample_rate == 0) {
+		printf("Error: Invalid multi-resolution analysis configuration\n");
+		return NULL;
+	}
+
+	MultiResAnalysis *mr = (MultiResAnalysis*)arena_alloc(arena, sizeof(MultiResAnalysis));
+	if (!mr) return NULL;
+	mr->channels = channels;
+	mr->size = size;
+	mr->levels = levels;
+	mr->sample_rate = sample_rate;
+	mr->num_bins = num_bins;
+	mr->band_level = (int*)arena_alloc(arena, sizeof(int) * num_bins);
+	mr->band_start = (int*)arena_alloc(arena, sizeof(int) * num_bins);
+	mr->band_end = (int*)arena_alloc(arena, sizeof(int) * num_bins);
+	mr->band_scale = (double*)arena_alloc(arena, sizeof(double) * num_bins);
+	mr->channel = (MultiResChannel*)arena_alloc(arena, sizeof(MultiResChannel) * channels);
+	if (!mr->band_level || !mr->band_start || !mr->band_end || !mr->band_scale || !mr->channel) return NULL;
+	for (size_t c = 0; c < channels; c++) {
+		for (size_t l = 0; l < levels; l++) {
+			mr->channel[c].levels[l].ring = (double*)arena_alloc(arena, sizeof(double) * 2 * size);
+			if (!mr->channel[c].levels[l].ring) return NULL;
+		}
+		mr->channel[c].in = (double*)arena_alloc(arena, sizeof(double) * size);
+		mr->channel[c].out = (double*)arena_alloc(arena, sizeof(double) * size);
+		if (!mr->channel[c].in || !mr->channel[c].out) return NULL;
+	}
+	_multires_design_taps(mr->taps);
+
+	// Bin k of a N point REDFT10 at rate r sits at k * r / (2N)
+	double base_width = sample_rate / (2.0 * spectrum_size);
+	for (size_t j = 0; j < num_bins; j++) {
+		double low = bin_start[j] * base_width;
+		double high = bin_end[j] * base_width;
+		int chosen = -1;
+		for (size_t l = 0; l < levels; l++) {
+			double rate = (double)sample_rate / (1u << l);
+			double usable = l == 0 ? rate / 2.0 : MULTIRES_USABLE * rate / 2.0;
+			double width = rate / (2.0 * size);
+			if (high > usable) continue;
+			chosen = (int)l;
+			if (high - low >= width) break; // Resolved, no need for a longer window
+		}
+		if (chosen < 0) chosen = 0; // Above every decimated level
+		double width = (double)sample_rate / (1u << chosen) / (2.0 * size);
+		int start = (int)floor(low / width);
+		int end = (int)ceil(high / width);
+		if (start > (int)size - 1) start = (int)size - 1;
+		if (end > (int)size) end = (int)size;
+		if (end <= start) end = start + 1;
+		mr->band_level[j] = chosen;
+		mr->band_start[j] = start;
+		mr->band_end[j] = end;
+		mr->band_scale[j] = 1.0 / (double)size / (double)(bin_end[j] > bin_start[j] ? bin_end[j] - bin_start[j] : 1);
+	}
+
+	// Arena rows are aligned like fftw_malloc, so the plan applies to every window
+	mr->plan = fftw_plan_r2r_1d(size, mr->channel[0].in, mr->channel[0].out, FFTW_REDFT10, FFTW_ESTIMATE);
+	return mr;
+}
+
+static inline void _multires_level_write(MultiResLevel *level, size_t size, double x) {
+	level->ring[level->pos] = x;
+	level->ring[level->pos + size] = x;
+	level->pos = level->pos + 1 == size ? 0 : level->pos + 1;
+	level->count++;
+}
+
+// The last `size` samples of a level, oldest first
+static inline const double* _multires_level_window(const MultiResLevel *level) {
+	return level->ring + level->pos;
+}
+
+// Feed `frames` interleaved frames of a channel, decimating down every level
+void multires_push(MultiResAnalysis *mr, size_t channel, const float *in, size_t frames) {
+	MultiResChannel *ch = &mr->channel[channel];
+	size_t size = mr->size;
+	for (size_t t = 0; t < frames; t++) {
+		double x = in[t * mr->channels + channel];
+		for (size_t l = 0; l < mr->levels; l++) {
+			MultiResLevel *level = &ch->levels[l];
+			_multires_level_write(level, size, x);
+			// Every other sample of this level makes one of the next
+			if (l + 1 == mr->levels || (level->count & 1)) break;
+			const double *window = _multires_level_window(level) + size - MULTIRES_TAPS;
+			double y = 0.0;
+			#pragma omp simd reduction(+:y)
+			for (int k = 0; k < MULTIRES_TAPS; k++) {
+				y += mr->taps[k] * window[k];
+			}
+			x = y;
+		}
+	}
+}
+
+// Transform every level of a channel and write its bands, log scaled like the single transform pitch
+void multires_bands(MultiResAnalysis *mr, size_t channel, double *bands) {
+	MultiResChannel *ch = &mr->channel[channel];
+	size_t size = mr->size;
+	for (size_t l = 0; l < mr->levels; l++) {
+		memcpy(ch->in, _multires_level_window(&ch->levels[l]), sizeof(double) * size);
+		fftw_execute_r2r(mr->plan, ch->in, ch->out);
+		for (size_t k = 0; k < size; k++) {
+			ch->in[k] = fabs(ch->out[k]); // The window copy is free again, keep the magnitudes there
+		}
+		ch->in[0] = 0.0; // Skip DC like freq_data does
+		for (size_t j = 0; j < mr->num_bins; j++) {
+			if (mr->band_level[j] != (int)l) continue;
+			double sum = 0.0;
+			for (int k = mr->band_start[j]; k < mr->band_end[j]; k++) {
+				sum += ch->in[k];
+			}
+			bands[j] = log2(sum * mr->band_scale[j] + 1);
+		}
+	}
+}
+
+// Destroy the FFTW plan, the memory is released with the arena
+void free_multires_analysis(MultiResAnalysis *mr) {
+	if (!mr) return;
+	fftw_destroy_plan(mr->plan);
+}
+#endif // MULTIRES_H
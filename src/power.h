@@ -0,0 +1,94 @@
+#ifndef POWER_H
+#define POWER_H
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+// Render side of the power governor.
+// Every frame the renderer reports whether the window is hidden or focused and
+// whether the analysis went idle on silence (see analysis_idle), and draws at
+// the frame rate of the resulting state. Idle states don't rely on the frame
+// limiter: power_governor_wait sleeps in short slices and returns as soon as
+// the analysis hears sound again, so the first loud hop is drawn without
+// waiting out a slow frame. Hidden windows always throttle, unfocused and
+// silent ones only when the governor is enabled.
+
+#define POWER_UNFOCUSED_FPS 30
+#define POWER_SILENT_FPS 5
+#define POWER_HIDDEN_FPS 2
+#define POWER_WAKE_POLL_US 5000 // Sleep slice of power_governor_wait, a fraction of a hop
+
+typedef enum {
+	POWER_ACTIVE,
+	POWER_UNFOCUSED,
+	POWER_SILENT,    // The input stayed under the analysis silence gate
+	POWER_HIDDEN,    // Minimized or hidden window
+	POWER_STATE_COUNT
+} PowerState;
+
+typedef struct {
+	int enabled;     // Throttle unfocused and silent windows too
+	int fps[POWER_STATE_COUNT];
+	PowerState state;
+} PowerGovernor;
+
+static const char *_power_state_names[POWER_STATE_COUNT] = {"active", "unfocused", "silent", "hidden"};
+
+const char* power_state_name(PowerState state) {
+	return state < POWER_STATE_COUNT ? _power_state_names[state] : "unknown";
+}
+
+PowerGovernor init_power_governor(int active_fps, int enabled) {
+	PowerGovernor governor;
+	governor.enabled = enabled;
+	governor.fps[POWER_ACTIVE] = active_fps;
+	governor.fps[POWER_UNFOCUSED] = active_fps > 0 && active_fps < POWER_UNFOCUSED_FPS ? active_fps : POWER_UNFOCUSED_FPS;
+	governor.fps[POWER_SILENT] = POWER_SILENT_FPS;
+	governor.fps[POWER_HIDDEN] = POWER_HIDDEN_FPS;
+	governor.state = POWER_ACTIVE;
+	return governor;
+}
+
+// Move to the state of the window and the input, 1 if it changed
+int power_governor_update(PowerGovernor *governor, int hidden, int focused, int silent) {
+	PowerState state = POWER_ACTIVE;
+	if (hidden) {
+		state = POWER_HIDDEN;
+	} else if (governor->enabled && silent) {
+		state = POWER_SILENT;
+	} else if (governor->enabled && !focused) {
+		state = POWER_UNFOCUSED;
+	}
+	if (state == governor->state) return 0;
+	printf("Power: %s -> %s, %d fps\n", power_state_name(governor->state), power_state_name(state), governor->fps[state]);
+	governor->state = state;
+	return 1;
+}
+
+// Frames of this state are paced by power_governor_wait instead of the frame limiter
+int power_governor_idle(const PowerGovernor *governor) {
+	return governor->state == POWER_SILENT || governor->state == POWER_HIDDEN;
+}
+
+static uint64_t _power_now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Monotonic nanoseconds to pass to power_governor_wait as the start of a frame
+uint64_t power_frame_start() {
+	return _power_now();
+}
+
+// Sleep until the next frame of an idle state is due, or until wake() reports the input came back
+void power_governor_wait(const PowerGovernor *governor, uint64_t frame_start, int (*wake)(void)) {
+	if (!power_governor_idle(governor)) return;
+	uint64_t deadline = frame_start + 1000000000ull / (uint64_t)governor->fps[governor->state];
+	while (_power_now() < deadline) {
+		if (governor->state == POWER_SILENT && wake != NULL && wake()) return;
+		usleep(POWER_WAKE_POLL_US);
+	}
+}
+#endif // POWER_H
@@ -0,0 +1,332 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Hot path timing.
+// Every thread that records a sample claims one of PROFILE_MAX_THREADS rings
+// and is its only writer, so recording is a clock read and a store, without
+// locks or allocations, and is safe from the audio callback. The main thread
+// drains the rings into a rolling window per stage and reads percentiles off
+// it. Nothing is recorded while profiling is disabled, profile_begin then
+// returns 0 without reading the clock.
+// While a trace is open every sample is also appended to a per-thread buffer
+// allocated by profile_trace_open, written out in Chrome trace-event format
+// (chrome://tracing, ui.perfetto.dev) by profile_trace_close.
+
+#define PROFILE_RING_SIZE 1024 // Samples kept per thread, a power of two
+#define PROFILE_MAX_THREADS 32
+#define PROFILE_WINDOW 256     // Samples per stage the percentiles are taken over
+#define PROFILE_TRACE_EVENTS 65536 // Trace samples kept per thread, the rest are dropped
+
+// Bits of _profile_enabled
+#define PROFILE_OVERLAY 1
+#define PROFILE_TRACE 2
+
+typedef enum {
+	PROFILE_CALLBACK,    // Device callback, capture side
+	PROFILE_READ,        // read_audio_data
+	PROFILE_COPY,        // Deinterleave of a channel
+	PROFILE_FFT,         // Time data and FFT of a channel
+	PROFILE_BANDS,       // Magnitude, smoothing and bands of a channel
+	PROFILE_STEREO,
+	PROFILE_LOUDNESS,
+	PROFILE_HOP,         // The whole task graph of a hop
+	PROFILE_PUBLISH,     // Spectrogram publish and feature recording
+	PROFILE_SNAPSHOT,    // Snapshot taken by the renderer
+	PROFILE_UPLOAD,      // Texture uploads of a frame
+	PROFILE_END_DRAWING, // EndDrawing, buffer swap and frame pacing included
+	PROFILE_LATENCY,     // Capture of the newest drawn samples to the end of the frame showing them
+	PROFILE_FRAME,       // A whole iteration of the render loop
+	PROFILE_MULTIRES,    // Multi-resolution filterbank of a channel
+	PROFILE_TONES,       // Sliding DFT of the tracked frequencies
+	PROFILE_WAVEFORM,    // Waveform pyramid of a channel
+	PROFILE_STAGE_COUNT
+} ProfileStage;
+
+static const char *_profile_stage_names[PROFILE_STAGE_COUNT] = {
+	"callback", "read", "copy", "fft", "bands", "stereo", "loudness",
+	"hop", "publish", "snapshot", "upload", "end_drawing", "latency", "frame",
+	"multires", "tones", "waveform",
+};
+
+// Meaning of ProfileSample.arg in a trace, NULL if it has none
+static const char *_profile_stage_args[PROFILE_STAGE_COUNT] = {
+	"frames", "frames", "channel", "channel", "channel", NULL, "frames",
+	"frames", NULL, NULL, NULL, NULL, NULL, "frame",
+	"channel", "frames", "channel",
+};
+
+typedef struct {
+	uint32_t stage;
+	uint32_t arg;   // Channel, frame count... see _profile_stage_args
+	uint64_t start; // profile_now() timestamps
+	uint64_t end;
+} ProfileSample;
+
+typedef struct {
+	ProfileSample samples[PROFILE_RING_SIZE];
+	atomic_ulong head;  // Samples written since init, by the owning thread
+	atomic_int owned;   // Claimed by a live thread
+	unsigned long read; // Samples consumed by profile_collect
+	const char *name;   // Thread name shown in traces, the last owner's if the ring was reused
+	ProfileSample *trace; // PROFILE_TRACE_EVENTS samples while a trace is open
+	size_t trace_count;   // Written by the owning thread only
+	size_t trace_dropped;
+} ProfileRing;
+
+typedef struct {
+	double durations[PROFILE_WINDOW]; // Seconds
+	size_t count;
+	size_t next;
+} ProfileWindow;
+
+static ProfileRing _profile_rings[PROFILE_MAX_THREADS];
+static atomic_int _profile_ring_count;  // Rings ever claimed
+static atomic_int _profile_enabled;
+static ProfileWindow _profile_windows[PROFILE_STAGE_COUNT];
+static pthread_key_t _profile_ring_key;
+static pthread_once_t _profile_key_once = PTHREAD_ONCE_INIT;
+static __thread ProfileRing *_profile_ring; // Ring of the current thread
+static __thread int _profile_ring_failed;   // Every ring is taken
+static ProfileSample *_profile_trace_events; // Trace buffers of every ring, one block
+static FILE *_profile_trace_file;
+static uint64_t _profile_trace_start;
+
+// Monotonic time in nanoseconds
+static inline uint64_t profile_now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static inline int profile_enabled() {
+	return atomic_load_explicit(&_profile_enabled, memory_order_relaxed);
+}
+
+// A thread exiting gives its ring back, the samples left in it are still collected
+static void _profile_release_ring(void *ring) {
+	atomic_store_explicit(&((ProfileRing *)ring)->owned, 0, memory_order_release);
+}
+
+static void _profile_create_key() {
+	pthread_key_create(&_profile_ring_key, _profile_release_ring);
+}
+
+static ProfileRing* _profile_thread_ring() {
+	if (_profile_ring != NULL || _profile_ring_failed) {
+		return _profile_ring;
+	}
+	pthread_once(&_profile_key_once, _profile_create_key);
+	for (int i = 0; i < PROFILE_MAX_THREADS; i++) {
+		int expected = 0;
+		if (atomic_compare_exchange_strong(&_profile_rings[i].owned, &expected, 1)) {
+			// Keep the highest claimed ring visible to the collector
+			int count = atomic_load(&_profile_ring_count);
+			while (count < i + 1 && !atomic_compare_exchange_weak(&_profile_ring_count, &count, i + 1)) {
+			}
+			pthread_setspecific(_profile_ring_key, &_profile_rings[i]);
+			_profile_ring = &_profile_rings[i];
+			return _profile_ring;
+		}
+	}
+	_profile_ring_failed = 1;
+	return NULL;
+}
+
+// Name the calling thread in traces, the string must outlive the trace
+void profile_thread_name(const char *name) {
+	ProfileRing *ring = _profile_thread_ring();
+	if (ring != NULL) ring->name = name;
+}
+
+// Record a sample of `stage` that ran from `start` to `end`, with a stage specific argument
+static inline void profile_record_arg(ProfileStage stage, uint64_t start, uint64_t end, uint32_t arg) {
+	int enabled = profile_enabled();
+	if (!enabled) return;
+	ProfileRing *ring = _profile_thread_ring();
+	if (ring == NULL) return;
+	unsigned long head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	ProfileSample *sample = &ring->samples[head & (PROFILE_RING_SIZE - 1)];
+	sample->stage = stage;
+	sample->arg = arg;
+	sample->start = start;
+	sample->end = end;
+	atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+	if ((enabled & PROFILE_TRACE) && ring->trace != NULL) {
+		if (ring->trace_count < PROFILE_TRACE_EVENTS) {
+			ring->trace[ring->trace_count++] = *sample;
+		} else {
+			ring->trace_dropped++;
+		}
+	}
+}
+
+static inline void profile_record(ProfileStage stage, uint64_t start, uint64_t end) {
+	profile_record_arg(stage, start, end, 0);
+}
+
+// Start timing a stage, 0 when profiling is disabled
+static inline uint64_t profile_begin() {
+	return profile_enabled() ? profile_now() : 0;
+}
+
+// Record the stage started by profile_begin
+static inline void profile_end_arg(ProfileStage stage, uint64_t start, uint32_t arg) {
+	if (start == 0) return;
+	profile_record_arg(stage, start, profile_now(), arg);
+}
+
+static inline void profile_end(ProfileStage stage, uint64_t start) {
+	profile_end_arg(stage, start, 0);
+}
+
+// Forget the collected samples and skip the ones not collected yet
+void profile_reset() {
+	int count = atomic_load(&_profile_ring_count);
+	for (int i = 0; i < count; i++) {
+		_profile_rings[i].read = atomic_load_explicit(&_profile_rings[i].head, memory_order_acquire);
+	}
+	memset(_profile_windows, 0, sizeof(_profile_windows));
+}
+
+// Start or stop recording for the overlay, the windows start over when it is enabled
+void profile_set_enabled(int enabled) {
+	if (enabled && !(profile_enabled() & PROFILE_OVERLAY)) {
+		profile_reset();
+	}
+	if (enabled) {
+		atomic_fetch_or(&_profile_enabled, PROFILE_OVERLAY);
+	} else {
+		atomic_fetch_and(&_profile_enabled, ~PROFILE_OVERLAY);
+	}
+}
+
+static void _profile_window_push(ProfileWindow *window, double duration) {
+	window->durations[window->next] = duration;
+	window->next = (window->next + 1) % PROFILE_WINDOW;
+	if (window->count < PROFILE_WINDOW) window->count++;
+}
+
+// Move the samples recorded since the last call into the stage windows.
+// Only one thread may collect.
+void profile_collect() {
+	int count = atomic_load(&_profile_ring_count);
+	for (int i = 0; i < count; i++) {
+		ProfileRing *ring = &_profile_rings[i];
+		unsigned long head = atomic_load_explicit(&ring->head, memory_order_acquire);
+		if (head - ring->read > PROFILE_RING_SIZE) {
+			ring->read = head - PROFILE_RING_SIZE; // Lapped, the oldest samples are gone
+		}
+		for (; ring->read < head; ring->read++) {
+			ProfileSample sample = ring->samples[ring->read & (PROFILE_RING_SIZE - 1)];
+			// The writer may have reused the slot while it was copied
+			atomic_thread_fence(memory_order_acquire);
+			unsigned long now = atomic_load_explicit(&ring->head, memory_order_acquire);
+			if (now - ring->read >= PROFILE_RING_SIZE) continue;
+			if (sample.stage >= PROFILE_STAGE_COUNT || sample.end < sample.start) continue;
+			_profile_window_push(&_profile_windows[sample.stage], (sample.end - sample.start) * 1e-9);
+		}
+	}
+}
+
+static int _profile_compare(const void *a, const void *b) {
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+// Percentile `p` (0..1) of the durations in a stage window, in seconds, -1 if it is empty
+double profile_percentile(ProfileStage stage, double p) {
+	ProfileWindow *window = &_profile_windows[stage];
+	if (window->count == 0) return -1.0;
+	double sorted[PROFILE_WINDOW];
+	memcpy(sorted, window->durations, sizeof(double) * window->count);
+	qsort(sorted, window->count, sizeof(double), _profile_compare);
+	size_t rank = (size_t)(p * (window->count - 1) + 0.5);
+	return sorted[rank];
+}
+
+const char* profile_stage_name(ProfileStage stage) {
+	return stage < PROFILE_STAGE_COUNT ? _profile_stage_names[stage] : "unknown";
+}
+// Start tracing to `path`, the buffers of every thread are allocated up front
+// so recording never allocates. Returns -1 on failure.
+int profile_trace_open(const char *path) {
+	if (_profile_trace_file != NULL) {
+		printf("Error: A trace is already open\n");
+		return -1;
+	}
+	_profile_trace_file = fopen(path, "w");
+	if (_profile_trace_file == NULL) {
+		printf("Error: Failed to open trace file %s\n", path);
+		return -1;
+	}
+	// Pages are only touched by the threads that record
+	_profile_trace_events = (ProfileSample *)calloc((size_t)PROFILE_MAX_THREADS * PROFILE_TRACE_EVENTS, sizeof(ProfileSample));
+	if (_profile_trace_events == NULL) {
+		printf("Error: Failed to allocate memory for the trace\n");
+		fclose(_profile_trace_file);
+		_profile_trace_file = NULL;
+		return -1;
+	}
+	for (int i = 0; i < PROFILE_MAX_THREADS; i++) {
+		_profile_rings[i].trace = _profile_trace_events + (size_t)i * PROFILE_TRACE_EVENTS;
+		_profile_rings[i].trace_count = 0;
+		_profile_rings[i].trace_dropped = 0;
+	}
+	_profile_trace_start = profile_now();
+	atomic_fetch_or(&_profile_enabled, PROFILE_TRACE);
+	return 0;
+}
+
+// Stop tracing and write the trace, every traced thread must have stopped recording
+void profile_trace_close() {
+	if (_profile_trace_file == NULL) return;
+	atomic_fetch_and(&_profile_enabled, ~PROFILE_TRACE);
+	FILE *file = _profile_trace_file;
+	int count = atomic_load(&_profile_ring_count);
+	size_t written = 0;
+	size_t dropped = 0;
+
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"vela\"}}");
+	for (int i = 0; i < count; i++) {
+		ProfileRing *ring = &_profile_rings[i];
+		if (ring->trace_count == 0) continue;
+		if (ring->name != NULL) {
+			fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", i + 1, ring->name);
+		}
+		for (size_t k = 0; k < ring->trace_count; k++) {
+			ProfileSample *sample = &ring->trace[k];
+			if (sample->stage >= PROFILE_STAGE_COUNT || sample->start < _profile_trace_start || sample->end < sample->start) continue;
+			// Timestamps and durations are in microseconds
+			fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+				_profile_stage_names[sample->stage], i + 1,
+				(sample->start - _profile_trace_start) * 1e-3, (sample->end - sample->start) * 1e-3);
+			if (_profile_stage_args[sample->stage] != NULL) {
+				fprintf(file, ",\"args\":{\"%s\":%u}", _profile_stage_args[sample->stage], sample->arg);
+			}
+			fprintf(file, "}");
+			written++;
+		}
+		dropped += ring->trace_dropped;
+		ring->trace = NULL;
+	}
+	fprintf(file, "\n]}\n");
+	fclose(file);
+	_profile_trace_file = NULL;
+	free(_profile_trace_events);
+	_profile_trace_events = NULL;
+	printf("Trace: %zu events written", written);
+	if (dropped > 0) {
+		printf(", %zu dropped after the per-thread limit of %d", dropped, PROFILE_TRACE_EVENTS);
+	}
+	printf("\n");
+}
+#endif // PROFILER_H
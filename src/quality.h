@@ -0,0 +1,75 @@
+#ifndef QUALITY_H
+#define QUALITY_H
+#include <stdio.h>
+
+// Deadline-driven quality governor.
+// Fed with the time a piece of work took and the time it had (a hop of
+// captured audio, a display interval), it keeps the smoothed load, their
+// ratio, under a ceiling by stepping down through the quality levels of its
+// owner, and steps back up once the load leaves enough headroom. Level 0 is
+// full quality. A step down waits for a few measurements so its effect shows
+// in the load, a step up for many more so the levels don't oscillate.
+
+#define QUALITY_MAX_LEVELS 8
+#define QUALITY_SMOOTHING 0.1   // Weight of a new measurement in the smoothed load
+#define QUALITY_HIGH_LOAD 0.8   // Step down above this load
+#define QUALITY_LOW_LOAD 0.4    // Step up below this load
+#define QUALITY_HOLD_DOWN 8     // Measurements after a step before stepping down again
+#define QUALITY_HOLD_UP 120     // Measurements after a step before stepping up
+
+typedef struct {
+	const char *name;
+	const char *const *level_names; // [levels]
+	int levels;
+	int level;       // Current level, 0 is full quality
+	int enabled;     // A disabled governor stays at level 0
+	double elapsed;  // Smoothed seconds of work per measurement
+	double deadline; // Smoothed seconds available per measurement
+	int hold;        // Measurements left before the level may change
+} QualityGovernor;
+
+QualityGovernor init_quality_governor(const char *name, const char *const *level_names, int levels, int enabled) {
+	QualityGovernor governor;
+	governor.name = name;
+	governor.level_names = level_names;
+	governor.levels = levels < 1 ? 1 : levels > QUALITY_MAX_LEVELS ? QUALITY_MAX_LEVELS : levels;
+	governor.level = 0;
+	governor.enabled = enabled;
+	governor.elapsed = 0.0;
+	governor.deadline = 0.0;
+	governor.hold = QUALITY_HOLD_DOWN;
+	return governor;
+}
+
+// Smoothed load, the share of the deadline spent working
+double quality_governor_load(const QualityGovernor *governor) {
+	return governor->deadline > 0.0 ? governor->elapsed / governor->deadline : 0.0;
+}
+
+// Account a piece of work of `elapsed` seconds that had `deadline` seconds, and return the level to run next
+int quality_governor_update(QualityGovernor *governor, double elapsed, double deadline) {
+	if (!governor->enabled || deadline <= 0.0) return governor->level;
+	// Both sides are smoothed, so cheap and expensive measurements of a cycle weigh by their duration
+	governor->elapsed += QUALITY_SMOOTHING * (elapsed - governor->elapsed);
+	governor->deadline += QUALITY_SMOOTHING * (deadline - governor->deadline);
+	if (governor->hold > 0) {
+		governor->hold--;
+		return governor->level;
+	}
+	double load = quality_governor_load(governor);
+	int level = governor->level;
+	if (load > QUALITY_HIGH_LOAD && level + 1 < governor->levels) {
+		level++;
+		governor->hold = QUALITY_HOLD_DOWN;
+	} else if (load < QUALITY_LOW_LOAD && level > 0) {
+		level--;
+		governor->hold = QUALITY_HOLD_UP;
+	}
+	if (level != governor->level) {
+		printf("Quality: %s %s -> %s at %.0f%% load\n", governor->name,
+			governor->level_names[governor->level], governor->level_names[level], 100.0 * load);
+		governor->level = level;
+	}
+	return governor->level;
+}
+#endif // QUALITY_H
@@ -0,0 +1,153 @@
+#ifndef REALTIME_H
+#define REALTIME_H
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+// Scheduling of the threads on the audio path.
+// A thread applies its own ThreadSchedule when it starts: a real-time policy
+// and priority, and optionally a core it is pinned to. Cores can be kept for
+// the analysis by taking them out of the affinity of the calling thread before
+// the others are spawned, so those inherit the reduced mask. Memory touched by
+// the hot path is locked so it is never paged out, and stacks are faulted in
+// up front. Every request may be refused without privileges (CAP_SYS_NICE,
+// CAP_IPC_LOCK or the rtprio/memlock limits): the refusal is reported and the
+// thread keeps running as it was. Affinity needs _GNU_SOURCE, which the
+// translation units define before their first include.
+
+#define REALTIME_STACK_PREFAULT (256 * 1024) // Bytes of stack touched by realtime_prefault_stack
+#define REALTIME_DEFAULT_PRIORITY 70
+
+typedef struct {
+	int policy;   // SCHED_OTHER leaves the thread to the default scheduler, or SCHED_FIFO, SCHED_RR
+	int priority; // Real-time priority, clamped to the range of the policy
+	int cpu;      // Core the thread is pinned to, -1 to let it float
+} ThreadSchedule;
+
+ThreadSchedule thread_schedule_default() {
+	ThreadSchedule schedule;
+	schedule.policy = SCHED_OTHER;
+	schedule.priority = 0;
+	schedule.cpu = -1;
+	return schedule;
+}
+
+const char* thread_schedule_policy_name(int policy) {
+	switch (policy) {
+		case SCHED_FIFO: return "SCHED_FIFO";
+		case SCHED_RR: return "SCHED_RR";
+		default: return "SCHED_OTHER";
+	}
+}
+
+static int _realtime_cpu_count() {
+	long cores = sysconf(_SC_NPROCESSORS_CONF);
+	return cores > 0 ? (int)cores : 1;
+}
+
+// Apply a schedule to the calling thread, 0 if it was granted entirely, -1 if any of it was refused
+int thread_schedule_apply(const char *name, const ThreadSchedule *schedule) {
+	int result = 0;
+	if (schedule->policy == SCHED_FIFO || schedule->policy == SCHED_RR) {
+		int min = sched_get_priority_min(schedule->policy);
+		int max = sched_get_priority_max(schedule->policy);
+		struct sched_param param;
+		param.sched_priority = schedule->priority < min ? min : schedule->priority > max ? max : schedule->priority;
+		int error = pthread_setschedparam(pthread_self(), schedule->policy, &param);
+		if (error != 0) {
+			printf("Warning: %s priority %d denied for the %s thread (%s), it keeps the default scheduler\n",
+				thread_schedule_policy_name(schedule->policy), param.sched_priority, name, strerror(error));
+			result = -1;
+		} else {
+			printf("The %s thread runs with %s priority %d\n", name, thread_schedule_policy_name(schedule->policy), param.sched_priority);
+		}
+	}
+	if (schedule->cpu >= 0) {
+		int cpu = schedule->cpu % _realtime_cpu_count();
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+		if (error != 0) {
+			printf("Warning: Pinning the %s thread to core %d failed (%s), it floats\n", name, cpu, strerror(error));
+			result = -1;
+		} else {
+			printf("The %s thread is pinned to core %d\n", name, cpu);
+		}
+	}
+	return result;
+}
+
+// Take `count` cores from `first` on out of the affinity of the calling thread, and of the threads it spawns from now on
+int realtime_isolate_cpus(int first, int count) {
+	int cores = _realtime_cpu_count();
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	if (pthread_getaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+		CPU_ZERO(&set);
+		for (int i = 0; i < cores; i++) CPU_SET(i, &set);
+	}
+	for (int i = 0; i < count; i++) {
+		CPU_CLR((first + i) % cores, &set);
+	}
+	if (CPU_COUNT(&set) == 0) {
+		printf("Warning: Isolating cores %d..%d would leave no core for the other threads, not isolating\n", first, first + count - 1);
+		return -1;
+	}
+	int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	if (error != 0) {
+		printf("Warning: Isolating cores %d..%d failed (%s)\n", first, first + count - 1, strerror(error));
+		return -1;
+	}
+	// Only the kernel keeps other processes and interrupts away, tell whether it was asked to
+	char isolated[256] = "";
+	FILE *file = fopen("/sys/devices/system/cpu/isolated", "r");
+	if (file != NULL) {
+		if (fgets(isolated, sizeof(isolated), file) == NULL) isolated[0] = '\0';
+		fclose(file);
+	}
+	isolated[strcspn(isolated, "\n")] = '\0';
+	printf("Cores %d..%d are kept for the analysis, kernel isolated cores: %s\n", first, first + count - 1,
+		isolated[0] != '\0' ? isolated : "none (boot with isolcpus= to move other processes away)");
+	return 0;
+}
+
+// Lock a block in memory and fault it in, 0 on success
+int realtime_lock(const void *ptr, size_t size, const char *label) {
+	if (ptr == NULL || size == 0) return 0;
+	if (mlock(ptr, size) != 0) {
+		int error = errno;
+		struct rlimit limit;
+		if (getrlimit(RLIMIT_MEMLOCK, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY) {
+			printf("Warning: Locking %zu bytes of %s failed (%s, memlock limit %llu bytes), it may be paged out\n",
+				size, label, strerror(error), (unsigned long long)limit.rlim_cur);
+		} else {
+			printf("Warning: Locking %zu bytes of %s failed (%s), it may be paged out\n", size, label, strerror(error));
+		}
+		return -1;
+	}
+	return 0;
+}
+
+void realtime_unlock(const void *ptr, size_t size) {
+	if (ptr == NULL || size == 0) return;
+	munlock(ptr, size);
+}
+
+// Touch the stack the calling thread will use, so the hot path doesn't fault it in
+void realtime_prefault_stack() {
+	volatile unsigned char stack[REALTIME_STACK_PREFAULT];
+	long page = sysconf(_SC_PAGESIZE);
+	if (page <= 0) page = 4096;
+	for (size_t i = 0; i < sizeof(stack); i += (size_t)page) {
+		stack[i] = 0;
+	}
+}
+#endif // REALTIME_H
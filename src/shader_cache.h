@@ -0,0 +1,589 @@
+#ifndef SHADER_CACHE_H
+#define SHADER_CACHE_H
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "gl_context.h"
+#include "raylib.h"
+#include "rlgl.h"
+
+// Shader programs cached on disk, and hot reloading of watched shaders.
+// Linking a program is slow, so every program built here is saved as the
+// binary the driver hands back, under a key hashing both sources and the
+// vendor, renderer and version strings of the driver. The next start loads
+// the binary instead of compiling; a binary the driver rejects, after an
+// update it didn't show in its strings, is compiled and saved again.
+// A ShaderProgram also watches its source files: a thread rereads them and
+// hands changed sources to the render thread, which looks them up in the
+// cache or starts compiling them. With KHR_parallel_shader_compile the
+// compile isn't waited for, the driver reports when it finished; without it
+// the status can't be asked for without waiting, so the reload compiles in
+// the frame it was picked up in and says it blocks. A program replaces the
+// current one once it links, one that doesn't is reported and dropped.
+// rlgl has no entry points for program binaries, they are loaded from the
+// context once; without them shaders are loaded by raylib, uncached and
+// unwatched.
+
+#define SHADER_CACHE_MAGIC "VELASHD1"
+#define SHADER_WATCH_POLL_US 250000  // Interval the watcher rereads the sources at
+
+// GL enums used here, rlgl doesn't export them
+#define _SHADER_CACHE_COMPILE_STATUS 0x8B81
+#define _SHADER_CACHE_LINK_STATUS 0x8B82
+#define _SHADER_CACHE_INFO_LOG_LENGTH 0x8B84
+#define _SHADER_CACHE_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define _SHADER_CACHE_PROGRAM_BINARY_LENGTH 0x8741
+#define _SHADER_CACHE_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#define _SHADER_CACHE_COMPLETION_STATUS 0x91B1
+#define _SHADER_CACHE_VENDOR 0x1F00
+#define _SHADER_CACHE_RENDERER 0x1F01
+#define _SHADER_CACHE_VERSION 0x1F02
+
+// raylib compiles fragment shaders without a vertex shader against this one
+static const char *_shader_cache_default_vs =
+	"#version 330\n"
+	"in vec3 vertexPosition;\n"
+	"in vec2 vertexTexCoord;\n"
+	"in vec4 vertexColor;\n"
+	"out vec2 fragTexCoord;\n"
+	"out vec4 fragColor;\n"
+	"uniform mat4 mvp;\n"
+	"void main()\n"
+	"{\n"
+	"    fragTexCoord = vertexTexCoord;\n"
+	"    fragColor = vertexColor;\n"
+	"    gl_Position = mvp*vec4(vertexPosition, 1.0);\n"
+	"}\n";
+
+typedef struct {
+	char magic[8];
+	uint64_t key;
+	uint32_t format;   // Binary format of the driver
+	uint32_t size;     // Bytes of binary after the header
+} ShaderCacheHeader;
+
+// A program being compiled and linked
+typedef struct {
+	unsigned int program, vs, fs; // 0 when nothing is being built
+	uint64_t key;
+} ShaderBuild;
+
+typedef struct {
+	Shader shader;
+	char *vs_path;               // NULL for the raylib default vertex shader
+	char *fs_path;
+	ShaderBuild build;           // Edited sources being compiled
+	// Shared with the watcher
+	pthread_t watcher;
+	int watching;                // The watcher thread is running
+	atomic_int stop;
+	pthread_mutex_t lock;
+	char *vs_source, *fs_source; // Changed sources not picked up yet, under lock
+	uint64_t source_key;         // Hash of the sources last seen by the watcher
+} ShaderProgram;
+
+static struct {
+	int loaded;   // 1 when the entry points are loaded, -1 when they are unavailable
+	int binaries; // The driver has program binary formats
+	int parallel; // The driver compiles in the background and reports completion
+	uint64_t driver_key;
+	char dir[512]; // Cache directory, empty when binaries aren't saved
+	unsigned int (*create_shader)(unsigned int type);
+	void (*shader_source)(unsigned int shader, int count, const char *const *strings, const int *lengths);
+	void (*compile_shader)(unsigned int shader);
+	void (*get_shaderiv)(unsigned int shader, unsigned int name, int *params);
+	void (*get_shader_info_log)(unsigned int shader, int size, int *length, char *log);
+	void (*delete_shader)(unsigned int shader);
+	unsigned int (*create_program)(void);
+	void (*attach_shader)(unsigned int program, unsigned int shader);
+	void (*detach_shader)(unsigned int program, unsigned int shader);
+	void (*bind_attrib_location)(unsigned int program, unsigned int index, const char *name);
+	void (*link_program)(unsigned int program);
+	void (*get_programiv)(unsigned int program, unsigned int name, int *params);
+	void (*get_program_info_log)(unsigned int program, int size, int *length, char *log);
+	void (*delete_program)(unsigned int program);
+	void (*program_parameteri)(unsigned int program, unsigned int name, int value);
+	void (*get_program_binary)(unsigned int program, int size, int *length, unsigned int *format, void *binary);
+	void (*program_binary)(unsigned int program, unsigned int format, const void *binary, int length);
+	const unsigned char* (*get_string)(unsigned int name);
+	void (*get_integerv)(unsigned int name, int *params);
+	void (*max_shader_compiler_threads)(unsigned int count);
+} _shader_cache_gl;
+
+#define _SHADER_CACHE_LOAD(field, name) (*(void **)&_shader_cache_gl.field = (void *)gl_proc_address(name))
+#define _SHADER_CACHE_EXTENSION(name) gl_extension_supported(name)
+
+// FNV-1a of a string, continuing from `hash`
+static uint64_t _shader_cache_hash(uint64_t hash, const char *text) {
+	for (const unsigned char *c = (const unsigned char *)text; *c != '\0'; c++) {
+		hash = (hash ^ *c) * 0x100000001b3ull;
+	}
+	return (hash ^ 0xff) * 0x100000001b3ull; // Separates consecutive strings
+}
+
+static uint64_t _shader_cache_source_key(const char *vs, const char *fs) {
+	return _shader_cache_hash(_shader_cache_hash(0xcbf29ce484222325ull, vs), fs);
+}
+
+// Pick the cache directory under $XDG_CACHE_HOME or ~/.cache and create it
+static void _shader_cache_dir() {
+	const char *base = getenv("XDG_CACHE_HOME");
+	const char *suffix = "";
+	if (base == NULL || base[0] == '\0') {
+		base = getenv("HOME");
+		suffix = "/.cache";
+	}
+	if (base == NULL || base[0] == '\0') return;
+	char *dir = _shader_cache_gl.dir;
+	int length = snprintf(dir, sizeof(_shader_cache_gl.dir), "%s%s/vela/shaders", base, suffix);
+	if (length < 0 || (size_t)length >= sizeof(_shader_cache_gl.dir)) {
+		dir[0] = '\0';
+		return;
+	}
+	// Create every missing level
+	for (char *c = dir + 1; ; c++) {
+		if (*c != '/' && *c != '\0') continue;
+		char end = *c;
+		*c = '\0';
+		int result = mkdir(dir, 0755);
+		*c = end;
+		if (result != 0 && errno != EEXIST) {
+			printf("Warning: Failed to create the shader cache %s, shaders are compiled every start\n", dir);
+			dir[0] = '\0';
+			return;
+		}
+		if (end == '\0') break;
+	}
+}
+
+// Load the shader and program binary entry points once a context exists, 0 if programs can be built here
+int shader_cache_load() {
+	if (_shader_cache_gl.loaded != 0) return _shader_cache_gl.loaded > 0 ? 0 : -1;
+	int loaded = _SHADER_CACHE_LOAD(create_shader, "glCreateShader") != NULL;
+	loaded &= _SHADER_CACHE_LOAD(shader_source, "glShaderSource") != NULL;
+	loaded &= _SHADER_CACHE_LOAD(compile_shader, "glCompileShader") != NULL;
+	loaded &= _SHADER_CACHE_LOAD(get_shaderiv, "glGetShaderiv") != NULL;
+	loaded &= _SHADER_CACHE_LOAD(get_shader_info_log, "glGetShaderInfoLog") != NULL;
+	loaded &= _SHADER_CACHE_LOAD(delete_shader, "glDeleteShader") != NULL;
+	loaded &= _SHADER_CACHE_LOAD(create_program, "glCreateProgram") != NULL;
+	loaded &= _SHADER_CACHE_LOAD(attach_shader, "glAttachShader") != NULL;
+	loaded &= _SHADER_CACHE_LOAD(detach_shader, "glDetachShader") != NULL;
+	loaded &= _SHADER_CACHE_LOAD(bind_attrib_location, "glBindAttribLocation") != NULL;
+	loaded &= _SHADER_CACHE_LOAD(link_program, "glLinkProgram") != NULL;
+	loaded &= _SHADER_CACHE_LOAD(get_programiv, "glGetProgramiv") != NULL;
+	loaded &= _SHADER_CACHE_LOAD(get_program_info_log, "glGetProgramInfoLog") != NULL;
+	loaded &= _SHADER_CACHE_LOAD(delete_program, "glDeleteProgram") != NULL;
+	loaded &= _SHADER_CACHE_LOAD(get_string, "glGetString") != NULL;
+	loaded &= _SHADER_CACHE_LOAD(get_integerv, "glGetIntegerv") != NULL;
+	_shader_cache_gl.loaded = loaded ? 1 : -1;
+	if (!loaded) {
+		printf("Warning: Shader entry points are unavailable, shaders are compiled by raylib without caching or reloading\n");
+		return -1;
+	}
+
+	// Binaries are optional, programs are then compiled every start
+	int binaries = _SHADER_CACHE_LOAD(program_parameteri, "glProgramParameteri") != NULL;
+	binaries &= _SHADER_CACHE_LOAD(get_program_binary, "glGetProgramBinary") != NULL;
+	binaries &= _SHADER_CACHE_LOAD(program_binary, "glProgramBinary") != NULL;
+	int formats = 0;
+	if (binaries) {
+		_shader_cache_gl.get_integerv(_SHADER_CACHE_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	}
+	_shader_cache_gl.binaries = binaries && formats > 0;
+	if (_shader_cache_gl.binaries) {
+		const char *strings[3] = {
+			(const char *)_shader_cache_gl.get_string(_SHADER_CACHE_VENDOR),
+			(const char *)_shader_cache_gl.get_string(_SHADER_CACHE_RENDERER),
+			(const char *)_shader_cache_gl.get_string(_SHADER_CACHE_VERSION)
+		};
+		uint64_t key = 0xcbf29ce484222325ull;
+		for (int i = 0; i < 3; i++) {
+			key = _shader_cache_hash(key, strings[i] != NULL ? strings[i] : "");
+		}
+		_shader_cache_gl.driver_key = key;
+		_shader_cache_dir();
+	} else {
+		printf("Warning: The driver has no program binary formats, shaders are compiled every start\n");
+	}
+
+	if (_SHADER_CACHE_EXTENSION("GL_KHR_parallel_shader_compile")) {
+		_SHADER_CACHE_LOAD(max_shader_compiler_threads, "glMaxShaderCompilerThreadsKHR");
+	} else if (_SHADER_CACHE_EXTENSION("GL_ARB_parallel_shader_compile")) {
+		_SHADER_CACHE_LOAD(max_shader_compiler_threads, "glMaxShaderCompilerThreadsARB");
+	}
+	if (_shader_cache_gl.max_shader_compiler_threads != NULL) {
+		_shader_cache_gl.max_shader_compiler_threads(0xFFFFFFFFu); // As many threads as the driver likes
+		_shader_cache_gl.parallel = 1;
+	}
+	return 0;
+}
+
+// Read a whole text file, NULL if it can't be read
+static char* _shader_cache_read(const char *path) {
+	FILE *file = fopen(path, "rb");
+	if (file == NULL) return NULL;
+	char *text = NULL;
+	long size = -1;
+	if (fseek(file, 0, SEEK_END) == 0 && (size = ftell(file)) >= 0 && fseek(file, 0, SEEK_SET) == 0) {
+		text = (char *)malloc((size_t)size + 1);
+	}
+	if (text != NULL) {
+		size_t read = fread(text, 1, (size_t)size, file);
+		text[read] = '\0';
+	}
+	fclose(file);
+	return text;
+}
+
+static void _shader_cache_path(char *path, size_t size, uint64_t key) {
+	snprintf(path, size, "%s/%016llx.bin", _shader_cache_gl.dir, (unsigned long long)key);
+}
+
+static uint64_t _shader_cache_key(const char *vs, const char *fs) {
+	return _shader_cache_source_key(vs, fs) ^ _shader_cache_gl.driver_key;
+}
+
+// Program loaded from the binary saved for `key`, 0 if there is none or the driver rejects it
+static unsigned int _shader_cache_load_binary(uint64_t key) {
+	if (!_shader_cache_gl.binaries || _shader_cache_gl.dir[0] == '\0') return 0;
+	char path[600];
+	_shader_cache_path(path, sizeof(path), key);
+	FILE *file = fopen(path, "rb");
+	if (file == NULL) return 0;
+	ShaderCacheHeader header;
+	void *binary = NULL;
+	if (fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, SHADER_CACHE_MAGIC, 8) == 0 &&
+			header.key == key && header.size > 0) {
+		binary = malloc(header.size);
+		if (binary != NULL && fread(binary, 1, header.size, file) != header.size) {
+			free(binary);
+			binary = NULL;
+		}
+	}
+	fclose(file);
+	if (binary == NULL) return 0;
+
+	unsigned int program = _shader_cache_gl.create_program();
+	_shader_cache_gl.program_binary(program, header.format, binary, (int)header.size);
+	free(binary);
+	int linked = 0;
+	_shader_cache_gl.get_programiv(program, _SHADER_CACHE_LINK_STATUS, &linked);
+	if (!linked) {
+		printf("Shader cache: %s was rejected by the driver, compiling again\n", path);
+		_shader_cache_gl.delete_program(program);
+		return 0;
+	}
+	return program;
+}
+
+// Save the binary of a linked program under `key`, written aside and renamed so readers never see half a file
+static void _shader_cache_save_binary(unsigned int program, uint64_t key) {
+	if (!_shader_cache_gl.binaries || _shader_cache_gl.dir[0] == '\0') return;
+	int size = 0;
+	_shader_cache_gl.get_programiv(program, _SHADER_CACHE_PROGRAM_BINARY_LENGTH, &size);
+	if (size <= 0) return;
+	void *binary = malloc((size_t)size);
+	if (binary == NULL) return;
+	ShaderCacheHeader header;
+	memcpy(header.magic, SHADER_CACHE_MAGIC, 8);
+	header.key = key;
+	header.format = 0;
+	int length = 0;
+	_shader_cache_gl.get_program_binary(program, size, &length, &header.format, binary);
+	header.size = (uint32_t)length;
+
+	char path[600], temporary[620];
+	_shader_cache_path(path, sizeof(path), key);
+	snprintf(temporary, sizeof(temporary), "%s.%d", path, (int)getpid());
+	FILE *file = fopen(temporary, "wb");
+	int written = file != NULL && length > 0 && fwrite(&header, sizeof(header), 1, file) == 1 &&
+		fwrite(binary, 1, (size_t)length, file) == (size_t)length;
+	if (file != NULL && fclose(file) != 0) written = 0;
+	if (!written || rename(temporary, path) != 0) {
+		printf("Warning: Failed to save the shader binary %s\n", path);
+		remove(temporary);
+	}
+	free(binary);
+}
+
+static unsigned int _shader_cache_compile(const char *source, unsigned int type) {
+	unsigned int shader = _shader_cache_gl.create_shader(type);
+	_shader_cache_gl.shader_source(shader, 1, &source, NULL);
+	_shader_cache_gl.compile_shader(shader);
+	return shader;
+}
+
+// Start compiling and linking, nothing waits for the driver until _shader_build_finish
+static ShaderBuild _shader_build_start(const char *vs, const char *fs) {
+	ShaderBuild build;
+	build.key = _shader_cache_key(vs, fs);
+	build.vs = _shader_cache_compile(vs, RL_VERTEX_SHADER);
+	build.fs = _shader_cache_compile(fs, RL_FRAGMENT_SHADER);
+	build.program = _shader_cache_gl.create_program();
+	_shader_cache_gl.attach_shader(build.program, build.vs);
+	_shader_cache_gl.attach_shader(build.program, build.fs);
+	// The attribute locations rlgl binds, its batches feed them
+	_shader_cache_gl.bind_attrib_location(build.program, RL_DEFAULT_SHADER_ATTRIB_LOCATION_POSITION, RL_DEFAULT_SHADER_ATTRIB_NAME_POSITION);
+	_shader_cache_gl.bind_attrib_location(build.program, RL_DEFAULT_SHADER_ATTRIB_LOCATION_TEXCOORD, RL_DEFAULT_SHADER_ATTRIB_NAME_TEXCOORD);
+	_shader_cache_gl.bind_attrib_location(build.program, RL_DEFAULT_SHADER_ATTRIB_LOCATION_NORMAL, RL_DEFAULT_SHADER_ATTRIB_NAME_NORMAL);
+	_shader_cache_gl.bind_attrib_location(build.program, RL_DEFAULT_SHADER_ATTRIB_LOCATION_COLOR, RL_DEFAULT_SHADER_ATTRIB_NAME_COLOR);
+	_shader_cache_gl.bind_attrib_location(build.program, RL_DEFAULT_SHADER_ATTRIB_LOCATION_TANGENT, RL_DEFAULT_SHADER_ATTRIB_NAME_TANGENT);
+	_shader_cache_gl.bind_attrib_location(build.program, RL_DEFAULT_SHADER_ATTRIB_LOCATION_TEXCOORD2, RL_DEFAULT_SHADER_ATTRIB_NAME_TEXCOORD2);
+	if (_shader_cache_gl.binaries) {
+		_shader_cache_gl.program_parameteri(build.program, _SHADER_CACHE_PROGRAM_BINARY_RETRIEVABLE_HINT, 1);
+	}
+	_shader_cache_gl.link_program(build.program);
+	return build;
+}
+
+// The driver is done with the build, asking for its status won't block. Only known with the parallel compile extension
+static int _shader_build_ready(ShaderBuild *build) {
+	int complete = 0;
+	_shader_cache_gl.get_programiv(build->program, _SHADER_CACHE_COMPLETION_STATUS, &complete);
+	return complete;
+}
+
+static void _shader_build_log(unsigned int object, int program, const char *what) {
+	int length = 0;
+	(program ? _shader_cache_gl.get_programiv : _shader_cache_gl.get_shaderiv)(object, _SHADER_CACHE_INFO_LOG_LENGTH, &length);
+	char *log = length > 0 ? (char *)malloc((size_t)length) : NULL;
+	if (log != NULL) {
+		(program ? _shader_cache_gl.get_program_info_log : _shader_cache_gl.get_shader_info_log)(object, length, NULL, log);
+	}
+	printf("Error: Failed to %s\n%s\n", what, log != NULL ? log : "");
+	free(log);
+}
+
+// Wait for the build, save its binary and return the linked program, 0 if it didn't compile or link
+static unsigned int _shader_build_finish(ShaderBuild *build, const char *name) {
+	unsigned int program = build->program;
+	int status = 0;
+	_shader_cache_gl.get_programiv(program, _SHADER_CACHE_LINK_STATUS, &status);
+	if (!status) {
+		// The compile errors say more than the link error
+		int compiled = 0;
+		_shader_cache_gl.get_shaderiv(build->vs, _SHADER_CACHE_COMPILE_STATUS, &compiled);
+		if (!compiled) _shader_build_log(build->vs, 0, TextFormat("compile the vertex shader of %s", name));
+		_shader_cache_gl.get_shaderiv(build->fs, _SHADER_CACHE_COMPILE_STATUS, &compiled);
+		if (!compiled) _shader_build_log(build->fs, 0, TextFormat("compile the fragment shader of %s", name));
+		_shader_build_log(program, 1, TextFormat("link %s", name));
+	}
+	_shader_cache_gl.detach_shader(program, build->vs);
+	_shader_cache_gl.detach_shader(program, build->fs);
+	_shader_cache_gl.delete_shader(build->vs);
+	_shader_cache_gl.delete_shader(build->fs);
+	if (status) {
+		_shader_cache_save_binary(program, build->key);
+	} else {
+		_shader_cache_gl.delete_program(program);
+		program = 0;
+	}
+	memset(build, 0, sizeof(*build));
+	return program;
+}
+
+// raylib shader of a linked program, with the locations raylib looks up when it loads one
+static Shader _shader_cache_shader(unsigned int program) {
+	Shader shader;
+	shader.id = program;
+	shader.locs = (int *)calloc(RL_MAX_SHADER_LOCATIONS, sizeof(int));
+	if (shader.locs == NULL) {
+		printf("Error: Failed to allocate memory for the shader locations\n");
+		_shader_cache_gl.delete_program(program);
+		shader.id = 0;
+		return shader;
+	}
+	for (int i = 0; i < RL_MAX_SHADER_LOCATIONS; i++) {
+		shader.locs[i] = -1;
+	}
+	shader.locs[SHADER_LOC_VERTEX_POSITION] = rlGetLocationAttrib(program, RL_DEFAULT_SHADER_ATTRIB_NAME_POSITION);
+	shader.locs[SHADER_LOC_VERTEX_TEXCOORD01] = rlGetLocationAttrib(program, RL_DEFAULT_SHADER_ATTRIB_NAME_TEXCOORD);
+	shader.locs[SHADER_LOC_VERTEX_TEXCOORD02] = rlGetLocationAttrib(program, RL_DEFAULT_SHADER_ATTRIB_NAME_TEXCOORD2);
+	shader.locs[SHADER_LOC_VERTEX_NORMAL] = rlGetLocationAttrib(program, RL_DEFAULT_SHADER_ATTRIB_NAME_NORMAL);
+	shader.locs[SHADER_LOC_VERTEX_TANGENT] = rlGetLocationAttrib(program, RL_DEFAULT_SHADER_ATTRIB_NAME_TANGENT);
+	shader.locs[SHADER_LOC_VERTEX_COLOR] = rlGetLocationAttrib(program, RL_DEFAULT_SHADER_ATTRIB_NAME_COLOR);
+	shader.locs[SHADER_LOC_MATRIX_MVP] = rlGetLocationUniform(program, RL_DEFAULT_SHADER_UNIFORM_NAME_MVP);
+	shader.locs[SHADER_LOC_MATRIX_VIEW] = rlGetLocationUniform(program, RL_DEFAULT_SHADER_UNIFORM_NAME_VIEW);
+	shader.locs[SHADER_LOC_MATRIX_PROJECTION] = rlGetLocationUniform(program, RL_DEFAULT_SHADER_UNIFORM_NAME_PROJECTION);
+	shader.locs[SHADER_LOC_MATRIX_MODEL] = rlGetLocationUniform(program, RL_DEFAULT_SHADER_UNIFORM_NAME_MODEL);
+	shader.locs[SHADER_LOC_MATRIX_NORMAL] = rlGetLocationUniform(program, RL_DEFAULT_SHADER_UNIFORM_NAME_NORMAL);
+	shader.locs[SHADER_LOC_COLOR_DIFFUSE] = rlGetLocationUniform(program, RL_DEFAULT_SHADER_UNIFORM_NAME_COLOR);
+	shader.locs[SHADER_LOC_MAP_DIFFUSE] = rlGetLocationUniform(program, RL_DEFAULT_SHADER_SAMPLER2D_NAME_TEXTURE0);
+	shader.locs[SHADER_LOC_MAP_SPECULAR] = rlGetLocationUniform(program, RL_DEFAULT_SHADER_SAMPLER2D_NAME_TEXTURE1);
+	shader.locs[SHADER_LOC_MAP_NORMAL] = rlGetLocationUniform(program, RL_DEFAULT_SHADER_SAMPLER2D_NAME_TEXTURE2);
+	return shader;
+}
+
+// Program of the sources from the cache, or compiled and linked now. 0 on failure
+static unsigned int _shader_cache_build(const char *vs, const char *fs, const char *name) {
+	unsigned int program = _shader_cache_load_binary(_shader_cache_key(vs, fs));
+	if (program != 0) return program;
+	ShaderBuild build = _shader_build_start(vs, fs);
+	return _shader_build_finish(&build, name);
+}
+
+// Like LoadShader, from the cache when the sources were built before. A NULL vertex shader is the raylib default
+Shader load_cached_shader(const char *vs_path, const char *fs_path) {
+	if (shader_cache_load() != 0) return LoadShader(vs_path, fs_path);
+	char *vs = vs_path != NULL ? _shader_cache_read(vs_path) : NULL;
+	char *fs = _shader_cache_read(fs_path);
+	if ((vs_path != NULL && vs == NULL) || fs == NULL) {
+		printf("Error: Failed to read the shader %s\n", vs_path != NULL && vs == NULL ? vs_path : fs_path);
+		free(vs);
+		free(fs);
+		return LoadShader(vs_path, fs_path); // Reports and falls back to the default shader like before
+	}
+	unsigned int program = _shader_cache_build(vs != NULL ? vs : _shader_cache_default_vs, fs, fs_path);
+	free(vs);
+	free(fs);
+	if (program == 0) {
+		Shader shader = {rlGetShaderIdDefault(), rlGetShaderLocsDefault()};
+		return shader;
+	}
+	return _shader_cache_shader(program);
+}
+
+// Reread the sources every SHADER_WATCH_POLL_US and pass them on when they changed
+static void* _shader_program_watch(void *arg) {
+	ShaderProgram *program = (ShaderProgram *)arg;
+	while (!atomic_load(&program->stop)) {
+		usleep(SHADER_WATCH_POLL_US);
+		char *vs = program->vs_path != NULL ? _shader_cache_read(program->vs_path) : NULL;
+		char *fs = _shader_cache_read(program->fs_path);
+		// Editors replace files by renaming, a source may be missing for a moment
+		if ((program->vs_path == NULL || vs != NULL) && fs != NULL) {
+			uint64_t key = _shader_cache_source_key(vs != NULL ? vs : "", fs);
+			pthread_mutex_lock(&program->lock);
+			if (key != program->source_key) {
+				program->source_key = key;
+				free(program->vs_source);
+				free(program->fs_source);
+				program->vs_source = vs;
+				program->fs_source = fs;
+				vs = fs = NULL;
+			}
+			pthread_mutex_unlock(&program->lock);
+		}
+		free(vs);
+		free(fs);
+	}
+	return NULL;
+}
+
+// Load a shader like load_cached_shader and watch its sources, NULL on failure
+ShaderProgram* create_shader_program(const char *vs_path, const char *fs_path) {
+	ShaderProgram *program = (ShaderProgram *)calloc(1, sizeof(ShaderProgram));
+	if (program == NULL) {
+		printf("Error: Failed to allocate memory for the shader program\n");
+		return NULL;
+	}
+	program->vs_path = vs_path != NULL ? strdup(vs_path) : NULL;
+	program->fs_path = strdup(fs_path);
+	if ((vs_path != NULL && program->vs_path == NULL) || program->fs_path == NULL) {
+		printf("Error: Failed to allocate memory for the shader program\n");
+		free(program->vs_path);
+		free(program->fs_path);
+		free(program);
+		return NULL;
+	}
+	program->shader = load_cached_shader(vs_path, fs_path);
+	if (shader_cache_load() != 0) return program; // Loaded by raylib, nothing to build reloads with
+
+	// The watcher starts from the sources just loaded, so only edits are passed on
+	char *vs = vs_path != NULL ? _shader_cache_read(vs_path) : NULL;
+	char *fs = _shader_cache_read(fs_path);
+	program->source_key = _shader_cache_source_key(vs != NULL ? vs : "", fs != NULL ? fs : "");
+	free(vs);
+	free(fs);
+	pthread_mutex_init(&program->lock, NULL);
+	atomic_store(&program->stop, 0);
+	if (pthread_create(&program->watcher, NULL, _shader_program_watch, program) != 0) {
+		printf("Warning: Failed to start watching %s, edits need a restart\n", fs_path);
+		pthread_mutex_destroy(&program->lock);
+		return program;
+	}
+	program->watching = 1;
+	return program;
+}
+
+void destroy_shader_program(ShaderProgram *program) {
+	if (program == NULL) return;
+	if (program->watching) {
+		atomic_store(&program->stop, 1);
+		pthread_join(program->watcher, NULL);
+		pthread_mutex_destroy(&program->lock);
+	}
+	if (program->build.program != 0) {
+		// Dropped unfinished, deleting the objects doesn't wait for the driver
+		_shader_cache_gl.delete_shader(program->build.vs);
+		_shader_cache_gl.delete_shader(program->build.fs);
+		_shader_cache_gl.delete_program(program->build.program);
+	}
+	UnloadShader(program->shader);
+	free(program->vs_source);
+	free(program->fs_source);
+	free(program->vs_path);
+	free(program->fs_path);
+	free(program);
+}
+
+// Replace the shader with a linked program
+static void _shader_program_swap(ShaderProgram *program, unsigned int id) {
+	Shader shader = _shader_cache_shader(id);
+	if (shader.id == 0) return;
+	UnloadShader(program->shader);
+	program->shader = shader;
+	printf("Shader: Reloaded %s\n", program->fs_path);
+}
+
+// Finish the build and swap its program in, the running one stays when it didn't link. 1 when the shader was replaced
+static int _shader_program_finish(ShaderProgram *program) {
+	unsigned int id = _shader_build_finish(&program->build, program->fs_path);
+	if (id == 0) {
+		printf("Shader: Keeping the running %s\n", program->fs_path);
+		return 0;
+	}
+	_shader_program_swap(program, id);
+	return 1;
+}
+
+// Pick up edited sources and finish their build, once per frame. 1 when the shader was replaced: its locations,
+// uniforms, samplers and blocks are those of a new program and need to be set again
+int shader_program_update(ShaderProgram *program) {
+	if (!program->watching) return 0;
+	if (program->build.program != 0) {
+		// Edits made during a build wait for it to finish
+		if (!_shader_build_ready(&program->build)) return 0;
+		return _shader_program_finish(program);
+	}
+
+	if (pthread_mutex_trylock(&program->lock) != 0) return 0; // The watcher is handing sources over, next frame
+	char *vs = program->vs_source;
+	char *fs = program->fs_source;
+	program->vs_source = program->fs_source = NULL;
+	pthread_mutex_unlock(&program->lock);
+	if (fs == NULL) return 0;
+
+	const char *vertex = vs != NULL ? vs : _shader_cache_default_vs;
+	unsigned int id = _shader_cache_load_binary(_shader_cache_key(vertex, fs));
+	if (id == 0) {
+		program->build = _shader_build_start(vertex, fs);
+	}
+	free(vs);
+	free(fs);
+	if (id == 0) {
+		if (_shader_cache_gl.parallel) return 0; // Finished once the driver reports it done
+		// Without the extension asking for the link status waits for the driver, the running program stays if it fails
+		printf("Shader: Compiling %s blocks this frame, the driver has no parallel shader compile\n", program->fs_path);
+		return _shader_program_finish(program);
+	}
+	_shader_program_swap(program, id);
+	return 1;
+}
+#endif // SHADER_CACHE_H
@@ -0,0 +1,128 @@
+#ifndef SNAPSHOT_INTERPOLATOR_H
+#define SNAPSHOT_INTERPOLATOR_H
+#include <float.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "audio_analysis.h"
+
+// Interpolation of analysis snapshots for the display clock.
+// The analysis publishes a hop whenever enough audio arrived, the renderer
+// draws at the refresh rate; without anything in between the frames repeat
+// or skip hops. The interpolator keeps the two newest hops with the time
+// their audio was captured and blends them for the time a frame is expected
+// on screen, shifted back by the delay a hop takes to reach the renderer
+// plus one hop interval. The frame drawn when a hop arrives then starts from
+// the previous one and reaches it as the next is due, the motion follows the
+// capture clock instead of the arrival jitter. A late hop is extrapolated for
+// at most SNAPSHOT_MAX_EXTRAPOLATION of an interval, then held.
+// Levels, pitch bins, tones, stereo correlation and balance and loudness are
+// blended; the waveform, the stereo delay and the history are the newest.
+
+#define SNAPSHOT_MAX_EXTRAPOLATION 0.25 // Share of a hop interval a late hop is extrapolated for
+#define SNAPSHOT_SMOOTHING 0.1          // Weight of a new hop in the smoothed interval and delay
+
+typedef struct {
+	AnalysisSnapshot *hops[2]; // Previous and newest hop, without waveforms
+	int newest;                // Index of the newest hop in hops
+	int count;                 // Hops received, up to 2
+	double interval;           // Smoothed nanoseconds between the captures of two hops
+	double delay;              // Smoothed nanoseconds from the capture of a hop to the renderer
+} SnapshotInterpolator;
+
+// Create an interpolator for snapshots of this layout, NULL on failure
+SnapshotInterpolator* create_snapshot_interpolator(const AnalysisSnapshot *layout) {
+	SnapshotInterpolator *interpolator = (SnapshotInterpolator *)calloc(1, sizeof(SnapshotInterpolator));
+	if (interpolator == NULL) {
+		printf("Error: Failed to allocate memory for the snapshot interpolator\n");
+		return NULL;
+	}
+	for (int i = 0; i < 2; i++) {
+		interpolator->hops[i] = init_analysis_snapshot(layout->channels, layout->num_bins, layout->num_tones, 0);
+		if (interpolator->hops[i] == NULL) {
+			free_analysis_snapshot(interpolator->hops[0]);
+			free(interpolator);
+			return NULL;
+		}
+	}
+	return interpolator;
+}
+
+void destroy_snapshot_interpolator(SnapshotInterpolator *interpolator) {
+	if (interpolator == NULL) return;
+	free_analysis_snapshot(interpolator->hops[0]);
+	free_analysis_snapshot(interpolator->hops[1]);
+	free(interpolator);
+}
+
+// Keep a snapshot taken at `now` when it holds a new hop, 1 if it did
+int snapshot_interpolator_push(SnapshotInterpolator *interpolator, const AnalysisSnapshot *snapshot, uint64_t now) {
+	AnalysisSnapshot *newest = interpolator->hops[interpolator->newest];
+	if (snapshot->capture_time == 0 || (interpolator->count > 0 && snapshot->frame == newest->frame)) return 0;
+	if (interpolator->count > 0 && snapshot->capture_time > newest->capture_time) {
+		double interval = (double)(snapshot->capture_time - newest->capture_time);
+		interpolator->interval = interpolator->count > 1 ? interpolator->interval + SNAPSHOT_SMOOTHING * (interval - interpolator->interval) : interval;
+	}
+	double delay = now > snapshot->capture_time ? (double)(now - snapshot->capture_time) : 0.0;
+	interpolator->delay = interpolator->count > 0 ? interpolator->delay + SNAPSHOT_SMOOTHING * (delay - interpolator->delay) : delay;
+
+	interpolator->newest ^= 1;
+	AnalysisSnapshot *hop = interpolator->hops[interpolator->newest];
+	size_t channels = snapshot->channels < hop->channels ? snapshot->channels : hop->channels;
+	size_t num_bins = snapshot->num_bins < hop->num_bins ? snapshot->num_bins : hop->num_bins;
+	size_t num_tones = snapshot->num_tones < hop->num_tones ? snapshot->num_tones : hop->num_tones;
+	hop->outputs = snapshot->outputs;
+	hop->frame = snapshot->frame;
+	hop->capture_time = snapshot->capture_time;
+	memcpy(hop->norm_avg, snapshot->norm_avg, sizeof(float) * channels);
+	memcpy(hop->stereo, snapshot->stereo, sizeof(hop->stereo));
+	memcpy(hop->loudness, snapshot->loudness, sizeof(hop->loudness));
+	for (size_t i = 0; i < channels; i++) {
+		memcpy(hop->pitch + i * hop->num_bins, snapshot->pitch + i * snapshot->num_bins, sizeof(float) * num_bins);
+		memcpy(hop->tones + i * hop->num_tones, snapshot->tones + i * snapshot->num_tones, sizeof(float) * num_tones);
+	}
+	if (interpolator->count < 2) interpolator->count++;
+	return 1;
+}
+
+// Blend factor of the newest hop for a frame presented at `present`, 1 draws it as it is
+double snapshot_interpolator_weight(const SnapshotInterpolator *interpolator, uint64_t present) {
+	if (interpolator->count < 2 || interpolator->interval <= 0.0) return 1.0;
+	const AnalysisSnapshot *previous = interpolator->hops[interpolator->newest ^ 1];
+	double span = (double)(interpolator->hops[interpolator->newest]->capture_time - previous->capture_time);
+	if (span <= 0.0) return 1.0;
+	// Audio time on screen at `present`
+	double time = (double)present - interpolator->delay - interpolator->interval;
+	double weight = (time - (double)previous->capture_time) / span;
+	return weight < 0.0 ? 0.0 : weight > 1.0 + SNAPSHOT_MAX_EXTRAPOLATION ? 1.0 + SNAPSHOT_MAX_EXTRAPOLATION : weight;
+}
+
+// Extrapolated values stay in the range of their field, magnitudes don't cross zero
+static inline void _snapshot_blend(float *out, const float *from, const float *to, size_t count, float weight, float low, float high) {
+	for (size_t j = 0; j < count; j++) {
+		float value = from[j] + weight * (to[j] - from[j]);
+		out[j] = value < low ? low : value > high ? high : value;
+	}
+}
+
+// Replace the blended fields of a snapshot of the newest hop with their values at `present`
+void snapshot_interpolator_apply(const SnapshotInterpolator *interpolator, AnalysisSnapshot *snapshot, uint64_t present) {
+	double weight = snapshot_interpolator_weight(interpolator, present);
+	if (weight == 1.0) return; // The snapshot already holds the newest hop
+	const AnalysisSnapshot *from = interpolator->hops[interpolator->newest ^ 1];
+	const AnalysisSnapshot *to = interpolator->hops[interpolator->newest];
+	if (snapshot->frame != to->frame) return; // Not the newest hop, nothing to blend it with
+	size_t channels = snapshot->channels < to->channels ? snapshot->channels : to->channels;
+	size_t num_bins = snapshot->num_bins < to->num_bins ? snapshot->num_bins : to->num_bins;
+	size_t num_tones = snapshot->num_tones < to->num_tones ? snapshot->num_tones : to->num_tones;
+	float w = (float)weight;
+	_snapshot_blend(snapshot->norm_avg, from->norm_avg, to->norm_avg, channels, w, -1.0f, 1.0f); // signed mean of the samples
+	for (size_t i = 0; i < channels; i++) {
+		_snapshot_blend(snapshot->pitch + i * snapshot->num_bins, from->pitch + i * from->num_bins, to->pitch + i * to->num_bins, num_bins, w, 0.0f, FLT_MAX);
+		_snapshot_blend(snapshot->tones + i * snapshot->num_tones, from->tones + i * from->num_tones, to->tones + i * to->num_tones, num_tones, w, 0.0f, FLT_MAX);
+	}
+	_snapshot_blend(snapshot->stereo, from->stereo, to->stereo, 2, w, -1.0f, 1.0f); // correlation and balance
+	_snapshot_blend(snapshot->loudness, from->loudness, to->loudness, 4, w, LOUDNESS_FLOOR, FLT_MAX);
+}
+#endif // SNAPSHOT_INTERPOLATOR_H
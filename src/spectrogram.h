@@ -0,0 +1,71 @@
+#ifndef SPECTROGRAM_H
+#define SPECTROGRAM_H
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "arena.h"
+
+// Spectrogram history: a ring of `rows` band rows per channel.
+// The analysis writes the row of the current hop for every channel, then
+// publishes it by bumping `written`. Readers compare `written` with the count
+// they already consumed, so a renderer only uploads the rows added since its
+// last frame. Rows are floats so they can be uploaded to an R32 texture as is.
+
+#define SPECTROGRAM_DEFAULT_ROWS 256
+
+typedef struct {
+	size_t num_bins;      // Bands per row
+	size_t rows;          // Rows kept per channel
+	size_t channels;
+	float *data;          // [channels][rows][num_bins], laid out as one texture of channels * rows lines
+	atomic_ulong written; // Rows published since init, the newest one is (written - 1) % rows
+} Spectrogram;
+
+// Bytes taken in an arena by init_spectrogram
+size_t spectrogram_arena_size(size_t channels, size_t num_bins, size_t rows) {
+	return arena_size(sizeof(Spectrogram)) + arena_size(sizeof(float) * channels * rows * num_bins);
+}
+
+// Initialize a spectrogram history, it is released with the arena
+Spectrogram* init_spectrogram(Arena *arena, size_t channels, size_t num_bins, size_t rows) {
+	if (channels == 0 || num_bins == 0 || rows == 0) {
+		printf("Error: Invalid spectrogram configuration\n");
+		return NULL;
+	}
+
+	Spectrogram *sg = (Spectrogram*)arena_alloc(arena, sizeof(Spectrogram));
+	if (!sg) return NULL;
+
+	sg->num_bins = num_bins;
+	sg->rows = rows;
+	sg->channels = channels;
+	sg->data = (float*)arena_alloc(arena, sizeof(float) * channels * rows * num_bins);
+	if (!sg->data) return NULL;
+	atomic_init(&sg->written, 0);
+
+	return sg;
+}
+
+// Row `row` of a channel
+static inline float* spectrogram_row(Spectrogram *sg, size_t channel, size_t row) {
+	return sg->data + (channel * sg->rows + row) * sg->num_bins;
+}
+
+// Write the bands of the row being filled, it stays hidden from readers until spectrogram_publish
+void spectrogram_write(Spectrogram *sg, size_t channel, const double *bands) {
+	float *row = spectrogram_row(sg, channel, atomic_load_explicit(&sg->written, memory_order_relaxed) % sg->rows);
+	for (size_t j = 0; j < sg->num_bins; j++) {
+		row[j] = (float)bands[j];
+	}
+}
+
+// Publish the row written for every channel and move on to the next one
+void spectrogram_publish(Spectrogram *sg) {
+	atomic_fetch_add_explicit(&sg->written, 1, memory_order_release);
+}
+
+// Rows published since init
+unsigned long spectrogram_written(Spectrogram *sg) {
+	return atomic_load_explicit(&sg->written, memory_order_acquire);
+}
+#endif // SPECTROGRAM_H
@@ -0,0 +1,206 @@
+#ifndef STEREO_ANALYSIS_H
+#define STEREO_ANALYSIS_H
+#include <fftw3.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+// Maximum inter-channel lag searched by the delay estimator, in samples
+#ifndef STEREO_MAX_LAG
+#define STEREO_MAX_LAG 1024
+#endif
+
+// Rows of StereoAnalysis.bands, each one num_bins wide
+typedef enum {
+	STEREO_FIELD_CORRELATION, // L/R correlation, -1 (out of phase) .. 1 (mono)
+	STEREO_FIELD_BALANCE,     // Energy balance, -1 (left) .. 1 (right)
+	STEREO_FIELD_MID,         // Mid energy, ((L+R)/2)^2 per bin
+	STEREO_FIELD_SIDE,        // Side energy, ((L-R)/2)^2 per bin
+	STEREO_FIELD_COUNT
+} StereoField;
+
+typedef struct {
+	size_t size;            // Number of samples per channel in a hop
+	size_t num_bins;        // Number of bands
+	const int *bin_start;   // First spectrum bin of each band (owned by the caller)
+	const int *bin_end;     // One past the last spectrum bin of each band (owned by the caller)
+	const double *coef[2];  // Signed spectrum of the left and right channels (owned by the caller)
+	float *bands;           // [STEREO_FIELD_COUNT][num_bins], laid out so it can be uploaded as one texture
+	float correlation;      // Broadband L/R correlation
+	float balance;          // Broadband energy balance
+	float delay;            // Delay of the right channel relative to the left, in samples (positive: right lags)
+	float delay_confidence; // Height of the normalized cross-correlation peak, 0..1
+	size_t max_lag;         // Lag range searched, in samples
+	size_t xcorr_size;      // Zero-padded cross-correlation length
+	double *xcorr_in;       // Padded time domain input
+	double *xcorr_out;      // Cross-correlation, indexed by lag (negative lags wrap around)
+	fftw_complex *xcorr_l;  // Spectrum of the left channel
+	fftw_complex *xcorr_r;  // Spectrum of the right channel, then the cross spectrum
+	fftw_plan xcorr_plan_l;
+	fftw_plan xcorr_plan_r;
+	fftw_plan xcorr_plan_inv;
+} StereoAnalysis;
+
+// Bytes taken in an arena by init_stereo_analysis
+size_t stereo_analysis_arena_size(size_t size, size_t num_bins) {
+	size_t spectrum_size = size + 1; // Half of the padded length, plus one
+	return arena_size(sizeof(StereoAnalysis)) +
+		arena_size(sizeof(float) * STEREO_FIELD_COUNT * num_bins) +
+		2 * arena_size(sizeof(double) * 2 * size) +
+		2 * arena_size(sizeof(fftw_complex) * spectrum_size);
+}
+
+// Initialize the stereo analysis for hops of `size` samples split into `num_bins` bands
+StereoAnalysis* init_stereo_analysis(Arena *arena, size_t size, size_t num_bins, const int *bin_start, const int *bin_end) {
+	if (size < 2 || num_bins == 0 || bin_start == NULL || bin_end == NULL) {
+		printf("Error: Invalid stereo analysis configuration\n");
+		return NULL;
+	}
+
+	StereoAnalysis *sa = (StereoAnalysis*)arena_alloc(arena, sizeof(StereoAnalysis));
+	if (!sa) return NULL;
+
+	sa->size = size;
+	sa->num_bins = num_bins;
+	sa->bin_start = bin_start;
+	sa->bin_end = bin_end;
+	sa->max_lag = STEREO_MAX_LAG < size ? STEREO_MAX_LAG : size - 1;
+
+	// Zero padding to twice the hop turns the circular correlation into a linear one
+	sa->xcorr_size = 2 * size;
+	size_t spectrum_size = sa->xcorr_size / 2 + 1;
+
+	// Arena rows are cache line aligned, enough for FFTW's SIMD code paths
+	sa->bands = (float*)arena_alloc(arena, sizeof(float) * STEREO_FIELD_COUNT * num_bins);
+	sa->xcorr_in = (double*)arena_alloc(arena, sizeof(double) * sa->xcorr_size);
+	sa->xcorr_out = (double*)arena_alloc(arena, sizeof(double) * sa->xcorr_size);
+	sa->xcorr_l = (fftw_complex*)arena_alloc(arena, sizeof(fftw_complex) * spectrum_size);
+	sa->xcorr_r = (fftw_complex*)arena_alloc(arena, sizeof(fftw_complex) * spectrum_size);
+	if (!sa->bands || !sa->xcorr_in || !sa->xcorr_out || !sa->xcorr_l || !sa->xcorr_r) {
+		printf("Error: Failed to allocate memory for stereo analysis\n");
+		return NULL;
+	}
+
+	sa->xcorr_plan_l = fftw_plan_dft_r2c_1d(sa->xcorr_size, sa->xcorr_in, sa->xcorr_l, FFTW_ESTIMATE);
+	sa->xcorr_plan_r = fftw_plan_dft_r2c_1d(sa->xcorr_size, sa->xcorr_in, sa->xcorr_r, FFTW_ESTIMATE);
+	sa->xcorr_plan_inv = fftw_plan_dft_c2r_1d(sa->xcorr_size, sa->xcorr_r, sa->xcorr_out, FFTW_ESTIMATE);
+
+	return sa;
+}
+
+// Accumulate the L/R energies and cross term of one band
+static inline void _stereo_band_sums(const double *restrict l, const double *restrict r, int start, int end, double *ll, double *rr, double *lr) {
+	double sll = 0.0, srr = 0.0, slr = 0.0;
+	#pragma omp simd reduction(+:sll,srr,slr)
+	for (int k = start; k < end; k++) {
+		sll += l[k] * l[k];
+		srr += r[k] * r[k];
+		slr += l[k] * r[k];
+	}
+	*ll = sll;
+	*rr = srr;
+	*lr = slr;
+}
+
+// Estimate the inter-channel delay with a PHAT weighted FFT cross-correlation
+static void _stereo_estimate_delay(StereoAnalysis *sa, const double *time_l, const double *time_r) {
+	size_t n = sa->xcorr_size;
+	size_t spectrum_size = n / 2 + 1;
+
+	// The upper half of xcorr_in stays zeroed from init, only the hop is rewritten
+	memcpy(sa->xcorr_in, time_l, sizeof(double) * sa->size);
+	fftw_execute(sa->xcorr_plan_l);
+	memcpy(sa->xcorr_in, time_r, sizeof(double) * sa->size);
+	fftw_execute(sa->xcorr_plan_r);
+
+	// Cross spectrum L * conj(R), whitened so the peak height doesn't depend on the signal level
+	for (size_t k = 0; k < spectrum_size; k++) {
+		double re = sa->xcorr_l[k][0] * sa->xcorr_r[k][0] + sa->xcorr_l[k][1] * sa->xcorr_r[k][1];
+		double im = sa->xcorr_l[k][1] * sa->xcorr_r[k][0] - sa->xcorr_l[k][0] * sa->xcorr_r[k][1];
+		double mag = sqrt(re * re + im * im);
+		double w = mag > 1e-12 ? 1.0 / mag : 0.0;
+		sa->xcorr_r[k][0] = re * w;
+		sa->xcorr_r[k][1] = im * w;
+	}
+	fftw_execute(sa->xcorr_plan_inv);
+
+	// xcorr_out[k] = sum l[t+k] r[t], so a right channel lagging by d peaks at k = -d
+	long best_lag = 0;
+	double best = -INFINITY;
+	for (long lag = -(long)sa->max_lag; lag <= (long)sa->max_lag; lag++) {
+		double v = sa->xcorr_out[lag < 0 ? (long)n + lag : lag];
+		if (v > best) {
+			best = v;
+			best_lag = lag;
+		}
+	}
+
+	// Parabolic interpolation around the peak for a sub-sample estimate
+	double offset = 0.0;
+	if (best_lag > -(long)sa->max_lag && best_lag < (long)sa->max_lag) {
+		long prev = best_lag - 1, next = best_lag + 1;
+		double a = sa->xcorr_out[prev < 0 ? (long)n + prev : prev];
+		double c = sa->xcorr_out[next < 0 ? (long)n + next : next];
+		double denom = a - 2.0 * best + c;
+		if (fabs(denom) > 1e-12) {
+			offset = 0.5 * (a - c) / denom;
+		}
+	}
+
+	// A pure delay puts every whitened bin in phase, peaking at the transform length
+	double confidence = best / (double)n;
+	sa->delay = (float)(-(best_lag + offset));
+	sa->delay_confidence = (float)(confidence < 0.0 ? 0.0 : confidence > 1.0 ? 1.0 : confidence);
+}
+
+// Compute per-band correlation, balance and mid/side energy from coef[0]/coef[1] and the inter-channel delay from the time domain hop
+void calculate_stereo_analysis(StereoAnalysis *sa, const double *time_l, const double *time_r) {
+	if (!sa || !time_l || !time_r) return;
+
+	const double *l = sa->coef[0];
+	const double *r = sa->coef[1];
+	double norm = 1.0 / ((double)sa->size * (double)sa->size); // Same scaling as freq_data, squared
+	float *correlation = sa->bands + STEREO_FIELD_CORRELATION * sa->num_bins;
+	float *balance = sa->bands + STEREO_FIELD_BALANCE * sa->num_bins;
+	float *mid = sa->bands + STEREO_FIELD_MID * sa->num_bins;
+	float *side = sa->bands + STEREO_FIELD_SIDE * sa->num_bins;
+
+	for (size_t b = 0; b < sa->num_bins; b++) {
+		int start = sa->bin_start[b];
+		int end = sa->bin_end[b];
+		if (end <= start) {
+			correlation[b] = balance[b] = mid[b] = side[b] = 0.0f;
+			continue;
+		}
+		double ll, rr, lr;
+		_stereo_band_sums(l, r, start, end, &ll, &rr, &lr);
+
+		double energy = ll + rr;
+		correlation[b] = (float)(lr / sqrt(ll * rr + 1e-20));
+		balance[b] = (float)((rr - ll) / (energy + 1e-20));
+		// M = (L+R)/2 and S = (L-R)/2, so their energies follow from the sums above
+		double bin_norm = norm / (end - start);
+		mid[b] = (float)(0.25 * (energy + 2.0 * lr) * bin_norm);
+		side[b] = (float)(0.25 * (energy - 2.0 * lr) * bin_norm);
+	}
+
+	double ll, rr, lr;
+	_stereo_band_sums(l, r, 1, (int)sa->size, &ll, &rr, &lr); // Skip DC like freq_data does
+	sa->correlation = (float)(lr / sqrt(ll * rr + 1e-20));
+	sa->balance = (float)((rr - ll) / (ll + rr + 1e-20));
+
+	_stereo_estimate_delay(sa, time_l, time_r);
+}
+
+// Destroy the FFTW plans, the memory is released with the arena
+void free_stereo_analysis(StereoAnalysis *sa) {
+	if (!sa) return;
+
+	fftw_destroy_plan(sa->xcorr_plan_l);
+	fftw_destroy_plan(sa->xcorr_plan_r);
+	fftw_destroy_plan(sa->xcorr_plan_inv);
+}
+#endif // STEREO_ANALYSIS_H
@@ -0,0 +1,293 @@
+#ifndef TEXTURE_STREAM_H
+#define TEXTURE_STREAM_H
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include "gl_context.h"
+#include "raylib.h"
+#include "rlgl.h"
+
+// Streaming of analysis data into float textures.
+// The analysis textures are rewritten every frame. Uploading from client
+// memory makes the driver copy the data before glTexSubImage2D returns, and
+// wait for the draws still reading the texture. A TextureStream writes into
+// a ring of pixel buffer objects instead: each update orphans the next buffer
+// and maps fresh storage, so the write never waits for the GPU, and the
+// texture is filled from the buffer asynchronously. The buffers live as long
+// as the texture, nothing is allocated per update. rlgl has no pixel buffer
+// entry points, they are loaded from the context once; without them updates
+// fall back to rlUpdateTexture. A UniformStream does the same for a uniform
+// block, its whole buffer is replaced at once. A PixelReadback goes the other
+// way: frames are read into a ring of buffers and mapped a few frames later,
+// when the GPU is done writing them, so reading back never stalls rendering.
+
+#define TEXTURE_STREAM_BUFFERS 3 // Buffers in the ring of a stream
+
+// GL enums used here, rlgl doesn't export them
+#define _TEXTURE_STREAM_PIXEL_UNPACK_BUFFER 0x88EC
+#define _TEXTURE_STREAM_STREAM_DRAW 0x88E0
+#define _TEXTURE_STREAM_MAP_WRITE 0x0002
+#define _TEXTURE_STREAM_MAP_INVALIDATE_BUFFER 0x0008
+#define _TEXTURE_STREAM_TEXTURE_2D 0x0DE1
+#define _TEXTURE_STREAM_RED 0x1903
+#define _TEXTURE_STREAM_RGBA 0x1908
+#define _TEXTURE_STREAM_FLOAT 0x1406
+#define _TEXTURE_STREAM_UNIFORM_BUFFER 0x8A11
+#define _TEXTURE_STREAM_INVALID_INDEX 0xFFFFFFFFu
+#define _TEXTURE_STREAM_PIXEL_PACK_BUFFER 0x88EB
+#define _TEXTURE_STREAM_STREAM_READ 0x88E1
+#define _TEXTURE_STREAM_MAP_READ 0x0001
+#define _TEXTURE_STREAM_UNSIGNED_BYTE 0x1401
+
+typedef struct {
+	Texture2D texture;      // R32 or R32G32B32A32 float texture
+	int components;         // Floats per texel
+	unsigned int buffers[TEXTURE_STREAM_BUFFERS]; // Pixel buffer objects, 0 when updates go through rlUpdateTexture
+	size_t buffer_size;     // Bytes of each buffer, the whole texture
+	int next;               // Buffer the next update writes
+} TextureStream;
+
+static struct {
+	int loaded; // 1 when the entry points are loaded, -1 when they are unavailable
+	void (*gen_buffers)(int n, unsigned int *buffers);
+	void (*delete_buffers)(int n, const unsigned int *buffers);
+	void (*bind_buffer)(unsigned int target, unsigned int buffer);
+	void (*buffer_data)(unsigned int target, ptrdiff_t size, const void *data, unsigned int usage);
+	void* (*map_buffer_range)(unsigned int target, ptrdiff_t offset, ptrdiff_t length, unsigned int access);
+	unsigned char (*unmap_buffer)(unsigned int target);
+	void (*bind_texture)(unsigned int target, unsigned int texture);
+	void (*tex_sub_image_2d)(unsigned int target, int level, int x, int y, int width, int height, unsigned int format, unsigned int type, const void *pixels);
+	void (*bind_buffer_base)(unsigned int target, unsigned int index, unsigned int buffer);
+	unsigned int (*get_uniform_block_index)(unsigned int program, const char *name);
+	void (*uniform_block_binding)(unsigned int program, unsigned int index, unsigned int binding);
+	void (*read_pixels)(int x, int y, int width, int height, unsigned int format, unsigned int type, void *pixels);
+} _texture_stream_gl;
+
+#define _TEXTURE_STREAM_LOAD(field, name) (*(void **)&_texture_stream_gl.field = (void *)gl_proc_address(name))
+
+// Load the pixel and uniform buffer entry points once a context exists, 0 if streams can use them
+int texture_stream_load() {
+	if (_texture_stream_gl.loaded != 0) return _texture_stream_gl.loaded > 0 ? 0 : -1;
+	int loaded = _TEXTURE_STREAM_LOAD(gen_buffers, "glGenBuffers") != NULL;
+	loaded &= _TEXTURE_STREAM_LOAD(delete_buffers, "glDeleteBuffers") != NULL;
+	loaded &= _TEXTURE_STREAM_LOAD(bind_buffer, "glBindBuffer") != NULL;
+	loaded &= _TEXTURE_STREAM_LOAD(buffer_data, "glBufferData") != NULL;
+	loaded &= _TEXTURE_STREAM_LOAD(map_buffer_range, "glMapBufferRange") != NULL;
+	loaded &= _TEXTURE_STREAM_LOAD(unmap_buffer, "glUnmapBuffer") != NULL;
+	loaded &= _TEXTURE_STREAM_LOAD(bind_texture, "glBindTexture") != NULL;
+	loaded &= _TEXTURE_STREAM_LOAD(tex_sub_image_2d, "glTexSubImage2D") != NULL;
+	loaded &= _TEXTURE_STREAM_LOAD(bind_buffer_base, "glBindBufferBase") != NULL;
+	loaded &= _TEXTURE_STREAM_LOAD(get_uniform_block_index, "glGetUniformBlockIndex") != NULL;
+	loaded &= _TEXTURE_STREAM_LOAD(uniform_block_binding, "glUniformBlockBinding") != NULL;
+	loaded &= _TEXTURE_STREAM_LOAD(read_pixels, "glReadPixels") != NULL;
+	_texture_stream_gl.loaded = loaded ? 1 : -1;
+	if (!loaded) {
+		printf("Warning: Pixel and uniform buffer objects are unavailable, textures are updated from client memory\n");
+		return -1;
+	}
+	return 0;
+}
+
+// Create a width x height texture of RL_PIXELFORMAT_UNCOMPRESSED_R32 or _R32G32B32A32 with `data`, or uninitialized with NULL
+TextureStream create_texture_stream_with(int width, int height, int format, const float *data) {
+	TextureStream stream;
+	memset(&stream, 0, sizeof(stream));
+	if (width <= 0 || height <= 0) return stream;
+	stream.components = format == RL_PIXELFORMAT_UNCOMPRESSED_R32G32B32A32 ? 4 : 1;
+	stream.texture.id = rlLoadTexture(data, width, height, format, 1);
+	stream.texture.width = width;
+	stream.texture.height = height;
+	stream.texture.mipmaps = 1;
+	stream.texture.format = format;
+	if (stream.texture.id == 0 || texture_stream_load() != 0) return stream;
+
+	stream.buffer_size = sizeof(float) * stream.components * (size_t)width * (size_t)height;
+	_texture_stream_gl.gen_buffers(TEXTURE_STREAM_BUFFERS, stream.buffers);
+	for (int i = 0; i < TEXTURE_STREAM_BUFFERS; i++) {
+		_texture_stream_gl.bind_buffer(_TEXTURE_STREAM_PIXEL_UNPACK_BUFFER, stream.buffers[i]);
+		_texture_stream_gl.buffer_data(_TEXTURE_STREAM_PIXEL_UNPACK_BUFFER, (ptrdiff_t)stream.buffer_size, NULL, _TEXTURE_STREAM_STREAM_DRAW);
+	}
+	_texture_stream_gl.bind_buffer(_TEXTURE_STREAM_PIXEL_UNPACK_BUFFER, 0);
+	return stream;
+}
+
+// Create a width x height single channel float texture
+TextureStream create_texture_stream(int width, int height, const float *data) {
+	return create_texture_stream_with(width, height, RL_PIXELFORMAT_UNCOMPRESSED_R32, data);
+}
+
+void destroy_texture_stream(TextureStream *stream) {
+	if (stream->buffers[0] != 0) {
+		_texture_stream_gl.delete_buffers(TEXTURE_STREAM_BUFFERS, stream->buffers);
+	}
+	if (stream->texture.id != 0) {
+		rlUnloadTexture(stream->texture.id);
+	}
+	memset(stream, 0, sizeof(*stream));
+}
+
+// Replace a width x height region at x, y with tightly packed `data`
+void texture_stream_update(TextureStream *stream, int x, int y, int width, int height, const float *data) {
+	if (stream->texture.id == 0 || width <= 0 || height <= 0) return;
+	size_t size = sizeof(float) * stream->components * (size_t)width * (size_t)height;
+	if (stream->buffers[0] == 0 || size > stream->buffer_size) {
+		rlUpdateTexture(stream->texture.id, x, y, width, height, stream->texture.format, data);
+		return;
+	}
+	unsigned int buffer = stream->buffers[stream->next];
+	stream->next = (stream->next + 1) % TEXTURE_STREAM_BUFFERS;
+
+	_texture_stream_gl.bind_buffer(_TEXTURE_STREAM_PIXEL_UNPACK_BUFFER, buffer);
+	// Orphan the storage a pending upload may still read, the mapping gets fresh storage without a sync
+	_texture_stream_gl.buffer_data(_TEXTURE_STREAM_PIXEL_UNPACK_BUFFER, (ptrdiff_t)stream->buffer_size, NULL, _TEXTURE_STREAM_STREAM_DRAW);
+	void *mapped = _texture_stream_gl.map_buffer_range(_TEXTURE_STREAM_PIXEL_UNPACK_BUFFER, 0, (ptrdiff_t)size,
+		_TEXTURE_STREAM_MAP_WRITE | _TEXTURE_STREAM_MAP_INVALIDATE_BUFFER);
+	if (mapped == NULL) {
+		_texture_stream_gl.bind_buffer(_TEXTURE_STREAM_PIXEL_UNPACK_BUFFER, 0);
+		rlUpdateTexture(stream->texture.id, x, y, width, height, stream->texture.format, data);
+		return;
+	}
+	memcpy(mapped, data, size);
+	_texture_stream_gl.unmap_buffer(_TEXTURE_STREAM_PIXEL_UNPACK_BUFFER);
+	// With a pixel buffer bound the pixels argument is an offset into it
+	_texture_stream_gl.bind_texture(_TEXTURE_STREAM_TEXTURE_2D, stream->texture.id);
+	_texture_stream_gl.tex_sub_image_2d(_TEXTURE_STREAM_TEXTURE_2D, 0, x, y, width, height,
+		stream->components == 4 ? _TEXTURE_STREAM_RGBA : _TEXTURE_STREAM_RED, _TEXTURE_STREAM_FLOAT, NULL);
+	_texture_stream_gl.bind_texture(_TEXTURE_STREAM_TEXTURE_2D, 0);
+	_texture_stream_gl.bind_buffer(_TEXTURE_STREAM_PIXEL_UNPACK_BUFFER, 0);
+}
+
+typedef struct {
+	unsigned int buffer;  // Uniform buffer object, 0 when they are unavailable
+	size_t size;          // Bytes of the block
+	unsigned int binding; // Binding point the buffer is attached to
+} UniformStream;
+
+// Create a buffer for a uniform block of `size` bytes, attached to a binding point
+UniformStream create_uniform_stream(size_t size, unsigned int binding) {
+	UniformStream stream;
+	memset(&stream, 0, sizeof(stream));
+	stream.size = size;
+	stream.binding = binding;
+	if (texture_stream_load() != 0) return stream;
+	_texture_stream_gl.gen_buffers(1, &stream.buffer);
+	_texture_stream_gl.bind_buffer(_TEXTURE_STREAM_UNIFORM_BUFFER, stream.buffer);
+	_texture_stream_gl.buffer_data(_TEXTURE_STREAM_UNIFORM_BUFFER, (ptrdiff_t)size, NULL, _TEXTURE_STREAM_STREAM_DRAW);
+	_texture_stream_gl.bind_buffer(_TEXTURE_STREAM_UNIFORM_BUFFER, 0);
+	_texture_stream_gl.bind_buffer_base(_TEXTURE_STREAM_UNIFORM_BUFFER, binding, stream.buffer);
+	return stream;
+}
+
+void destroy_uniform_stream(UniformStream *stream) {
+	if (stream->buffer != 0) {
+		_texture_stream_gl.delete_buffers(1, &stream->buffer);
+	}
+	memset(stream, 0, sizeof(*stream));
+}
+
+// Point the uniform block `block` of a shader program at the stream, 0 if the program declares it
+int uniform_stream_attach(const UniformStream *stream, unsigned int program, const char *block) {
+	if (stream->buffer == 0) return -1;
+	unsigned int index = _texture_stream_gl.get_uniform_block_index(program, block);
+	if (index == _TEXTURE_STREAM_INVALID_INDEX) return -1;
+	_texture_stream_gl.uniform_block_binding(program, index, stream->binding);
+	return 0;
+}
+
+// Replace the whole block, orphaning the storage draws in flight still read
+void uniform_stream_update(UniformStream *stream, const void *data) {
+	if (stream->buffer == 0) return;
+	_texture_stream_gl.bind_buffer(_TEXTURE_STREAM_UNIFORM_BUFFER, stream->buffer);
+	_texture_stream_gl.buffer_data(_TEXTURE_STREAM_UNIFORM_BUFFER, (ptrdiff_t)stream->size, data, _TEXTURE_STREAM_STREAM_DRAW);
+	_texture_stream_gl.bind_buffer(_TEXTURE_STREAM_UNIFORM_BUFFER, 0);
+}
+
+typedef struct {
+	int width, height;
+	unsigned int buffers[TEXTURE_STREAM_BUFFERS]; // Pixel pack buffers, 0 when frames are read synchronously
+	size_t size;            // RGBA8 bytes of a frame
+	int pending;            // Frames read and not mapped yet
+	int next;               // Buffer the next read writes
+	int bottom_up;          // Rows of mapped frames start at the bottom, like GL reads them
+	unsigned char *frame;   // Frame read synchronously, without buffers
+} PixelReadback;
+
+// Create a ring reading width x height RGBA8 frames
+PixelReadback create_pixel_readback(int width, int height) {
+	PixelReadback readback;
+	memset(&readback, 0, sizeof(readback));
+	readback.width = width;
+	readback.height = height;
+	readback.size = 4 * (size_t)width * (size_t)height;
+	if (width <= 0 || height <= 0 || texture_stream_load() != 0) return readback;
+	_texture_stream_gl.gen_buffers(TEXTURE_STREAM_BUFFERS, readback.buffers);
+	for (int i = 0; i < TEXTURE_STREAM_BUFFERS; i++) {
+		_texture_stream_gl.bind_buffer(_TEXTURE_STREAM_PIXEL_PACK_BUFFER, readback.buffers[i]);
+		_texture_stream_gl.buffer_data(_TEXTURE_STREAM_PIXEL_PACK_BUFFER, (ptrdiff_t)readback.size, NULL, _TEXTURE_STREAM_STREAM_READ);
+	}
+	_texture_stream_gl.bind_buffer(_TEXTURE_STREAM_PIXEL_PACK_BUFFER, 0);
+	readback.bottom_up = 1;
+	return readback;
+}
+
+void destroy_pixel_readback(PixelReadback *readback) {
+	if (readback->buffers[0] != 0) {
+		_texture_stream_gl.delete_buffers(TEXTURE_STREAM_BUFFERS, readback->buffers);
+	}
+	if (readback->frame != NULL) {
+		RL_FREE(readback->frame);
+	}
+	memset(readback, 0, sizeof(*readback));
+}
+
+// Every buffer holds a frame, the oldest has to be mapped before the next read
+int pixel_readback_full(const PixelReadback *readback) {
+	return readback->pending == (readback->buffers[0] != 0 ? TEXTURE_STREAM_BUFFERS : 1);
+}
+
+// Start reading the bound framebuffer, which has to be drawn already: the batch is flushed first
+void pixel_readback_start(PixelReadback *readback) {
+	if (pixel_readback_full(readback)) return;
+	rlDrawRenderBatchActive();
+	if (readback->buffers[0] == 0) {
+		// Synchronous, already flipped to top down rows
+		readback->frame = rlReadScreenPixels(readback->width, readback->height);
+		readback->pending = readback->frame != NULL;
+		return;
+	}
+	_texture_stream_gl.bind_buffer(_TEXTURE_STREAM_PIXEL_PACK_BUFFER, readback->buffers[readback->next]);
+	// With a pixel buffer bound the pixels argument is an offset into it, the read returns at once
+	_texture_stream_gl.read_pixels(0, 0, readback->width, readback->height, _TEXTURE_STREAM_RGBA, _TEXTURE_STREAM_UNSIGNED_BYTE, NULL);
+	_texture_stream_gl.bind_buffer(_TEXTURE_STREAM_PIXEL_PACK_BUFFER, 0);
+	readback->next = (readback->next + 1) % TEXTURE_STREAM_BUFFERS;
+	readback->pending++;
+}
+
+// Map the oldest frame read, NULL if there is none or it was dropped. Release a mapped frame with pixel_readback_unmap before the next read
+const unsigned char* pixel_readback_map(PixelReadback *readback) {
+	if (readback->pending == 0) return NULL;
+	if (readback->buffers[0] == 0) return readback->frame;
+	int oldest = (readback->next + TEXTURE_STREAM_BUFFERS - readback->pending) % TEXTURE_STREAM_BUFFERS;
+	_texture_stream_gl.bind_buffer(_TEXTURE_STREAM_PIXEL_PACK_BUFFER, readback->buffers[oldest]);
+	const unsigned char *mapped = (const unsigned char *)_texture_stream_gl.map_buffer_range(_TEXTURE_STREAM_PIXEL_PACK_BUFFER,
+		0, (ptrdiff_t)readback->size, _TEXTURE_STREAM_MAP_READ);
+	if (mapped == NULL) {
+		printf("Error: Failed to map a frame read back\n");
+		_texture_stream_gl.bind_buffer(_TEXTURE_STREAM_PIXEL_PACK_BUFFER, 0);
+		readback->pending--; // Dropped
+	}
+	return mapped;
+}
+
+void pixel_readback_unmap(PixelReadback *readback) {
+	if (readback->pending == 0) return;
+	readback->pending--;
+	if (readback->buffers[0] == 0) {
+		RL_FREE(readback->frame);
+		readback->frame = NULL;
+		return;
+	}
+	_texture_stream_gl.unmap_buffer(_TEXTURE_STREAM_PIXEL_PACK_BUFFER);
+	_texture_stream_gl.bind_buffer(_TEXTURE_STREAM_PIXEL_PACK_BUFFER, 0);
+}
+#endif // TEXTURE_STREAM_H
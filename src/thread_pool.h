@@ -0,0 +1,356 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Small work-stealing task scheduler.
+// A graph of tasks is built with thread_pool_add_task/task_depends_on, then
+// thread_pool_run executes it on the calling thread plus the pool workers and
+// returns once every task finished. Each thread owns a deque: it pushes and pops
+// ready tasks at the tail and steals from the head of the others when idle.
+// A thread that finds no ready task sleeps until one is queued or the graph
+// finished; workers also sleep between graphs. A graph stays in the pool after
+// it ran, thread_pool_run can run it again without rebuilding it.
+
+#define TASK_MAX_SUCCESSORS 8
+
+typedef void (*TaskFunc)(void *arg);
+typedef void (*ThreadPoolStart)(int index, void *arg); // Runs first on every worker, index 1..worker_count
+
+typedef struct Task Task;
+struct Task {
+	TaskFunc func;
+	void *arg;
+	atomic_int pending;                     // Dependencies not finished yet
+	int dependencies;                       // Restored into pending on every run
+	int successor_count;
+	Task *successors[TASK_MAX_SUCCESSORS];  // Tasks waiting on this one
+};
+
+typedef struct {
+	pthread_mutex_t lock;
+	Task **tasks;
+	int head; // Thieves take from here
+	int tail; // The owner pushes and pops here
+} TaskDeque;
+
+typedef struct {
+	int worker_count;        // Threads besides the one calling thread_pool_run
+	pthread_t *workers;
+	TaskDeque *deques;       // worker_count + 1, index 0 belongs to the calling thread
+	int deque_count;         // Deques allocated, more than in use if a worker failed to start
+	Task *tasks;             // Task storage of the current graph
+	int task_capacity;
+	int task_count;
+	Task **roots;            // Scratch list of the tasks without dependencies
+	atomic_int remaining;    // Tasks of the current graph not finished yet
+	atomic_int running;
+	atomic_int sleepers;     // Threads waiting on `idle` for a task
+	pthread_mutex_t idle_lock;
+	pthread_cond_t idle;     // A task was queued or the graph finished
+	pthread_mutex_t wake_lock;
+	pthread_cond_t wake;
+	unsigned int generation; // Bumped for every graph, wakes the workers
+	ThreadPoolStart start;   // Called by each worker before it waits for graphs, NULL for none
+	void *start_arg;
+} ThreadPool;
+
+typedef struct {
+	ThreadPool *pool;
+	int index;
+} _ThreadPoolWorker;
+
+static __thread int _thread_pool_index = 0; // Deque owned by the current thread
+
+// Number of worker threads to use besides the calling thread: one per remaining core
+int thread_pool_default_workers() {
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	return cores > 1 ? (int)cores - 1 : 0;
+}
+
+static void _task_deque_push(TaskDeque *deque, Task *task) {
+	pthread_mutex_lock(&deque->lock);
+	deque->tasks[deque->tail++] = task;
+	pthread_mutex_unlock(&deque->lock);
+}
+
+static Task* _task_deque_pop(TaskDeque *deque) {
+	Task *task = NULL;
+	pthread_mutex_lock(&deque->lock);
+	if (deque->tail > deque->head) {
+		task = deque->tasks[--deque->tail];
+	}
+	if (deque->tail == deque->head) {
+		deque->head = deque->tail = 0;
+	}
+	pthread_mutex_unlock(&deque->lock);
+	return task;
+}
+
+static Task* _task_deque_steal(TaskDeque *deque) {
+	Task *task = NULL;
+	pthread_mutex_lock(&deque->lock);
+	if (deque->tail > deque->head) {
+		task = deque->tasks[deque->head++];
+	}
+	if (deque->tail == deque->head) {
+		deque->head = deque->tail = 0;
+	}
+	pthread_mutex_unlock(&deque->lock);
+	return task;
+}
+
+// Pop from the own deque first, then try to steal from the others
+static Task* _thread_pool_find_task(ThreadPool *pool, int index) {
+	Task *task = _task_deque_pop(&pool->deques[index]);
+	for (int i = 1; task == NULL && i <= pool->worker_count; i++) {
+		task = _task_deque_steal(&pool->deques[(index + i) % (pool->worker_count + 1)]);
+	}
+	return task;
+}
+
+// Wake sleeping threads after a push or the end of the graph. Sleepers are counted
+// before they look for a task, so either they see the change or they are counted here
+static void _thread_pool_notify(ThreadPool *pool, int all) {
+	if (atomic_load(&pool->sleepers) == 0) return;
+	pthread_mutex_lock(&pool->idle_lock);
+	if (all) {
+		pthread_cond_broadcast(&pool->idle);
+	} else {
+		pthread_cond_signal(&pool->idle);
+	}
+	pthread_mutex_unlock(&pool->idle_lock);
+}
+
+// Next task for this thread, sleeping while none is ready. NULL once the graph finished
+static Task* _thread_pool_next_task(ThreadPool *pool, int index) {
+	Task *task = _thread_pool_find_task(pool, index);
+	if (task != NULL || atomic_load(&pool->remaining) == 0) return task;
+	pthread_mutex_lock(&pool->idle_lock);
+	atomic_fetch_add(&pool->sleepers, 1);
+	while (atomic_load(&pool->remaining) > 0 && (task = _thread_pool_find_task(pool, index)) == NULL) {
+		pthread_cond_wait(&pool->idle, &pool->idle_lock);
+	}
+	atomic_fetch_sub(&pool->sleepers, 1);
+	pthread_mutex_unlock(&pool->idle_lock);
+	return task;
+}
+
+static void _thread_pool_execute(ThreadPool *pool, int index, Task *task) {
+	task->func(task->arg);
+	// Successors whose last dependency just finished become ready on this thread
+	for (int i = 0; i < task->successor_count; i++) {
+		Task *successor = task->successors[i];
+		if (atomic_fetch_sub(&successor->pending, 1) == 1) {
+			_task_deque_push(&pool->deques[index], successor);
+			_thread_pool_notify(pool, 0);
+		}
+	}
+	if (atomic_fetch_sub(&pool->remaining, 1) == 1) {
+		_thread_pool_notify(pool, 1); // Sleepers leave the graph
+	}
+}
+
+static void *_thread_pool_worker(void *arg) {
+	_ThreadPoolWorker *worker = (_ThreadPoolWorker *)arg;
+	ThreadPool *pool = worker->pool;
+	int index = worker->index;
+	free(worker);
+	_thread_pool_index = index;
+	if (pool->start != NULL) {
+		pool->start(index, pool->start_arg);
+	}
+
+	unsigned int seen = 0;
+	while (1) {
+		pthread_mutex_lock(&pool->wake_lock);
+		while (pool->generation == seen && atomic_load(&pool->running)) {
+			pthread_cond_wait(&pool->wake, &pool->wake_lock);
+		}
+		seen = pool->generation;
+		pthread_mutex_unlock(&pool->wake_lock);
+		if (!atomic_load(&pool->running)) break;
+
+		Task *task;
+		while ((task = _thread_pool_next_task(pool, index)) != NULL) {
+			_thread_pool_execute(pool, index, task);
+		}
+	}
+	return NULL;
+}
+
+// Create a pool able to hold graphs of up to `task_capacity` tasks, every worker calls `start` first
+ThreadPool* thread_pool_create_with(int worker_count, int task_capacity, ThreadPoolStart start, void *start_arg) {
+	if (worker_count < 0 || task_capacity <= 0) {
+		printf("Error: Invalid thread pool configuration\n");
+		return NULL;
+	}
+
+	ThreadPool *pool = (ThreadPool *)calloc(1, sizeof(ThreadPool));
+	if (!pool) return NULL;
+
+	pool->task_capacity = task_capacity;
+	pool->start = start;
+	pool->start_arg = start_arg;
+	pool->tasks = (Task *)calloc(task_capacity, sizeof(Task));
+	pool->deques = (TaskDeque *)calloc(worker_count + 1, sizeof(TaskDeque));
+	pool->workers = (pthread_t *)calloc(worker_count > 0 ? worker_count : 1, sizeof(pthread_t));
+	pool->roots = (Task **)calloc(task_capacity, sizeof(Task *));
+	if (!pool->tasks || !pool->deques || !pool->workers || !pool->roots) {
+		printf("Error: Failed to allocate memory for thread pool\n");
+		free(pool->roots);
+		free(pool->tasks);
+		free(pool->deques);
+		free(pool->workers);
+		free(pool);
+		return NULL;
+	}
+	pool->deque_count = worker_count + 1;
+	for (int i = 0; i < pool->deque_count; i++) {
+		// A graph never holds more ready tasks than its capacity
+		pool->deques[i].tasks = (Task **)calloc(task_capacity, sizeof(Task *));
+		if (pool->deques[i].tasks == NULL) {
+			printf("Error: Failed to allocate memory for thread pool\n");
+			for (int j = 0; j < i; j++) {
+				pthread_mutex_destroy(&pool->deques[j].lock);
+				free(pool->deques[j].tasks);
+			}
+			free(pool->roots);
+			free(pool->tasks);
+			free(pool->deques);
+			free(pool->workers);
+			free(pool);
+			return NULL;
+		}
+		pthread_mutex_init(&pool->deques[i].lock, NULL);
+	}
+	pthread_mutex_init(&pool->idle_lock, NULL);
+	pthread_cond_init(&pool->idle, NULL);
+	pthread_mutex_init(&pool->wake_lock, NULL);
+	pthread_cond_init(&pool->wake, NULL);
+	atomic_store(&pool->remaining, 0);
+	atomic_store(&pool->sleepers, 0);
+	atomic_store(&pool->running, 1);
+
+	for (int i = 0; i < worker_count; i++) {
+		_ThreadPoolWorker *worker = (_ThreadPoolWorker *)malloc(sizeof(_ThreadPoolWorker));
+		if (worker == NULL) {
+			printf("Failed to create thread pool worker %d, continuing with %d\n", i + 1, i);
+			break;
+		}
+		worker->pool = pool;
+		worker->index = i + 1;
+		if (pthread_create(&pool->workers[i], NULL, _thread_pool_worker, worker) != 0) {
+			printf("Failed to create thread pool worker %d, continuing with %d\n", i + 1, i);
+			free(worker);
+			break;
+		}
+		pool->worker_count++;
+	}
+
+	return pool;
+}
+
+ThreadPool* thread_pool_create(int worker_count, int task_capacity) {
+	return thread_pool_create_with(worker_count, task_capacity, NULL, NULL);
+}
+
+// Stop the workers and free the pool
+void thread_pool_destroy(ThreadPool *pool) {
+	if (!pool) return;
+
+	pthread_mutex_lock(&pool->wake_lock);
+	atomic_store(&pool->running, 0);
+	pthread_cond_broadcast(&pool->wake);
+	pthread_mutex_unlock(&pool->wake_lock);
+	for (int i = 0; i < pool->worker_count; i++) {
+		pthread_join(pool->workers[i], NULL);
+	}
+
+	for (int i = 0; i < pool->deque_count; i++) {
+		pthread_mutex_destroy(&pool->deques[i].lock);
+		free(pool->deques[i].tasks);
+	}
+	pthread_mutex_destroy(&pool->idle_lock);
+	pthread_cond_destroy(&pool->idle);
+	pthread_mutex_destroy(&pool->wake_lock);
+	pthread_cond_destroy(&pool->wake);
+	free(pool->deques);
+	free(pool->workers);
+	free(pool->tasks);
+	free(pool->roots);
+	free(pool);
+}
+
+// Start a new graph, forgetting the tasks of the previous one
+void thread_pool_reset(ThreadPool *pool) {
+	pool->task_count = 0;
+}
+
+// Add a task to the current graph, NULL if the graph is full
+Task* thread_pool_add_task(ThreadPool *pool, TaskFunc func, void *arg) {
+	if (pool->task_count >= pool->task_capacity) {
+		printf("Thread pool graph is full (%d tasks)\n", pool->task_capacity);
+		return NULL;
+	}
+	Task *task = &pool->tasks[pool->task_count++];
+	task->func = func;
+	task->arg = arg;
+	task->successor_count = 0;
+	task->dependencies = 0;
+	atomic_store(&task->pending, 0);
+	return task;
+}
+
+// Make `task` wait for `dependency` to finish
+int task_depends_on(Task *task, Task *dependency) {
+	if (task == NULL || dependency == NULL) return -1;
+	if (dependency->successor_count >= TASK_MAX_SUCCESSORS) {
+		printf("Task has too many successors (%d)\n", TASK_MAX_SUCCESSORS);
+		return -1;
+	}
+	dependency->successors[dependency->successor_count++] = task;
+	task->dependencies++;
+	return 0;
+}
+
+// Run the current graph to completion, the calling thread works alongside the pool.
+// The graph is kept, running it again needs no thread_pool_reset and no new tasks
+void thread_pool_run(ThreadPool *pool) {
+	if (pool->task_count == 0) return;
+
+	// Dependency counts are restored and roots collected before any of them is queued:
+	// a worker still leaving the previous run may pick one up right away and release its successors
+	int root_count = 0;
+	for (int i = 0; i < pool->task_count; i++) {
+		atomic_store(&pool->tasks[i].pending, pool->tasks[i].dependencies);
+		if (pool->tasks[i].dependencies == 0) {
+			pool->roots[root_count++] = &pool->tasks[i];
+		}
+	}
+	atomic_store(&pool->remaining, pool->task_count);
+	for (int i = 0; i < root_count; i++) {
+		// Spread the roots so every worker starts with local work
+		_task_deque_push(&pool->deques[i % (pool->worker_count + 1)], pool->roots[i]);
+		_thread_pool_notify(pool, 0);
+	}
+
+	if (pool->worker_count > 0) {
+		pthread_mutex_lock(&pool->wake_lock);
+		pool->generation++;
+		pthread_cond_broadcast(&pool->wake);
+		pthread_mutex_unlock(&pool->wake_lock);
+	}
+
+	int index = _thread_pool_index;
+	Task *task;
+	while ((task = _thread_pool_next_task(pool, index)) != NULL) {
+		_thread_pool_execute(pool, index, task);
+	}
+}
+#endif // THREAD_POOL_H
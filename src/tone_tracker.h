@@ -0,0 +1,152 @@
+#ifndef TONE_TRACKER_H
+#define TONE_TRACKER_H
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+// Sliding DFT bank.
+// Tracks the magnitude of a few target frequencies on every captured sample.
+// Each target keeps one complex DFT coefficient over the last `window`
+// samples, updated in O(1) per sample as the newest sample enters and the
+// oldest one leaves:
+//   S[n] = r e^{iw} S[n-1] + x[n] - r^N e^{iwN} x[n-N]
+// Targets don't have to sit on a bin of the window, and the damping r just
+// under 1 keeps rounding errors from piling up. The window is independent of
+// the analysis buffer, so a short one follows a tone within milliseconds
+// instead of waiting for a full buffer. The coefficients of every target of
+// a channel are contiguous, so the per-sample loop runs across targets and
+// vectorizes.
+
+#define TONE_TRACKER_MAX_TARGETS 32
+#define TONE_TRACKER_DEFAULT_WINDOW 0.02 // Seconds
+#define TONE_TRACKER_MIN_WINDOW 16       // Samples
+#define TONE_TRACKER_DAMPING 0.99999
+
+typedef struct {
+	size_t channels;
+	size_t targets;
+	size_t window;        // Samples in the sliding window
+	size_t pos;           // Oldest sample of every history row, overwritten next
+	double scale;         // Turns a coefficient into the amplitude of a sinusoid
+	double *frequency;    // [targets] Hz
+	double *rot_re, *rot_im;     // [targets] r e^{iw}
+	double *tail_re, *tail_im;   // [targets] r^N e^{iwN}, weight of the sample leaving the window
+	double *state_re, *state_im; // [channels][targets] Sliding coefficients
+	double *history;      // [channels][window] Samples in the window, to take them out again
+	double *magnitude;    // [channels][targets] Amplitude at the end of the last block
+} ToneTracker;
+
+// Bytes taken in an arena by init_tone_tracker
+size_t tone_tracker_arena_size(size_t channels, size_t targets, size_t window) {
+	return arena_size(sizeof(ToneTracker)) +
+		5 * arena_size(sizeof(double) * targets) +
+		3 * arena_size(sizeof(double) * channels * targets) +
+		arena_size(sizeof(double) * channels * window);
+}
+
+// Samples in a window of `seconds` at sample_rate
+size_t tone_tracker_window(double seconds, unsigned int sample_rate) {
+	size_t window = (size_t)(seconds * sample_rate + 0.5);
+	return window < TONE_TRACKER_MIN_WINDOW ? TONE_TRACKER_MIN_WINDOW : window;
+}
+
+// Initialize a bank tracking `targets` frequencies in interleaved input, it is released with the arena
+ToneTracker* init_tone_tracker(Arena *arena, size_t channels, unsigned int sample_rate, const double *frequencies, size_t targets, size_t window) {
+	if (channels == 0 || sample_rate == 0 || targets == 0 || targets > TONE_TRACKER_MAX_TARGETS || window < TONE_TRACKER_MIN_WINDOW) {
+		printf("Error: Invalid tone tracker configuration (%zu targets, %zu samples window)\n", targets, window);
+		return NULL;
+	}
+	for (size_t k = 0; k < targets; k++) {
+		if (!(frequencies[k] > 0.0 && frequencies[k] < sample_rate / 2.0)) {
+			printf("Error: Tone tracker target %.1f Hz is outside 0..%u Hz\n", frequencies[k], sample_rate / 2);
+			return NULL;
+		}
+	}
+
+	ToneTracker *tt = (ToneTracker*)arena_alloc(arena, sizeof(ToneTracker));
+	if (!tt) return NULL;
+	tt->channels = channels;
+	tt->targets = targets;
+	tt->window = window;
+	tt->pos = 0;
+	tt->frequency = (double*)arena_alloc(arena, sizeof(double) * targets);
+	tt->rot_re = (double*)arena_alloc(arena, sizeof(double) * targets);
+	tt->rot_im = (double*)arena_alloc(arena, sizeof(double) * targets);
+	tt->tail_re = (double*)arena_alloc(arena, sizeof(double) * targets);
+	tt->tail_im = (double*)arena_alloc(arena, sizeof(double) * targets);
+	tt->state_re = (double*)arena_alloc(arena, sizeof(double) * channels * targets);
+	tt->state_im = (double*)arena_alloc(arena, sizeof(double) * channels * targets);
+	tt->magnitude = (double*)arena_alloc(arena, sizeof(double) * channels * targets);
+	tt->history = (double*)arena_alloc(arena, sizeof(double) * channels * window);
+	if (!tt->frequency || !tt->rot_re || !tt->rot_im || !tt->tail_re || !tt->tail_im ||
+		!tt->state_re || !tt->state_im || !tt->magnitude || !tt->history) {
+		printf("Error: Failed to allocate memory for tone tracker\n");
+		return NULL;
+	}
+
+	double tail = pow(TONE_TRACKER_DAMPING, (double)window);
+	for (size_t k = 0; k < targets; k++) {
+		double w = 2.0 * M_PI * frequencies[k] / sample_rate;
+		tt->frequency[k] = frequencies[k];
+		tt->rot_re[k] = TONE_TRACKER_DAMPING * cos(w);
+		tt->rot_im[k] = TONE_TRACKER_DAMPING * sin(w);
+		tt->tail_re[k] = tail * cos(w * window);
+		tt->tail_im[k] = tail * sin(w * window);
+	}
+	// A sinusoid of amplitude A sums to A/2 times the weights of the window
+	tt->scale = 2.0 * (1.0 - TONE_TRACKER_DAMPING) / (1.0 - tail);
+	return tt;
+}
+
+// Feed interleaved samples from the capture stream, the magnitudes follow the end of the block
+void process_tone_tracker(ToneTracker *tt, const float *in, size_t frames) {
+	if (!tt || !in) return;
+	size_t channels = tt->channels;
+	size_t targets = tt->targets;
+	const double *restrict rot_re = tt->rot_re;
+	const double *restrict rot_im = tt->rot_im;
+	const double *restrict tail_re = tt->tail_re;
+	const double *restrict tail_im = tt->tail_im;
+
+	for (size_t c = 0; c < channels; c++) {
+		double *restrict re = tt->state_re + c * targets;
+		double *restrict im = tt->state_im + c * targets;
+		double *restrict history = tt->history + c * tt->window;
+		size_t pos = tt->pos;
+		for (size_t t = 0; t < frames; t++) {
+			double x = in[t * channels + c];
+			double old = history[pos];
+			history[pos] = x;
+			pos = pos + 1 == tt->window ? 0 : pos + 1;
+
+			#pragma omp simd
+			for (size_t k = 0; k < targets; k++) {
+				double r = rot_re[k] * re[k] - rot_im[k] * im[k] + x - tail_re[k] * old;
+				double i = rot_re[k] * im[k] + rot_im[k] * re[k] - tail_im[k] * old;
+				re[k] = r;
+				im[k] = i;
+			}
+		}
+
+		double *restrict magnitude = tt->magnitude + c * targets;
+		#pragma omp simd
+		for (size_t k = 0; k < targets; k++) {
+			magnitude[k] = tt->scale * sqrt(re[k] * re[k] + im[k] * im[k]);
+		}
+	}
+	tt->pos = (tt->pos + frames) % tt->window;
+}
+
+// Forget the window and the coefficients
+void reset_tone_tracker(ToneTracker *tt) {
+	if (!tt) return;
+	memset(tt->state_re, 0, sizeof(double) * tt->channels * tt->targets);
+	memset(tt->state_im, 0, sizeof(double) * tt->channels * tt->targets);
+	memset(tt->magnitude, 0, sizeof(double) * tt->channels * tt->targets);
+	memset(tt->history, 0, sizeof(double) * tt->channels * tt->window);
+	tt->pos = 0;
+}
+#endif // TONE_TRACKER_H
@@ -0,0 +1,149 @@
+#ifndef VIDEO_WRITER_H
+#define VIDEO_WRITER_H
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Uncompressed video of rendered frames, for offline renders.
+// A path ending in .rgba or .raw gets the RGBA8 frames as they are, anything
+// else a YUV4MPEG2 stream: 4:2:0 with full range BT.601 chroma, what ffmpeg
+// and most encoders read from a pipe without being told the frame size:
+//   bin/main --render song.flac - | ffmpeg -i - -i song.flac -c:v libx264 out.mp4
+// A path of "-" writes to stdout; what the program prints goes to stderr
+// from then on, so it doesn't end up in the stream.
+
+typedef enum {
+	VIDEO_FORMAT_Y4M,
+	VIDEO_FORMAT_RGBA
+} VideoFormat;
+
+typedef struct {
+	FILE *file;
+	VideoFormat format;
+	int width, height;
+	int fps;
+	unsigned char *planes; // Y, U and V of a frame, converted before a single write
+	size_t plane_size;     // Bytes of the Y plane
+	size_t chroma_size;    // Bytes of the U and of the V plane
+	unsigned long frames;  // Frames written
+} VideoWriter;
+
+// Open `path` for width x height frames at fps, NULL on failure
+VideoWriter* create_video_writer(const char *path, int width, int height, int fps) {
+	if (width <= 0 || height <= 0 || fps <= 0) {
+		printf("Error: Invalid video format %dx%d at %d fps\n", width, height, fps);
+		return NULL;
+	}
+	VideoWriter *writer = (VideoWriter *)calloc(1, sizeof(VideoWriter));
+	if (writer == NULL) {
+		printf("Error: Failed to allocate memory for the video writer\n");
+		return NULL;
+	}
+	writer->width = width;
+	writer->height = height;
+	writer->fps = fps;
+	const char *extension = strrchr(path, '.');
+	writer->format = extension != NULL && (strcmp(extension, ".rgba") == 0 || strcmp(extension, ".raw") == 0) ? VIDEO_FORMAT_RGBA : VIDEO_FORMAT_Y4M;
+	if (strcmp(path, "-") == 0) {
+		// The stream keeps stdout, prints follow stderr
+		fflush(stdout);
+		int fd = dup(STDOUT_FILENO);
+		writer->file = fd >= 0 ? fdopen(fd, "wb") : NULL;
+		if (writer->file != NULL) {
+			dup2(STDERR_FILENO, STDOUT_FILENO);
+		}
+	} else {
+		writer->file = fopen(path, "wb");
+	}
+	if (writer->file == NULL) {
+		printf("Error: Failed to open %s for writing video\n", path);
+		free(writer);
+		return NULL;
+	}
+	if (writer->format == VIDEO_FORMAT_Y4M) {
+		writer->plane_size = (size_t)width * height;
+		writer->chroma_size = (size_t)((width + 1) / 2) * ((height + 1) / 2);
+		writer->planes = (unsigned char *)malloc(writer->plane_size + 2 * writer->chroma_size);
+		if (writer->planes == NULL) {
+			printf("Error: Failed to allocate memory for the video writer\n");
+			fclose(writer->file);
+			free(writer);
+			return NULL;
+		}
+		fprintf(writer->file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height, fps);
+	}
+	return writer;
+}
+
+void destroy_video_writer(VideoWriter *writer) {
+	if (writer == NULL) return;
+	fclose(writer->file);
+	free(writer->planes);
+	free(writer);
+}
+
+static inline unsigned char _video_writer_clamp(float value) {
+	return value <= 0.0f ? 0 : value >= 255.0f ? 255 : (unsigned char)(value + 0.5f);
+}
+
+// Convert an RGBA8 frame to the Y, U and V planes, every chroma sample averages a 2x2 block
+static void _video_writer_yuv(VideoWriter *writer, const unsigned char *rgba, int bottom_up) {
+	int width = writer->width;
+	int height = writer->height;
+	int chroma_width = (width + 1) / 2;
+	unsigned char *y_plane = writer->planes;
+	unsigned char *u_plane = y_plane + writer->plane_size;
+	unsigned char *v_plane = u_plane + writer->chroma_size;
+	for (int y = 0; y < height; y += 2) {
+		// Rows of the frame from the top
+		const unsigned char *rows[2];
+		rows[0] = rgba + (size_t)(bottom_up ? height - 1 - y : y) * width * 4;
+		rows[1] = y + 1 < height ? rgba + (size_t)(bottom_up ? height - 2 - y : y + 1) * width * 4 : rows[0];
+		unsigned char *luma[2] = {y_plane + (size_t)y * width, y_plane + (size_t)(y + 1 < height ? y + 1 : y) * width};
+		for (int x = 0; x < width; x += 2) {
+			float r = 0.0f, g = 0.0f, b = 0.0f;
+			for (int k = 0; k < 2; k++) {
+				for (int dx = 0; dx < 2; dx++) {
+					int column = x + dx < width ? x + dx : x;
+					const unsigned char *pixel = rows[k] + (size_t)column * 4;
+					luma[k][column] = _video_writer_clamp(0.299f * pixel[0] + 0.587f * pixel[1] + 0.114f * pixel[2]);
+					r += pixel[0];
+					g += pixel[1];
+					b += pixel[2];
+				}
+			}
+			r *= 0.25f;
+			g *= 0.25f;
+			b *= 0.25f;
+			size_t chroma = (size_t)(y / 2) * chroma_width + x / 2;
+			u_plane[chroma] = _video_writer_clamp(128.0f - 0.168736f * r - 0.331264f * g + 0.5f * b);
+			v_plane[chroma] = _video_writer_clamp(128.0f + 0.5f * r - 0.418688f * g - 0.081312f * b);
+		}
+	}
+}
+
+// Append a width x height RGBA8 frame, rows from the bottom when it was read back from GL. 0 on success
+int video_writer_frame(VideoWriter *writer, const unsigned char *rgba, int bottom_up) {
+	size_t row = (size_t)writer->width * 4;
+	if (writer->format == VIDEO_FORMAT_RGBA) {
+		for (int y = 0; y < writer->height; y++) {
+			const unsigned char *source = rgba + (size_t)(bottom_up ? writer->height - 1 - y : y) * row;
+			if (fwrite(source, 1, row, writer->file) != row) {
+				printf("Error: Failed to write video frame %lu\n", writer->frames);
+				return -1;
+			}
+		}
+	} else {
+		_video_writer_yuv(writer, rgba, bottom_up);
+		size_t size = writer->plane_size + 2 * writer->chroma_size;
+		if (fputs("FRAME\n", writer->file) == EOF || fwrite(writer->planes, 1, size, writer->file) != size) {
+			printf("Error: Failed to write video frame %lu\n", writer->frames);
+			return -1;
+		}
+	}
+	writer->frames++;
+	return 0;
+}
+#endif // VIDEO_WRITER_H
@@ -0,0 +1,251 @@
+#ifndef WAVEFORM_PYRAMID_H
+#define WAVEFORM_PYRAMID_H
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+#include "arena.h"
+
+// Min/max/RMS decimation pyramid of the waveform of every channel.
+// Level 0 keeps the minimum, maximum and sum of squares of every block of
+// WAVEFORM_PYRAMID_BLOCK samples, every following level merges
+// WAVEFORM_PYRAMID_FACTOR entries of the level below. Each level is a ring
+// over the same history, so the envelope of any span of it is a handful of
+// entries per level: whole coarse entries in the middle, finer ones towards
+// the edges, and the samples themselves for the parts of a block at the edges
+// while they are still in the ring of recent samples. A waveform view then
+// costs the same per screen column whether it covers a buffer or minutes.
+// The analysis pushes every channel of a hop, then publishes the hop by
+// bumping `written`, like the spectrogram; readers only go up to it.
+
+#define WAVEFORM_PYRAMID_BLOCK 16         // Samples per entry of level 0, a power of two
+#define WAVEFORM_PYRAMID_FACTOR 4         // Entries of a level merged into one of the next
+#define WAVEFORM_PYRAMID_MAX_LEVELS 16
+#define WAVEFORM_PYRAMID_RECENT 65536     // Samples kept as they are, at least, a power of two
+#define WAVEFORM_PYRAMID_DEFAULT_SECONDS 60.0 // History of a waveform view, none is kept unless asked for
+
+typedef struct {
+	float min, max;
+	float energy; // Sum of squares
+} WaveformEnvelope;
+
+// Envelope of the samples a screen column covers
+typedef struct {
+	float min, max, rms;
+} WaveformColumn;
+
+typedef struct {
+	size_t channels;
+	size_t levels;
+	size_t capacity;      // Samples per channel the rings cover, readers get capacity - recent of them
+	size_t recent;        // Samples per channel kept as they are
+	float *samples;       // [channels][recent] Ring of the newest samples
+	WaveformEnvelope *entries[WAVEFORM_PYRAMID_MAX_LEVELS]; // [channels][capacity / block size of the level]
+	atomic_ullong written; // Samples per channel published since init
+} WaveformPyramid;
+
+// Samples an entry of `level` covers
+static inline uint64_t waveform_pyramid_block(size_t level) {
+	uint64_t block = WAVEFORM_PYRAMID_BLOCK;
+	for (size_t l = 0; l < level; l++) {
+		block *= WAVEFORM_PYRAMID_FACTOR;
+	}
+	return block;
+}
+
+// Layout of a pyramid keeping `history` samples, pushed at most `max_hop` at a time
+static void _waveform_pyramid_layout(size_t history, size_t max_hop, size_t *levels, size_t *capacity, size_t *recent) {
+	// Levels are added while the new one still has a few entries
+	*levels = 1;
+	while (*levels < WAVEFORM_PYRAMID_MAX_LEVELS && waveform_pyramid_block(*levels) * WAVEFORM_PYRAMID_FACTOR <= history) {
+		(*levels)++;
+	}
+	// The hop being pushed writes ahead of what readers see, so it never overwrites what they read
+	*recent = WAVEFORM_PYRAMID_RECENT;
+	while (*recent < 2 * max_hop) {
+		*recent *= 2;
+	}
+	uint64_t top = waveform_pyramid_block(*levels - 1);
+	*capacity = (size_t)((history + *recent + top - 1) / top * top);
+}
+
+// Bytes taken in an arena by init_waveform_pyramid
+size_t waveform_pyramid_arena_size(size_t channels, size_t history, size_t max_hop) {
+	size_t levels, capacity, recent;
+	_waveform_pyramid_layout(history, max_hop, &levels, &capacity, &recent);
+	size_t size = arena_size(sizeof(WaveformPyramid)) + arena_size(sizeof(float) * channels * recent);
+	for (size_t l = 0; l < levels; l++) {
+		size += arena_size(sizeof(WaveformEnvelope) * channels * (capacity / waveform_pyramid_block(l)));
+	}
+	return size;
+}
+
+// Initialize a pyramid over `history` samples per channel, it is released with the arena
+WaveformPyramid* init_waveform_pyramid(Arena *arena, size_t channels, size_t history, size_t max_hop) {
+	if (channels == 0 || history == 0 || max_hop == 0) {
+		printf("Error: Invalid waveform pyramid configuration\n");
+		return NULL;
+	}
+	WaveformPyramid *pyramid = (WaveformPyramid *)arena_alloc(arena, sizeof(WaveformPyramid));
+	if (!pyramid) return NULL;
+	pyramid->channels = channels;
+	_waveform_pyramid_layout(history, max_hop, &pyramid->levels, &pyramid->capacity, &pyramid->recent);
+	pyramid->samples = (float *)arena_alloc(arena, sizeof(float) * channels * pyramid->recent);
+	if (!pyramid->samples) return NULL;
+	for (size_t l = 0; l < pyramid->levels; l++) {
+		pyramid->entries[l] = (WaveformEnvelope *)arena_alloc(arena, sizeof(WaveformEnvelope) * channels * (pyramid->capacity / waveform_pyramid_block(l)));
+		if (!pyramid->entries[l]) return NULL;
+	}
+	atomic_init(&pyramid->written, 0);
+	return pyramid;
+}
+
+// Entry `index` of a level, counted from the first sample ever pushed
+static inline WaveformEnvelope* _waveform_pyramid_entry(WaveformPyramid *pyramid, size_t channel, size_t level, uint64_t index) {
+	size_t entries = pyramid->capacity / waveform_pyramid_block(level);
+	return pyramid->entries[level] + channel * entries + index % entries;
+}
+
+// Sample `index` of a channel, still in the ring of recent samples
+static inline float* _waveform_pyramid_sample(WaveformPyramid *pyramid, size_t channel, uint64_t index) {
+	return pyramid->samples + channel * pyramid->recent + (index & (pyramid->recent - 1));
+}
+
+// Envelope of `count` contiguous samples
+static inline WaveformEnvelope _waveform_pyramid_reduce(const float *samples, size_t count) {
+	float lo = samples[0], hi = samples[0], energy = 0.0f;
+	#pragma omp simd reduction(min:lo) reduction(max:hi) reduction(+:energy)
+	for (size_t j = 0; j < count; j++) {
+		lo = samples[j] < lo ? samples[j] : lo;
+		hi = samples[j] > hi ? samples[j] : hi;
+		energy += samples[j] * samples[j];
+	}
+	return (WaveformEnvelope){lo, hi, energy};
+}
+
+static inline void _waveform_pyramid_merge(WaveformEnvelope *into, const WaveformEnvelope *entry) {
+	into->min = entry->min < into->min ? entry->min : into->min;
+	into->max = entry->max > into->max ? entry->max : into->max;
+	into->energy += entry->energy;
+}
+
+// Add `frames` interleaved frames of one channel, hidden from readers until waveform_pyramid_publish
+void waveform_pyramid_push(WaveformPyramid *pyramid, size_t channel, const float *raw, size_t frames, size_t stride) {
+	uint64_t position = atomic_load_explicit(&pyramid->written, memory_order_relaxed);
+	for (size_t j = 0; j < frames; j++) {
+		*_waveform_pyramid_sample(pyramid, channel, position + j) = raw[j * stride];
+	}
+	// Blocks completed by this hop; recent is a multiple of the block, a block never wraps around the ring
+	uint64_t first = position / WAVEFORM_PYRAMID_BLOCK;
+	uint64_t last = (position + frames) / WAVEFORM_PYRAMID_BLOCK;
+	for (uint64_t b = first; b < last; b++) {
+		*_waveform_pyramid_entry(pyramid, channel, 0, b) =
+			_waveform_pyramid_reduce(_waveform_pyramid_sample(pyramid, channel, b * WAVEFORM_PYRAMID_BLOCK), WAVEFORM_PYRAMID_BLOCK);
+		// The last entry of a group completes the entry above it
+		uint64_t index = b;
+		for (size_t l = 1; l < pyramid->levels && (index + 1) % WAVEFORM_PYRAMID_FACTOR == 0; l++) {
+			index /= WAVEFORM_PYRAMID_FACTOR;
+			uint64_t child = index * WAVEFORM_PYRAMID_FACTOR;
+			WaveformEnvelope merged = *_waveform_pyramid_entry(pyramid, channel, l - 1, child);
+			for (size_t k = 1; k < WAVEFORM_PYRAMID_FACTOR; k++) {
+				_waveform_pyramid_merge(&merged, _waveform_pyramid_entry(pyramid, channel, l - 1, child + k));
+			}
+			*_waveform_pyramid_entry(pyramid, channel, l, index) = merged;
+		}
+	}
+}
+
+// Publish the frames pushed for every channel
+void waveform_pyramid_publish(WaveformPyramid *pyramid, size_t frames) {
+	atomic_fetch_add_explicit(&pyramid->written, frames, memory_order_release);
+}
+
+// Samples per channel published since init
+uint64_t waveform_pyramid_written(WaveformPyramid *pyramid) {
+	return atomic_load_explicit(&pyramid->written, memory_order_acquire);
+}
+
+// Merge the samples [from, to) of a channel that don't make a whole block
+static void _waveform_pyramid_partial(WaveformPyramid *pyramid, size_t channel, uint64_t from, uint64_t to, uint64_t oldest_sample, WaveformEnvelope *envelope) {
+	if (from >= to) return;
+	if (from >= oldest_sample) {
+		for (uint64_t s = from; s < to; s++) {
+			float value = *_waveform_pyramid_sample(pyramid, channel, s);
+			WaveformEnvelope sample = {value, value, value * value};
+			_waveform_pyramid_merge(envelope, &sample);
+		}
+		return;
+	}
+	// Gone from the ring: the blocks holding them, their energy scaled to the samples asked for
+	uint64_t first = from / WAVEFORM_PYRAMID_BLOCK;
+	uint64_t last = (to - 1) / WAVEFORM_PYRAMID_BLOCK;
+	WaveformEnvelope blocks = *_waveform_pyramid_entry(pyramid, channel, 0, first);
+	for (uint64_t b = first + 1; b <= last; b++) {
+		_waveform_pyramid_merge(&blocks, _waveform_pyramid_entry(pyramid, channel, 0, b));
+	}
+	blocks.energy *= (float)(to - from) / ((last - first + 1) * WAVEFORM_PYRAMID_BLOCK);
+	_waveform_pyramid_merge(envelope, &blocks);
+}
+
+// Envelope of the samples [start, end) of a channel, clamped to the history published as of `written`
+WaveformEnvelope waveform_pyramid_range(WaveformPyramid *pyramid, size_t channel, uint64_t start, uint64_t end, uint64_t written) {
+	uint64_t history = pyramid->capacity - pyramid->recent;
+	uint64_t oldest = written > history ? written - history : 0;
+	// Samples still in the ring, away from where the next hop writes
+	uint64_t oldest_sample = written > pyramid->recent / 2 ? written - pyramid->recent / 2 : 0;
+	start = start < oldest ? oldest : start;
+	end = end > written ? written : end;
+	if (start >= end) return (WaveformEnvelope){0.0f, 0.0f, 0.0f};
+
+	WaveformEnvelope envelope = {INFINITY, -INFINITY, 0.0f};
+	uint64_t first = (start + WAVEFORM_PYRAMID_BLOCK - 1) / WAVEFORM_PYRAMID_BLOCK; // First whole block
+	uint64_t last = end / WAVEFORM_PYRAMID_BLOCK;                                   // One past the last whole block
+	if (first >= last) {
+		_waveform_pyramid_partial(pyramid, channel, start, end, oldest_sample, &envelope);
+		return envelope;
+	}
+	_waveform_pyramid_partial(pyramid, channel, start, first * WAVEFORM_PYRAMID_BLOCK, oldest_sample, &envelope);
+	_waveform_pyramid_partial(pyramid, channel, last * WAVEFORM_PYRAMID_BLOCK, end, oldest_sample, &envelope);
+	// Whole blocks, coarse entries in the middle and finer ones towards the edges
+	for (size_t l = 0; first < last; l++) {
+		if (l + 1 == pyramid->levels) {
+			for (uint64_t i = first; i < last; i++) {
+				_waveform_pyramid_merge(&envelope, _waveform_pyramid_entry(pyramid, channel, l, i));
+			}
+			break;
+		}
+		while (first < last && first % WAVEFORM_PYRAMID_FACTOR != 0) {
+			_waveform_pyramid_merge(&envelope, _waveform_pyramid_entry(pyramid, channel, l, first++));
+		}
+		while (last > first && last % WAVEFORM_PYRAMID_FACTOR != 0) {
+			_waveform_pyramid_merge(&envelope, _waveform_pyramid_entry(pyramid, channel, l, --last));
+		}
+		first /= WAVEFORM_PYRAMID_FACTOR;
+		last /= WAVEFORM_PYRAMID_FACTOR;
+	}
+	return envelope;
+}
+
+// Envelope of `columns` columns of `width` samples each, ending at the newest published sample.
+// Columns start on multiples of their width, so a scrolling view doesn't shimmer as hops arrive.
+// Columns older than the history are silent. Returns the sample the last column ends at
+uint64_t waveform_pyramid_columns(WaveformPyramid *pyramid, size_t channel, uint64_t width, WaveformColumn *out, size_t columns) {
+	uint64_t written = waveform_pyramid_written(pyramid);
+	width = width > 0 ? width : 1;
+	uint64_t end = written / width * width;
+	for (size_t k = 0; k < columns; k++) {
+		uint64_t offset = (uint64_t)(columns - k) * width;
+		WaveformColumn *column = &out[k];
+		if (offset > end) {
+			*column = (WaveformColumn){0.0f, 0.0f, 0.0f};
+			continue;
+		}
+		WaveformEnvelope envelope = waveform_pyramid_range(pyramid, channel, end - offset, end - offset + width, written);
+		column->min = envelope.min;
+		column->max = envelope.max;
+		column->rms = sqrtf(envelope.energy / width);
+	}
+	return end;
+}
+#endif // WAVEFORM_PYRAMID_H